@@ -0,0 +1,99 @@
+#pragma once
+
+#ifndef AABB_H
+#define AABB_H
+
+#include "rtweekend.h"
+
+#include <limits>
+#include <utility>
+
+// Rounding in the slab test can put a box's exit just before its entry when a ray grazes an
+// edge or corner, which would cull whatever touches it there (e.g. a ray through a shared mesh
+// vertex). Pushing the exit out by 1 + 2 gamma(3) keeps the test conservative (Ize 2013).
+const real slab_exit_scale = 1 + 3 * std::numeric_limits<real>::epsilon();
+
+class aabb
+{
+public:
+	point3 minimum;
+	point3 maximum;
+
+public:
+	// default box is empty, so expanding it by anything gives that thing's bounds
+	aabb() : minimum(infinity, infinity, infinity), maximum(-infinity, -infinity, -infinity) {}
+	aabb(const point3& a, const point3& b) : minimum(a), maximum(b) {}
+
+	point3 min() const { return minimum; }
+	point3 max() const { return maximum; }
+
+	point3 centroid() const
+	{
+		return 0.5 * (minimum + maximum);
+	}
+
+	real surface_area() const
+	{
+		auto d = maximum - minimum;
+		return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+	}
+
+	int longest_axis() const
+	{
+		auto d = maximum - minimum;
+		if (d.x() > d.y() && d.x() > d.z())
+			return 0;
+		return d.y() > d.z() ? 1 : 2;
+	}
+
+	// plain compares rather than fmin/fmax, these sit in the BVH build's inner loops
+	void expand(const point3& p)
+	{
+		for (int a = 0; a < 3; a++) {
+			minimum[a] = p[a] < minimum[a] ? p[a] : minimum[a];
+			maximum[a] = p[a] > maximum[a] ? p[a] : maximum[a];
+		}
+	}
+
+	void expand(const aabb& box)
+	{
+		for (int a = 0; a < 3; a++) {
+			minimum[a] = box.minimum[a] < minimum[a] ? box.minimum[a] : minimum[a];
+			maximum[a] = box.maximum[a] > maximum[a] ? box.maximum[a] : maximum[a];
+		}
+	}
+
+	bool hit(const ray& r, real t_min, real t_max) const
+	{
+		vec3 dir = r.direction();
+		vec3 inv_dir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+		return hit(r.origin(), inv_dir, t_min, t_max);
+	}
+
+	// slab test with the reciprocal direction precomputed by the caller,
+	// so a traversal only pays for the divisions once per ray
+	inline bool hit(const point3& orig, const vec3& inv_dir, real t_min, real t_max) const
+	{
+		for (int a = 0; a < 3; a++) {
+			auto t0 = (minimum[a] - orig[a]) * inv_dir[a];
+			auto t1 = (maximum[a] - orig[a]) * inv_dir[a];
+			if (inv_dir[a] < 0)
+				std::swap(t0, t1);
+			t1 *= slab_exit_scale;
+			t_min = t0 > t_min ? t0 : t_min;
+			t_max = t1 < t_max ? t1 : t_max;
+			if (t_max < t_min)
+				return false;
+		}
+		return true;
+	}
+};
+
+inline aabb surrounding_box(const aabb& box0, const aabb& box1)
+{
+	aabb box = box0;
+	box.expand(box1);
+	return box;
+}
+
+#endif
@@ -0,0 +1,277 @@
+#pragma once
+
+#ifndef ACCUMULATION_H
+#define ACCUMULATION_H
+
+#include "rtweekend.h"
+
+#include "colour.h"
+#include "settings.h"
+#include "stats.h"
+#include "tiles.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Allocator that leaves new elements uninitialised, so a big buffer's pages stay untouched
+// until something first writes them, and that write decides which NUMA node they live on.
+template <typename T>
+struct uninitialised_allocator : std::allocator<T>
+{
+	template <typename U>
+	struct rebind { using other = uninitialised_allocator<U>; };
+
+	uninitialised_allocator() noexcept {}
+	template <typename U>
+	uninitialised_allocator(const uninitialised_allocator<U>&) noexcept {}
+
+	template <typename U>
+	void construct(U* p) noexcept { ::new (static_cast<void*>(p)) U; }
+	template <typename U, typename... Args>
+	void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+};
+
+template <typename T>
+using pixel_vector = std::vector<T, uninitialised_allocator<T>>;
+
+// Running per-pixel sums of every sample rendered so far, refined pass after pass. The
+// displayable image is the sum over the sample count, so more samples can always be added
+// later, including after a save and reload.
+class accumulation_buffer
+{
+public:
+	long long width = 0, height = 0;
+	uint64_t seed = 0;   // seed the samples were rendered with, resuming with another would repeat nothing useful
+	uint64_t passes = 0; // passes completed, picks the rng streams of the next pass
+	pixel_vector<float> sum;   // linear RGB
+	pixel_vector<int> samples; // per pixel
+	pixel_vector<float> cost;  // seconds spent on each pixel, only measured with RT_STATS and never saved
+	// First-hit albedo (RGB), normal (xyz) and depth for the denoiser, summed over samples like
+	// sum, and the sum of each sample's luminance squared for its variance. Empty unless
+	// enable_aovs is called.
+	pixel_vector<float> albedo, normal, depth, luminance_squares;
+	// Set by first_touch until every tile has been cleared, render threads clear each tile they
+	// take before adding to it so its pages end up on their own NUMA node. Only changes between passes.
+	bool untouched = false;
+
+public:
+	accumulation_buffer() {}
+	// every pixel starts at zero, or is left for clear_tile with first_touch
+	accumulation_buffer(long long w, long long h, uint64_t s, bool first_touch = false);
+
+	void clear_tile(const tile& t);
+
+	// zeroed, or left for clear_tile like everything else while untouched
+	void enable_aovs();
+	bool has_aovs() const { return !depth.empty(); }
+
+	// tiles never overlap so threads can add to their own pixels without locking
+	void add(long long pixel_index, const colour& pixel_sum, int n)
+	{
+		sum[pixel_index * 3] += static_cast<float>(pixel_sum.x());
+		sum[pixel_index * 3 + 1] += static_cast<float>(pixel_sum.y());
+		sum[pixel_index * 3 + 2] += static_cast<float>(pixel_sum.z());
+		samples[pixel_index] += n;
+	}
+
+	void add_aovs(long long pixel_index, const colour& albedo_sum, const vec3& normal_sum, real depth_sum, real luminance_squares_sum)
+	{
+		for (int c = 0; c < 3; ++c) {
+			albedo[pixel_index * 3 + c] += static_cast<float>(albedo_sum[c]);
+			normal[pixel_index * 3 + c] += static_cast<float>(normal_sum[c]);
+		}
+		depth[pixel_index] += static_cast<float>(depth_sum);
+		luminance_squares[pixel_index] += static_cast<float>(luminance_squares_sum);
+	}
+
+	// mean linear colour of every pixel, the image the writers expect
+	void resolve(std::vector<float>& image) const;
+	// mean albedo and depth, the normals averaged then made unit length (zero where nothing was
+	// hit) and the variance of each pixel's mean luminance, -1 where too few samples to tell
+	void resolve_aovs(std::vector<float>& albedo_image, std::vector<float>& normal_image, std::vector<float>& depth_image,
+		std::vector<float>& variance_image) const;
+
+	long long total_samples() const;
+
+	// Binary checkpoint, a small header then the raw buffers in native byte order, the AOVs too
+	// when there are any. Saving writes to a temporary file first so a job killed mid-save leaves
+	// the previous checkpoint intact.
+	bool save(const std::string& path) const;
+	// fails if the file is missing, truncated or not a checkpoint
+	bool load(const std::string& path);
+};
+
+accumulation_buffer::accumulation_buffer(long long w, long long h, uint64_t s, bool first_touch) : width(w), height(h), seed(s),
+	sum(w * h * 3), samples(w * h), cost(stats_enabled ? w * h : 0), untouched(first_touch)
+{
+	if (!first_touch) {
+		std::fill(sum.begin(), sum.end(), 0.0f);
+		std::fill(samples.begin(), samples.end(), 0);
+		std::fill(cost.begin(), cost.end(), 0.0f);
+	}
+}
+
+void accumulation_buffer::clear_tile(const tile& t)
+{
+	for (long long j = t.y0; j < t.y1; ++j) {
+		long long row = j * width;
+		std::fill(sum.begin() + (row + t.x0) * 3, sum.begin() + (row + t.x1) * 3, 0.0f);
+		std::fill(samples.begin() + row + t.x0, samples.begin() + row + t.x1, 0);
+		if (!cost.empty())
+			std::fill(cost.begin() + row + t.x0, cost.begin() + row + t.x1, 0.0f);
+		if (has_aovs()) {
+			std::fill(albedo.begin() + (row + t.x0) * 3, albedo.begin() + (row + t.x1) * 3, 0.0f);
+			std::fill(normal.begin() + (row + t.x0) * 3, normal.begin() + (row + t.x1) * 3, 0.0f);
+			std::fill(depth.begin() + row + t.x0, depth.begin() + row + t.x1, 0.0f);
+			std::fill(luminance_squares.begin() + row + t.x0, luminance_squares.begin() + row + t.x1, 0.0f);
+		}
+	}
+}
+
+void accumulation_buffer::enable_aovs()
+{
+	albedo.resize(sum.size());
+	normal.resize(sum.size());
+	depth.resize(samples.size());
+	luminance_squares.resize(samples.size());
+	if (!untouched) {
+		std::fill(albedo.begin(), albedo.end(), 0.0f);
+		std::fill(normal.begin(), normal.end(), 0.0f);
+		std::fill(depth.begin(), depth.end(), 0.0f);
+		std::fill(luminance_squares.begin(), luminance_squares.end(), 0.0f);
+	}
+}
+
+// "RTACCUM" and a format version, 2 added a flags word saying whether the AOVs follow the samples
+const char accumulation_magic[8] = { 'R', 'T', 'A', 'C', 'C', 'U', 'M', '2' };
+const uint64_t checkpoint_has_aovs = 1;
+
+void accumulation_buffer::resolve(std::vector<float>& image) const
+{
+	image.resize(sum.size());
+	for (size_t i = 0; i < samples.size(); ++i) {
+		float scale = samples[i] > 0 ? 1.0f / samples[i] : 0.0f;
+		image[i * 3] = sum[i * 3] * scale;
+		image[i * 3 + 1] = sum[i * 3 + 1] * scale;
+		image[i * 3 + 2] = sum[i * 3 + 2] * scale;
+	}
+}
+
+void accumulation_buffer::resolve_aovs(std::vector<float>& albedo_image, std::vector<float>& normal_image, std::vector<float>& depth_image,
+	std::vector<float>& variance_image) const
+{
+	albedo_image.resize(albedo.size());
+	normal_image.resize(normal.size());
+	depth_image.resize(depth.size());
+	variance_image.resize(depth.size());
+	for (size_t i = 0; i < samples.size(); ++i) {
+		float scale = samples[i] > 0 ? 1.0f / samples[i] : 0.0f;
+		const float* n = &normal[i * 3];
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		float normal_scale = length > 0 ? 1.0f / length : 0.0f;
+		for (int c = 0; c < 3; ++c) {
+			albedo_image[i * 3 + c] = albedo[i * 3 + c] * scale;
+			normal_image[i * 3 + c] = n[c] * normal_scale;
+		}
+		depth_image[i] = depth[i] * scale;
+		// the samples' variance, over the count again for the mean's
+		if (samples[i] > 1) {
+			const float* c = &sum[i * 3];
+			float mean = static_cast<float>(luminance(colour(c[0], c[1], c[2]))) * scale;
+			float sample_variance = std::max(0.0f, luminance_squares[i] * scale - mean * mean) * samples[i] / (samples[i] - 1);
+			variance_image[i] = sample_variance * scale;
+		} else {
+			variance_image[i] = -1;
+		}
+	}
+}
+
+long long accumulation_buffer::total_samples() const
+{
+	long long total = 0;
+	for (int n : samples)
+		total += n;
+	return total;
+}
+
+bool accumulation_buffer::save(const std::string& path) const
+{
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream file_out(tmp_path, std::ios::binary);
+		if (!file_out)
+			return false;
+		file_out.write(accumulation_magic, sizeof(accumulation_magic));
+		int64_t header[2] = { width, height };
+		uint64_t state[3] = { seed, passes, has_aovs() ? checkpoint_has_aovs : 0 };
+		file_out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file_out.write(reinterpret_cast<const char*>(state), sizeof(state));
+		file_out.write(reinterpret_cast<const char*>(sum.data()), sum.size() * sizeof(float));
+		file_out.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(int));
+		if (has_aovs()) {
+			file_out.write(reinterpret_cast<const char*>(albedo.data()), albedo.size() * sizeof(float));
+			file_out.write(reinterpret_cast<const char*>(normal.data()), normal.size() * sizeof(float));
+			file_out.write(reinterpret_cast<const char*>(depth.data()), depth.size() * sizeof(float));
+			file_out.write(reinterpret_cast<const char*>(luminance_squares.data()), luminance_squares.size() * sizeof(float));
+		}
+		// closed here so a failure to flush the end of it counts too
+		file_out.close();
+		if (!file_out) {
+			std::remove(tmp_path.c_str());
+			return false;
+		}
+	}
+	// replaces the old checkpoint in one step, so there's always a whole one to resume from
+	std::error_code error;
+	std::filesystem::rename(tmp_path, path, error);
+	if (error)
+		std::remove(tmp_path.c_str());
+	return !error;
+}
+
+bool accumulation_buffer::load(const std::string& path)
+{
+	std::ifstream file_in(path, std::ios::binary);
+	if (!file_in)
+		return false;
+
+	char magic[sizeof(accumulation_magic)];
+	int64_t header[2];
+	// version 1 checkpoints have no flags
+	uint64_t state[3] = {};
+	file_in.read(magic, sizeof(magic));
+	bool version_1 = magic[7] == '1';
+	file_in.read(reinterpret_cast<char*>(header), sizeof(header));
+	file_in.read(reinterpret_cast<char*>(state), version_1 ? 2 * sizeof(uint64_t) : sizeof(state));
+	if (!file_in || std::memcmp(magic, accumulation_magic, sizeof(magic) - 1) != 0 || (!version_1 && magic[7] != accumulation_magic[7])
+		|| header[0] <= 0 || header[1] <= 0 || header[0] > max_image_size || header[1] > max_image_size)
+		return false;
+
+	accumulation_buffer loaded(header[0], header[1], state[0]);
+	loaded.passes = state[1];
+	file_in.read(reinterpret_cast<char*>(loaded.sum.data()), loaded.sum.size() * sizeof(float));
+	file_in.read(reinterpret_cast<char*>(loaded.samples.data()), loaded.samples.size() * sizeof(int));
+	if (state[2] & checkpoint_has_aovs) {
+		loaded.enable_aovs();
+		file_in.read(reinterpret_cast<char*>(loaded.albedo.data()), loaded.albedo.size() * sizeof(float));
+		file_in.read(reinterpret_cast<char*>(loaded.normal.data()), loaded.normal.size() * sizeof(float));
+		file_in.read(reinterpret_cast<char*>(loaded.depth.data()), loaded.depth.size() * sizeof(float));
+		file_in.read(reinterpret_cast<char*>(loaded.luminance_squares.data()), loaded.luminance_squares.size() * sizeof(float));
+	}
+	if (!file_in)
+		return false;
+
+	*this = std::move(loaded);
+	return true;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#pragma once
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#endif
+
+// Keeps the calling thread on a set of logical CPUs, so it stops migrating between cores (and
+// sockets) mid-render and taking its cache with it. Threads pin themselves before they allocate
+// anything, so their first touches already happen on the right node. Returns false where the
+// platform doesn't support it or none of the CPUs exist.
+bool pin_this_thread(const std::vector<unsigned int>& cpus)
+{
+#if defined(_WIN32)
+	DWORD_PTR mask = 0;
+	for (unsigned int cpu : cpus) {
+		if (cpu < 8 * sizeof(DWORD_PTR))
+			mask |= static_cast<DWORD_PTR>(1) << cpu;
+	}
+	return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	bool any = false;
+	for (unsigned int cpu : cpus) {
+		if (cpu < CPU_SETSIZE) {
+			CPU_SET(cpu, &set);
+			any = true;
+		}
+	}
+	return any && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)cpus;
+	return false;
+#endif
+}
+
+// The logical CPUs of each NUMA node this process may run on, one node holding every CPU on
+// machines (or platforms) without NUMA. Memory a thread touches first is placed on its own node,
+// so the threads rendering on a node should also be the ones that first write what they read.
+struct numa_topology
+{
+	std::vector<std::vector<unsigned int>> nodes;
+
+	size_t cpu_count() const
+	{
+		size_t n = 0;
+		for (const auto& cpus : nodes)
+			n += cpus.size();
+		return n;
+	}
+};
+
+#ifdef __linux__
+// sysfs CPU and node lists, e.g. "0-3,8-11"
+inline std::vector<unsigned int> parse_cpu_list(const std::string& list)
+{
+	std::vector<unsigned int> out;
+	size_t pos = 0;
+	while (pos < list.size()) {
+		size_t comma = list.find(',', pos);
+		std::string range = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+		size_t dash = range.find('-');
+		try {
+			unsigned long first = std::stoul(range.substr(0, dash));
+			unsigned long last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+			for (unsigned long cpu = first; cpu <= last; ++cpu)
+				out.push_back(static_cast<unsigned int>(cpu));
+		} catch (...) {
+			return {};
+		}
+		if (comma == std::string::npos)
+			break;
+		pos = comma + 1;
+	}
+	return out;
+}
+
+inline std::string read_sysfs_line(const std::string& path)
+{
+	std::ifstream file_in(path);
+	std::string line;
+	std::getline(file_in, line);
+	return line;
+}
+#endif
+
+numa_topology read_numa_topology()
+{
+	numa_topology topology;
+#if defined(_WIN32)
+	ULONG highest = 0;
+	if (GetNumaHighestNodeNumber(&highest)) {
+		for (ULONG node = 0; node <= highest; ++node) {
+			ULONGLONG mask = 0;
+			if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask) || mask == 0)
+				continue;
+			std::vector<unsigned int> cpus;
+			for (unsigned int cpu = 0; cpu < 64; ++cpu) {
+				if (mask & (1ull << cpu))
+					cpus.push_back(cpu);
+			}
+			topology.nodes.push_back(cpus);
+		}
+	}
+#elif defined(__linux__)
+	// only the CPUs we're allowed on, containers and taskset can hide some
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool have_allowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+	for (unsigned int node : parse_cpu_list(read_sysfs_line("/sys/devices/system/node/online"))) {
+		std::vector<unsigned int> cpus;
+		for (unsigned int cpu : parse_cpu_list(read_sysfs_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"))) {
+			if (!have_allowed || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+				cpus.push_back(cpu);
+		}
+		if (!cpus.empty())
+			topology.nodes.push_back(cpus);
+	}
+#endif
+	if (topology.nodes.empty()) {
+		std::vector<unsigned int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+		for (unsigned int cpu = 0; cpu < cpus.size(); ++cpu)
+			cpus[cpu] = cpu;
+		topology.nodes.push_back(cpus);
+	}
+	return topology;
+}
+
+// where render threads go, compact fills one node before the next, spread deals threads out
+// to the nodes in turn so every node's memory controller is busy from the first few threads
+enum class thread_placement
+{
+	spread,
+	compact
+};
+
+struct thread_slot
+{
+	unsigned int cpu;
+	unsigned int node; // index into numa_topology::nodes
+};
+
+// a CPU for each of n_threads, wrapping around when there are more threads than CPUs
+std::vector<thread_slot> place_threads(const numa_topology& topology, unsigned int n_threads, thread_placement placement)
+{
+	std::vector<thread_slot> order;
+	if (placement == thread_placement::compact) {
+		for (unsigned int node = 0; node < topology.nodes.size(); ++node) {
+			for (unsigned int cpu : topology.nodes[node])
+				order.push_back({ cpu, node });
+		}
+	} else {
+		size_t widest = 0;
+		for (const auto& cpus : topology.nodes)
+			widest = std::max(widest, cpus.size());
+		for (size_t k = 0; k < widest; ++k) {
+			for (unsigned int node = 0; node < topology.nodes.size(); ++node) {
+				if (k < topology.nodes[node].size())
+					order.push_back({ topology.nodes[node][k], node });
+			}
+		}
+	}
+
+	std::vector<thread_slot> slots(n_threads);
+	for (unsigned int i = 0; i < n_threads; ++i)
+		slots[i] = order[i % order.size()];
+	return slots;
+}
+
+#endif
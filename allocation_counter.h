@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations by replacing the global operator new, so the render can report how
+// many it made and the sampling loop can be checked for any at all. Like everything else here
+// this is meant for a single translation unit, replacements can only be defined once.
+// Over-aligned new isn't counted, nothing in the renderer uses it.
+
+std::atomic<uint64_t> heap_allocations{ 0 };        // every thread, since the program started
+inline thread_local uint64_t thread_heap_allocations = 0; // this thread only
+
+void* operator new(size_t size)
+{
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	thread_heap_allocations++;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+// gcc sees free() on memory from operator new once this is inlined into a delete expression
+// and warns, not knowing new is replaced with malloc above
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete[](void* p) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+#endif
@@ -0,0 +1,171 @@
+#pragma once
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "rtweekend.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Bump allocator: hands out memory from big chunks in the order it's asked for and frees it all
+// at once. Objects made with make() get their destructors run, newest first, when the arena is
+// reset or destroyed, the bookkeeping for that lives in the arena too. reset() keeps the chunks,
+// so an arena that's reused for the same work only touches the heap the first time.
+class arena
+{
+public:
+	static constexpr size_t default_chunk_size = 64 * 1024;
+
+public:
+	arena(size_t chunk_bytes = default_chunk_size) : chunk_size(chunk_bytes) {}
+	arena(arena&& other) noexcept { take(other); }
+	arena& operator=(arena&& other) noexcept;
+	arena(const arena&) = delete;
+	arena& operator=(const arena&) = delete;
+	~arena() { release(); }
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// uninitialised space for count Ts, they're never destroyed so T should be plain data
+	template <typename T>
+	T* allocate_array(size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+	// construct a T in the arena, destroyed along with the arena unless that would be a no-op
+	template <typename T, typename... Args>
+	T* make(Args&&... args);
+
+	// destroy everything made so far and start again from the first chunk
+	void reset();
+
+	size_t bytes_used() const { return used; }
+
+private:
+	struct chunk
+	{
+		chunk* next;
+		size_t size; // usable bytes after the header
+	};
+	struct destructor
+	{
+		destructor* next;
+		void (*destroy)(void*);
+		void* object;
+	};
+
+	size_t chunk_size = default_chunk_size;
+	chunk* first = nullptr;
+	chunk* current = nullptr;
+	char* top = nullptr;
+	char* limit = nullptr;
+	size_t used = 0;
+	destructor* destructors = nullptr; // most recent first
+
+	static char* chunk_data(chunk* c) { return reinterpret_cast<char*>(c) + sizeof(chunk); }
+	void run_destructors();
+	void release();
+	void take(arena& other);
+};
+
+arena& arena::operator=(arena&& other) noexcept
+{
+	if (this != &other) {
+		release();
+		take(other);
+	}
+	return *this;
+}
+
+void* arena::allocate(size_t size, size_t alignment)
+{
+	auto align_up = [alignment](char* p) {
+		auto address = reinterpret_cast<uintptr_t>(p);
+		return reinterpret_cast<char*>((address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+	};
+
+	char* p = top ? align_up(top) : nullptr;
+	if (!p || p + size > limit) {
+		// move on to the next chunk if a reset left one big enough, otherwise get a new one
+		chunk* next = current ? current->next : first;
+		if (!next || next->size < size + alignment) {
+			size_t bytes = size + alignment > chunk_size ? size + alignment : chunk_size;
+			chunk* fresh = static_cast<chunk*>(::operator new(sizeof(chunk) + bytes));
+			fresh->size = bytes;
+			fresh->next = next;
+			if (current)
+				current->next = fresh;
+			else
+				first = fresh;
+			next = fresh;
+		}
+		current = next;
+		top = chunk_data(current);
+		limit = top + current->size;
+		p = align_up(top);
+	}
+	top = p + size;
+	used += size;
+	return p;
+}
+
+template <typename T, typename... Args>
+T* arena::make(Args&&... args)
+{
+	T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	if (!std::is_trivially_destructible<T>::value) {
+		auto d = static_cast<destructor*>(allocate(sizeof(destructor), alignof(destructor)));
+		d->next = destructors;
+		d->destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+		d->object = object;
+		destructors = d;
+	}
+	return object;
+}
+
+void arena::run_destructors()
+{
+	for (destructor* d = destructors; d; d = d->next)
+		d->destroy(d->object);
+	destructors = nullptr;
+}
+
+void arena::reset()
+{
+	run_destructors();
+	current = nullptr;
+	top = limit = nullptr;
+	used = 0;
+}
+
+void arena::release()
+{
+	run_destructors();
+	while (first) {
+		chunk* next = first->next;
+		::operator delete(first);
+		first = next;
+	}
+	current = nullptr;
+	top = limit = nullptr;
+	used = 0;
+}
+
+void arena::take(arena& other)
+{
+	chunk_size = other.chunk_size;
+	first = other.first;
+	current = other.current;
+	top = other.top;
+	limit = other.limit;
+	used = other.used;
+	destructors = other.destructors;
+	other.first = other.current = nullptr;
+	other.top = other.limit = nullptr;
+	other.used = 0;
+	other.destructors = nullptr;
+}
+
+#endif
@@ -0,0 +1,109 @@
+// Ray throughput of a linear hittable_list scan vs bvh_node over random sphere fields.
+// Build from the repo root with optimisations on, e.g.
+//   g++ -std=c++17 -O2 bench/bench_bvh.cpp -o bench_bvh
+//   cl /std:c++17 /O2 /EHsc bench\bench_bvh.cpp
+
+#include "../rtweekend.h"
+
+#include "../sphere.h"
+#include "../material.h"
+#include "../hittable_list.h"
+#include "../scene.h"
+#include "../bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+// roughly constant density, so bigger scenes are bigger rather than more crowded
+scene sphere_field(long long n_spheres)
+{
+	scene world;
+	world.world.objects.reserve(n_spheres);
+	auto mat = world.make_material<lambertian>(colour(0.5, 0.5, 0.5));
+	auto half_extent = 2.0 * std::cbrt(static_cast<double>(n_spheres));
+	for (long long i = 0; i < n_spheres; ++i) {
+		auto center = vec3::random(-half_extent, half_extent);
+		world.add<sphere>(center, random_double(0.2, 0.5), mat);
+	}
+	return world;
+}
+
+// rays start anywhere in the field and head off in any direction, a mix of hits and misses
+std::vector<ray> random_rays(const hittable& world, int n_rays)
+{
+	aabb box;
+	world.bounding_box(box);
+	std::vector<ray> rays;
+	rays.reserve(n_rays);
+	for (int i = 0; i < n_rays; ++i) {
+		point3 orig(random_double(box.min().x(), box.max().x()),
+					random_double(box.min().y(), box.max().y()),
+					random_double(box.min().z(), box.max().z()));
+		rays.push_back(ray(orig, random_unit_vector()));
+	}
+	return rays;
+}
+
+// traces rays round-robin until min_seconds have passed, returns rays per second
+double rays_per_second(const hittable& world, const std::vector<ray>& rays, double min_seconds)
+{
+	long long traced = 0;
+	long long hits = 0;
+	hit_record rec;
+	auto tp1 = bench_clock::now();
+	std::chrono::duration<double> elapsed(0);
+	while (elapsed.count() < min_seconds) {
+		for (int k = 0; k < 64; ++k) {
+			if (world.hit(rays[traced % rays.size()], 0.001, infinity, rec))
+				hits++;
+			traced++;
+		}
+		elapsed = bench_clock::now() - tp1;
+	}
+	// keep the hit count alive so the loop can't be optimised away
+	if (hits < 0)
+		std::printf("%lld\n", hits);
+	return traced / elapsed.count();
+}
+
+// both structures must agree on the closest hit for every ray
+int count_mismatches(const hittable& a, const hittable& b, const std::vector<ray>& rays, int n_rays)
+{
+	int mismatches = 0;
+	for (int i = 0; i < n_rays && i < static_cast<int>(rays.size()); ++i) {
+		hit_record rec_a, rec_b;
+		bool hit_a = a.hit(rays[i], 0.001, infinity, rec_a);
+		bool hit_b = b.hit(rays[i], 0.001, infinity, rec_b);
+		if (hit_a != hit_b || (hit_a && rec_a.t != rec_b.t))
+			mismatches++;
+	}
+	return mismatches;
+}
+
+int main()
+{
+	const long long sizes[] = { 500, 50000, 1000000 };
+	const double min_seconds = 1.0;
+
+	std::printf("%10s %12s %14s %14s %10s %10s\n", "spheres", "build (ms)", "list (Mray/s)", "bvh (Mray/s)", "speedup", "mismatch");
+	for (auto n : sizes) {
+		scene field = sphere_field(n);
+		const hittable_list& world = field.world;
+		auto rays = random_rays(world, 1 << 16);
+
+		auto tp1 = bench_clock::now();
+		bvh_node bvh(world);
+		std::chrono::duration<double, std::milli> build_time = bench_clock::now() - tp1;
+
+		double list_rate = rays_per_second(world, rays, min_seconds);
+		double bvh_rate = rays_per_second(bvh, rays, min_seconds);
+		int mismatches = count_mismatches(world, bvh, rays, 256);
+
+		std::printf("%10lld %12.1f %14.4f %14.4f %9.1fx %10d\n", n, build_time.count(),
+			list_rate * 1e-6, bvh_rate * 1e-6, bvh_rate / list_rate, mismatches);
+	}
+	return 0;
+}
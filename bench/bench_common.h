@@ -0,0 +1,146 @@
+#pragma once
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+// What the benchmarks that render whole images share: the scene set up as main does it, whole
+// renders across threads, and for the image quality ones (bench_sampler, bench_lights and
+// bench_denoise) RMSE against a reference and working out how many samples fit in a time budget.
+// Each bench keeps its own scenes, methods and counters and the JSON it writes.
+
+#include "../rtweekend.h"
+
+#include "../bvh.h"
+#include "../camera.h"
+#include "../render.h"
+#include "../scenes.h"
+#include "../sphere_soup.h"
+#include "../tiles.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+// the small, fairly deep renders every quality bench uses
+inline render_settings bench_settings()
+{
+	render_settings settings;
+	settings.image_width = 320;
+	settings.image_height = 180;
+	settings.max_depth = 8;
+	return settings;
+}
+
+// a built-in scene made with its rng seed, with its BVH and camera
+struct bench_scene
+{
+	const char* name;
+	uint64_t seed;
+	std::function<scene()> make;
+};
+
+struct bench_world
+{
+	scene world_scene;
+	bvh_node world_bvh;
+	camera cam;
+
+	explicit bench_world(const bench_scene& bs) : world_scene(make_seeded(bs)), world_bvh(pack_sphere_soups(world_scene, world_scene.world)),
+		cam(world_scene.view.lookfrom, world_scene.view.lookat, world_scene.view.vup, world_scene.view.vfov, 16.0 / 9.0,
+			world_scene.view.aperture, world_scene.view.focus_distance) {}
+
+private:
+	static scene make_seeded(const bench_scene& bs)
+	{
+		seed_rng(bs.seed);
+		return bs.make();
+	}
+};
+
+// an image and the AOVs the denoiser needs to go with it
+struct bench_image
+{
+	std::vector<float> colour, albedo, normal, depth, variance;
+};
+
+// Renders into accum with n_threads, every hardware thread when 0, returns the seconds taken.
+// counters, if given, gets the threads' counts added to it (only counted with RT_STATS).
+double render_accumulation(const render_settings& settings, const camera& cam, const hittable& world, const scene_lighting& lighting,
+	accumulation_buffer& accum, unsigned int n_threads = 0, render_counters* counters = nullptr)
+{
+	if (n_threads == 0)
+		n_threads = std::max(1u, std::thread::hardware_concurrency());
+	tile_scheduler scheduler(make_tiles(static_cast<int>(settings.image_width), static_cast<int>(settings.image_height), 32, tile_order::hilbert));
+	std::vector<worker_stats> stats(n_threads);
+	std::vector<wavefront_state> scratch(n_threads);
+	std::vector<std::thread> threads;
+
+	auto tp1 = bench_clock::now();
+	for (unsigned int i = 0; i < n_threads; ++i)
+		threads.push_back(std::thread(render_tiles, std::ref(scheduler), std::cref(settings), std::cref(cam), std::cref(world),
+			std::cref(lighting), std::ref(accum), std::ref(scratch[i]), std::ref(stats[i])));
+	for (auto& th : threads)
+		th.join();
+	std::chrono::duration<double> elapsed = bench_clock::now() - tp1;
+	if (counters)
+		for (const auto& s : stats)
+			*counters += s.counters;
+	return elapsed.count();
+}
+
+double render_image(const render_settings& settings, const camera& cam, const hittable& world, const scene_lighting& lighting,
+	std::vector<float>& image)
+{
+	accumulation_buffer accum(settings.image_width, settings.image_height, settings.seed);
+	double seconds = render_accumulation(settings, cam, world, lighting, accum);
+	accum.resolve(image);
+	return seconds;
+}
+
+double render_image(const render_settings& settings, const camera& cam, const hittable& world, const scene_lighting& lighting,
+	bench_image& image)
+{
+	accumulation_buffer accum(settings.image_width, settings.image_height, settings.seed);
+	accum.enable_aovs();
+	double seconds = render_accumulation(settings, cam, world, lighting, accum);
+	accum.resolve(image.colour);
+	accum.resolve_aovs(image.albedo, image.normal, image.depth, image.variance);
+	return seconds;
+}
+
+// of the linear image, or with gamma of its square root, which is closer to how the error looks
+// once the image is gamma corrected
+double rmse(const std::vector<float>& image, const std::vector<float>& reference, bool gamma = false)
+{
+	double sum = 0;
+	for (size_t i = 0; i < image.size(); ++i) {
+		double a = image[i];
+		double b = reference[i];
+		double d = gamma ? std::sqrt(std::max(0.0, a)) - std::sqrt(std::max(0.0, b)) : a - b;
+		sum += d * d;
+	}
+	return std::sqrt(sum / image.size());
+}
+
+// Seconds per sample per pixel, from the faster of two 4 sample renders so a cold cache or a
+// busy moment doesn't skew it. The renders go to image, which is overwritten.
+double time_per_sample(render_settings settings, const camera& cam, const hittable& world, const scene_lighting& lighting,
+	std::vector<float>& image)
+{
+	settings.samples_per_pixel = 4;
+	return std::min(render_image(settings, cam, world, lighting, image), render_image(settings, cam, world, lighting, image))
+		/ settings.samples_per_pixel;
+}
+
+// as many samples as fit in budget seconds, at least one
+int samples_in_budget(double budget, double seconds_per_sample)
+{
+	return std::max(1, static_cast<int>(budget / seconds_per_sample));
+}
+
+#endif
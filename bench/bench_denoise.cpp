@@ -0,0 +1,113 @@
+// What the denoiser buys: renders the random scene and lit_scene at 1 to 64 samples per pixel
+// with the AOVs, times the render and the denoise, and measures both images against a high
+// sample count reference. Then, assuming the noisy images' error falls with the square root of
+// the samples, works out how long a render without denoising would take to match each denoised
+// one, for the equal quality speedup. RMSE is reported for the linear image and for its square
+// root, which is closer to how the error looks once the image is gamma corrected. JSON on stdout.
+// Build from the repo root with optimisations on, e.g.
+//   g++ -std=c++17 -O2 -pthread -mavx2 bench/bench_denoise.cpp -o bench_denoise
+//   ./bench_denoise > denoise.json
+// An argument overrides the reference's samples per pixel (default 512).
+
+#include "bench_common.h"
+
+#include "../denoise.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+struct bench_run
+{
+	int samples_per_pixel;
+	double render_seconds, denoise_seconds;
+	double noisy_rmse, denoised_rmse, noisy_gamma_rmse, denoised_gamma_rmse;
+};
+
+int main(int argc, char** argv)
+{
+	int reference_spp = argc > 1 ? std::atoi(argv[1]) : 512;
+	if (reference_spp <= 0) {
+		std::fprintf(stderr, "Usage: %s [reference spp]\n", argv[0]);
+		return 1;
+	}
+
+	render_settings settings = bench_settings();
+	denoise_settings denoising;
+
+	const int sample_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+	const int n_sample_counts = 7;
+	const std::vector<bench_scene> scenes = {
+		{ "random", 1, [] { return random_scene(); } },
+		{ "lights", 0, [] { return lit_scene(); } },
+	};
+
+	std::printf("{\n");
+	std::printf("  \"image\": { \"width\": %lld, \"height\": %lld, \"max_depth\": %d },\n", settings.image_width, settings.image_height,
+		settings.max_depth);
+	std::printf("  \"denoiser\": { \"iterations\": %d, \"luminance_sigma\": %g, \"normal_power\": %g, \"depth_sigma\": %g },\n",
+		denoising.iterations, denoising.luminance_sigma, denoising.normal_power, denoising.depth_sigma);
+	std::printf("  \"scenes\": [\n");
+
+	for (size_t sc = 0; sc < scenes.size(); ++sc) {
+		const bench_scene& bs = scenes[sc];
+		bench_world world(bs);
+
+		// the reference uses its own seed so its noise doesn't line up with the runs it's judging
+		bench_image reference;
+		settings.seed = 1000;
+		settings.samples_per_pixel = reference_spp;
+		double reference_seconds = render_image(settings, world.cam, world.world_bvh, world.world_scene.lighting, reference);
+		std::fprintf(stderr, "%s reference, %d spp: %.3fs\n", bs.name, reference_spp, reference_seconds);
+
+		settings.seed = 1;
+		std::vector<bench_run> runs;
+		bench_image image;
+		for (int s = 0; s < n_sample_counts; ++s) {
+			bench_run run;
+			run.samples_per_pixel = sample_counts[s];
+			settings.samples_per_pixel = run.samples_per_pixel;
+			run.render_seconds = render_image(settings, world.cam, world.world_bvh, world.world_scene.lighting, image);
+			run.noisy_rmse = rmse(image.colour, reference.colour);
+			run.noisy_gamma_rmse = rmse(image.colour, reference.colour, true);
+			auto tp1 = bench_clock::now();
+			denoise(image.colour, image.albedo, image.normal, image.depth, image.variance, settings.image_width, settings.image_height, denoising);
+			std::chrono::duration<double> elapsed = bench_clock::now() - tp1;
+			run.denoise_seconds = elapsed.count();
+			run.denoised_rmse = rmse(image.colour, reference.colour);
+			run.denoised_gamma_rmse = rmse(image.colour, reference.colour, true);
+			std::fprintf(stderr, "%s, %d spp: render %.3fs, denoise %.3fs, rmse %.5f -> %.5f\n", bs.name, run.samples_per_pixel,
+				run.render_seconds, run.denoise_seconds, run.noisy_rmse, run.denoised_rmse);
+			runs.push_back(run);
+		}
+
+		// noisy error and time per sample from the highest sample count, the least skewed by
+		// fixed costs, to extrapolate the samples a plain render needs to match each denoised one
+		const bench_run& last = runs.back();
+		double seconds_per_sample = last.render_seconds / last.samples_per_pixel;
+
+		std::printf("    {\n");
+		std::printf("      \"name\": \"%s\",\n", bs.name);
+		std::printf("      \"reference\": { \"samples_per_pixel\": %d, \"seconds\": %.3f },\n", reference_spp, reference_seconds);
+		std::printf("      \"runs\": [\n");
+		for (size_t r = 0; r < runs.size(); ++r) {
+			const bench_run& run = runs[r];
+			double ratio = last.noisy_rmse / run.denoised_rmse;
+			double equal_quality_spp = last.samples_per_pixel * ratio * ratio;
+			double equal_quality_seconds = equal_quality_spp * seconds_per_sample;
+			std::printf("        { \"samples_per_pixel\": %d, \"render_seconds\": %.4f, \"denoise_seconds\": %.4f, \"noisy_rmse\": %.6f, "
+				"\"denoised_rmse\": %.6f, \"noisy_gamma_rmse\": %.6f, \"denoised_gamma_rmse\": %.6f, \"equal_quality_samples_per_pixel\": %.1f, "
+				"\"equal_quality_seconds\": %.4f, \"speedup\": %.2f }%s\n",
+				run.samples_per_pixel, run.render_seconds, run.denoise_seconds, run.noisy_rmse, run.denoised_rmse, run.noisy_gamma_rmse,
+				run.denoised_gamma_rmse, equal_quality_spp, equal_quality_seconds, equal_quality_seconds / (run.render_seconds + run.denoise_seconds),
+				r + 1 < runs.size() ? "," : "");
+		}
+		std::printf("      ]\n");
+		std::printf("    }%s\n", sc + 1 < scenes.size() ? "," : "");
+	}
+
+	std::printf("  ]\n");
+	std::printf("}\n");
+	return 0;
+}
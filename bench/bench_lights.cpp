@@ -0,0 +1,79 @@
+// Noise at equal render time with and without sampling the lights (next-event estimation with
+// multiple importance sampling) on lit_scene, where nearly all the light comes from a small
+// bulb and a panel. Each method gets as many samples per pixel as fit in the time budget,
+// measured from a short calibration render, and is compared against a high sample count
+// reference. Reports RMSE of the linear image and how many times the samples plain path tracing
+// would need to match light sampling's noise, as JSON on stdout. Build from the repo root with
+// optimisations on, e.g.
+//   g++ -std=c++17 -O2 -pthread -mavx2 bench/bench_lights.cpp -o bench_lights
+//   ./bench_lights > lights.json
+// Arguments override the time budget in seconds (default 2) and the reference's samples per
+// pixel (default 1024).
+
+#include "bench_common.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+struct bench_method
+{
+	const char* name;
+	const scene_lighting* lighting;
+};
+
+int main(int argc, char** argv)
+{
+	double budget = argc > 1 ? std::atof(argv[1]) : 2.0;
+	int reference_spp = argc > 2 ? std::atoi(argv[2]) : 1024;
+	if (budget <= 0 || reference_spp <= 0) {
+		std::fprintf(stderr, "Usage: %s [seconds] [reference spp]\n", argv[0]);
+		return 1;
+	}
+
+	render_settings settings = bench_settings();
+
+	bench_world world({ "lights", 0, [] { return lit_scene(); } });
+	// the same scene with nothing to aim at, so emitters only count when a path hits them
+	scene_lighting unsampled = world.world_scene.lighting;
+	unsampled.lights.clear();
+	const bench_method methods[] = {
+		{ "path_tracing", &unsampled },
+		{ "light_sampling", &world.world_scene.lighting },
+	};
+
+	// the reference uses its own seed so its noise doesn't line up with the runs it's judging
+	std::vector<float> reference;
+	settings.seed = 1000;
+	settings.samples_per_pixel = reference_spp;
+	double reference_seconds = render_image(settings, world.cam, world.world_bvh, world.world_scene.lighting, reference);
+	std::fprintf(stderr, "reference, %d spp: %.3fs\n", reference_spp, reference_seconds);
+
+	std::printf("{\n");
+	std::printf("  \"image\": { \"width\": %lld, \"height\": %lld, \"max_depth\": %d },\n", settings.image_width, settings.image_height,
+		settings.max_depth);
+	std::printf("  \"reference\": { \"samples_per_pixel\": %d, \"seconds\": %.3f },\n", reference_spp, reference_seconds);
+	std::printf("  \"budget_seconds\": %.3f,\n", budget);
+	std::printf("  \"methods\": [\n");
+
+	settings.seed = 1;
+	double method_rmse[2] = {};
+	std::vector<float> image;
+	for (int m = 0; m < 2; ++m) {
+		const bench_method& method = methods[m];
+		double seconds_per_sample = time_per_sample(settings, world.cam, world.world_bvh, *method.lighting, image);
+		settings.samples_per_pixel = samples_in_budget(budget, seconds_per_sample);
+		double seconds = render_image(settings, world.cam, world.world_bvh, *method.lighting, image);
+		method_rmse[m] = rmse(image, reference);
+		std::fprintf(stderr, "%s, %d spp: %.3fs, rmse %.5f\n", method.name, settings.samples_per_pixel, seconds, method_rmse[m]);
+		std::printf("    { \"name\": \"%s\", \"samples_per_pixel\": %d, \"seconds\": %.3f, \"seconds_per_sample\": %.5f, \"rmse\": %.6f }%s\n",
+			method.name, settings.samples_per_pixel, seconds, seconds_per_sample, method_rmse[m], m == 0 ? "," : "");
+	}
+	std::printf("  ],\n");
+	// noise falls with the square root of the samples taken
+	double ratio = method_rmse[0] / method_rmse[1];
+	std::printf("  \"rmse_ratio\": %.3f,\n", ratio);
+	std::printf("  \"equal_noise_time_ratio\": %.3f\n", ratio * ratio);
+	std::printf("}\n");
+	return 0;
+}
@@ -0,0 +1,183 @@
+// Thread scaling across NUMA nodes (sockets) with the different ways of placing render
+// threads and their memory:
+//   unpinned           threads go where the OS puts them, the main thread builds everything
+//   compact            pinned, filling one node's CPUs before the next
+//   spread             pinned, dealt out to the nodes in turn
+//   spread_replicated  spread, plus a copy of the scene and BVH built on every node
+// Pinned runs clear the framebuffer from the render threads so its pages are first touched
+// where they're written. Reports seconds and speedup over one unpinned thread for 1, 2, 4...
+// threads as JSON on stdout. On a single node machine every layout should match unpinned.
+// Build from the repo root with optimisations on, e.g.
+//   g++ -std=c++17 -O2 -pthread -mavx2 bench/bench_numa.cpp -o bench_numa
+//   ./bench_numa > numa.json
+// An argument overrides the highest thread count, which is otherwise the number of CPUs.
+
+#include "../rtweekend.h"
+
+#include "../affinity.h"
+#include "../bvh.h"
+#include "../camera.h"
+#include "../render.h"
+#include "../scenes.h"
+#include "../sphere_soup.h"
+#include "../tiles.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <set>
+#include <thread>
+#include <vector>
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+// fastest of this many renders per layout and thread count
+const int repeats = 3;
+
+struct bench_layout
+{
+	const char* name;
+	bool pinned;
+	thread_placement placement;
+	bool replicated;
+};
+
+struct bench_scene
+{
+	const char* name;
+	uint64_t seed;
+	std::function<scene()> make;
+};
+
+// one copy of a scene and its BVH, built by a thread on the node it's for
+struct world_copy
+{
+	scene s;
+	bvh_node bvh;
+};
+
+void build_copy(world_copy& copy, const bench_scene& bs)
+{
+	seed_rng(bs.seed);
+	copy.s = bs.make();
+	copy.bvh = bvh_node(pack_sphere_soups(copy.s, copy.s.world));
+}
+
+double render_once(const render_settings& settings, const camera& cam, const std::vector<world_copy>& copies,
+	const std::vector<thread_slot>& slots, const bench_layout& layout)
+{
+	unsigned int n_threads = static_cast<unsigned int>(slots.size());
+	accumulation_buffer accum(settings.image_width, settings.image_height, settings.seed, layout.pinned);
+	tile_scheduler scheduler(make_tiles(static_cast<int>(settings.image_width), static_cast<int>(settings.image_height), 32, tile_order::hilbert));
+	std::vector<worker_stats> stats(n_threads);
+	std::vector<wavefront_state> scratch(n_threads);
+	std::vector<std::thread> threads;
+
+	auto tp1 = bench_clock::now();
+	for (unsigned int i = 0; i < n_threads; ++i) {
+		threads.push_back(std::thread([&, i] {
+			if (layout.pinned)
+				pin_this_thread({ slots[i].cpu });
+			const world_copy& copy = copies[layout.replicated ? slots[i].node : 0];
+			render_tiles(scheduler, settings, cam, copy.bvh, copy.s.lighting, accum, scratch[i], stats[i]);
+		}));
+	}
+	for (auto& th : threads)
+		th.join();
+	std::chrono::duration<double> elapsed = bench_clock::now() - tp1;
+	return elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+	render_settings settings;
+	settings.image_width = 400;
+	settings.image_height = 225;
+	settings.samples_per_pixel = 8;
+	settings.max_depth = 8;
+	settings.seed = 1;
+
+	numa_topology topology = read_numa_topology();
+	unsigned int max_threads = argc > 1 ? static_cast<unsigned int>(std::atoi(argv[1])) : static_cast<unsigned int>(topology.cpu_count());
+	if (max_threads == 0)
+		max_threads = 1;
+	std::vector<unsigned int> thread_counts;
+	for (unsigned int n = 1; n < max_threads; n *= 2)
+		thread_counts.push_back(n);
+	thread_counts.push_back(max_threads);
+
+	const std::vector<bench_layout> layouts = {
+		{ "unpinned", false, thread_placement::spread, false },
+		{ "compact", true, thread_placement::compact, false },
+		{ "spread", true, thread_placement::spread, false },
+		{ "spread_replicated", true, thread_placement::spread, true },
+	};
+	// the BVH of 100k spheres is far bigger than the caches, so where it lives shows up
+	const std::vector<bench_scene> scenes = {
+		{ "random", 1, [] { return random_scene(); } },
+		{ "many_spheres", 2, [] { return many_spheres_scene(100000); } },
+	};
+
+	std::printf("{\n");
+	std::printf("  \"topology\": [");
+	for (size_t n = 0; n < topology.nodes.size(); ++n)
+		std::printf("%s{ \"node\": %zu, \"cpus\": %zu }", n ? ", " : "", n, topology.nodes[n].size());
+	std::printf("],\n");
+	std::printf("  \"image\": { \"width\": %lld, \"height\": %lld, \"samples_per_pixel\": %d, \"max_depth\": %d },\n",
+		settings.image_width, settings.image_height, settings.samples_per_pixel, settings.max_depth);
+	std::printf("  \"max_threads\": %u,\n", max_threads);
+	std::printf("  \"scenes\": [\n");
+
+	for (size_t s = 0; s < scenes.size(); ++s) {
+		const bench_scene& bs = scenes[s];
+		// copy 0 is the main thread's, used by every layout that doesn't replicate
+		std::vector<world_copy> copies(topology.nodes.size());
+		build_copy(copies[0], bs);
+		for (size_t node = 1; node < copies.size(); ++node) {
+			std::thread builder([&, node] {
+				pin_this_thread(topology.nodes[node]);
+				build_copy(copies[node], bs);
+			});
+			builder.join();
+		}
+		const camera_settings& view = copies[0].s.view;
+		camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 16.0 / 9.0, view.aperture, view.focus_distance);
+
+		std::printf("    {\n");
+		std::printf("      \"name\": \"%s\",\n", bs.name);
+		std::printf("      \"layouts\": [\n");
+		double baseline = 0;
+		for (size_t l = 0; l < layouts.size(); ++l) {
+			const bench_layout& layout = layouts[l];
+			std::printf("        {\n");
+			std::printf("          \"name\": \"%s\",\n", layout.name);
+			std::printf("          \"runs\": [\n");
+			for (size_t t = 0; t < thread_counts.size(); ++t) {
+				unsigned int n = thread_counts[t];
+				std::vector<thread_slot> slots = place_threads(topology, n, layout.placement);
+				std::set<unsigned int> nodes_used;
+				for (const thread_slot& slot : slots)
+					nodes_used.insert(slot.node);
+
+				double best = render_once(settings, cam, copies, slots, layout);
+				for (int k = 1; k < repeats; ++k)
+					best = std::min(best, render_once(settings, cam, copies, slots, layout));
+				if (l == 0 && t == 0)
+					baseline = best;
+				std::fprintf(stderr, "%s, %s, %u threads: %.3fs\n", bs.name, layout.name, n, best);
+				std::printf("            { \"threads\": %u, \"nodes\": %zu, \"seconds\": %.6f, \"speedup\": %.3f, \"efficiency\": %.3f }%s\n",
+					n, layout.pinned ? nodes_used.size() : topology.nodes.size(), best, baseline / best, baseline / best / n,
+					t + 1 < thread_counts.size() ? "," : "");
+			}
+			std::printf("          ]\n");
+			std::printf("        }%s\n", l + 1 < layouts.size() ? "," : "");
+		}
+		std::printf("      ]\n");
+		std::printf("    }%s\n", s + 1 < scenes.size() ? "," : "");
+	}
+
+	std::printf("  ]\n");
+	std::printf("}\n");
+	return 0;
+}
@@ -0,0 +1,82 @@
+// Throughput and image error of the float build against the double build. Build and run it
+// twice from the repo root, the second run compares its image with the first's:
+//   g++ -std=c++17 -O2 -pthread -mavx2 bench/bench_precision.cpp -o bench_double
+//   g++ -std=c++17 -O2 -pthread -mavx2 -DRT_USE_FLOAT bench/bench_precision.cpp -o bench_float
+//   ./bench_double && ./bench_float
+// Each writes its linear image to precision_<float|double>.pfm in the working directory.
+
+#include "bench_common.h"
+
+#include "../image_writer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef RT_USE_FLOAT
+const char* precision_name = "float";
+const char* other_precision_name = "double";
+#else
+const char* precision_name = "double";
+const char* other_precision_name = "float";
+#endif
+
+// reads back a PFM written by write_image, returns false if it isn't there
+bool read_pfm(const std::string& path, long long width, long long height, std::vector<float>& pixels)
+{
+	std::ifstream file_in(path, std::ios::binary);
+	std::string magic;
+	long long w, h;
+	double scale;
+	if (!(file_in >> magic >> w >> h >> scale) || magic != "PF" || w != width || h != height)
+		return false;
+	file_in.get();
+	pixels.resize(width * height * 3);
+	file_in.read(reinterpret_cast<char*>(pixels.data()), pixels.size() * sizeof(float));
+	return static_cast<bool>(file_in);
+}
+
+int main()
+{
+	render_settings settings;
+	settings.image_width = 640;
+	settings.image_height = 360;
+	settings.samples_per_pixel = 16;
+	settings.max_depth = 8;
+	settings.seed = 1;
+
+	seed_rng(settings.seed);
+	scene world_scene = random_scene();
+	bvh_node world_bvh(pack_sphere_soups(world_scene, world_scene.world));
+	camera cam(point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 20, 16.0 / 9.0, 0.2, 10.0);
+
+	std::vector<float> image;
+	double seconds = render_image(settings, cam, world_bvh, world_scene.lighting, image);
+
+	double samples = static_cast<double>(settings.image_width) * settings.image_height * settings.samples_per_pixel;
+	std::printf("%s build (%s): %.3fs, %.3f Msamples/s, %zu bytes per hit_record, %zu per vec3\n", precision_name, simd_name,
+		seconds, samples / seconds * 1e-6, sizeof(hit_record), sizeof(vec3));
+
+	write_image(std::string("precision_") + precision_name + ".pfm", image, settings.image_width, settings.image_height, 1, image_format::pfm);
+
+	// compare against the other build's image if it has been run already
+	std::vector<float> other;
+	if (!read_pfm(std::string("precision_") + other_precision_name + ".pfm", settings.image_width, settings.image_height, other)) {
+		std::printf("run the %s build too to compare images\n", other_precision_name);
+		return 0;
+	}
+	double sum_sq = 0, max_err = 0;
+	long long differing = 0;
+	for (size_t k = 0; k < image.size(); ++k) {
+		double err = std::fabs(static_cast<double>(image[k]) - other[k]);
+		sum_sq += err * err;
+		max_err = err > max_err ? err : max_err;
+		if (to_8bit(image[k]) != to_8bit(other[k]))
+			differing++;
+	}
+	std::printf("vs %s: rmse %.6f, max abs error %.6f, %.3f%% of 8-bit channels differ\n", other_precision_name,
+		std::sqrt(sum_sq / image.size()), max_err, 100.0 * differing / image.size());
+	return 0;
+}
@@ -0,0 +1,128 @@
+// Whole renders of fixed scenes at fixed seeds, with 1, 2, 4... threads up to the machine's
+// count. Reports primary and secondary rays per second, BVH node and primitive tests per ray
+// and the speedup over one thread, as JSON on stdout so results can be kept and compared
+// between builds. Counting needs RT_STATS, which this turns on, so absolute throughput sits a
+// little below main's. Build from the repo root with optimisations on, e.g.
+//   g++ -std=c++17 -O2 -pthread -mavx2 bench/bench_render.cpp -o bench_render
+//   ./bench_render > before.json
+// An argument overrides the highest thread count, which is otherwise the hardware's.
+
+#ifndef RT_STATS
+#define RT_STATS
+#endif
+
+#include "bench_common.h"
+
+#include "../stats.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#ifdef RT_USE_FLOAT
+const char* precision_name = "float";
+#else
+const char* precision_name = "double";
+#endif
+
+// fastest of this many renders per thread count, noise only ever makes a run slower
+const int repeats = 3;
+
+struct bench_run
+{
+	unsigned int threads;
+	double seconds;
+	render_counters counters;
+};
+
+bench_run render_once(const render_settings& settings, const camera& cam, const hittable& world, const scene_lighting& lighting,
+	unsigned int n_threads)
+{
+	accumulation_buffer accum(settings.image_width, settings.image_height, settings.seed);
+	bench_run run = { n_threads, 0, render_counters() };
+	run.seconds = render_accumulation(settings, cam, world, lighting, accum, n_threads, &run.counters);
+	return run;
+}
+
+int main(int argc, char** argv)
+{
+	render_settings settings;
+	settings.image_width = 400;
+	settings.image_height = 225;
+	settings.samples_per_pixel = 8;
+	settings.max_depth = 8;
+	settings.seed = 1;
+
+	std::vector<bench_scene> scenes = {
+		{ "random", 1, [] { return random_scene(); } },
+		{ "many_spheres", 2, [] { return many_spheres_scene(100000); } },
+		{ "glass", 3, [] { return glass_scene(); } },
+	};
+
+	unsigned int max_threads = argc > 1 ? static_cast<unsigned int>(std::atoi(argv[1])) : std::thread::hardware_concurrency();
+	if (max_threads == 0)
+		max_threads = 1;
+	std::vector<unsigned int> thread_counts;
+	for (unsigned int n = 1; n < max_threads; n *= 2)
+		thread_counts.push_back(n);
+	thread_counts.push_back(max_threads);
+
+	std::printf("{\n");
+	std::printf("  \"build\": { \"precision\": \"%s\", \"simd\": \"%s\" },\n", precision_name, simd_name);
+	std::printf("  \"image\": { \"width\": %lld, \"height\": %lld, \"samples_per_pixel\": %d, \"max_depth\": %d },\n",
+		settings.image_width, settings.image_height, settings.samples_per_pixel, settings.max_depth);
+	std::printf("  \"max_threads\": %u,\n", max_threads);
+	std::printf("  \"scenes\": [\n");
+
+	for (size_t s = 0; s < scenes.size(); ++s) {
+		const bench_scene& bs = scenes[s];
+		seed_rng(bs.seed);
+		scene world_scene = bs.make();
+		auto tp1 = bench_clock::now();
+		bvh_node world_bvh(pack_sphere_soups(world_scene, world_scene.world));
+		std::chrono::duration<double> bvh_seconds = bench_clock::now() - tp1;
+		const camera_settings& view = world_scene.view;
+		camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, 16.0 / 9.0, view.aperture, view.focus_distance);
+
+		std::vector<bench_run> runs;
+		for (unsigned int n : thread_counts) {
+			bench_run best = render_once(settings, cam, world_bvh, world_scene.lighting, n);
+			for (int k = 1; k < repeats; ++k) {
+				bench_run run = render_once(settings, cam, world_bvh, world_scene.lighting, n);
+				if (run.seconds < best.seconds)
+					best = run;
+			}
+			std::fprintf(stderr, "%s, %u threads: %.3fs\n", bs.name, n, best.seconds);
+			runs.push_back(best);
+		}
+
+		// the image, and so every count, is the same for any thread count
+		const render_counters& c = runs[0].counters;
+		double rays = static_cast<double>(c.rays());
+		std::printf("    {\n");
+		std::printf("      \"name\": \"%s\",\n", bs.name);
+		std::printf("      \"objects\": %zu,\n", world_scene.world.objects.size());
+		std::printf("      \"bvh_build_seconds\": %.6f,\n", bvh_seconds.count());
+		std::printf("      \"primary_rays\": %llu,\n", static_cast<unsigned long long>(c.primary_rays));
+		std::printf("      \"secondary_rays\": %llu,\n", static_cast<unsigned long long>(c.secondary_rays));
+		std::printf("      \"shadow_rays\": %llu,\n", static_cast<unsigned long long>(c.shadow_rays));
+		std::printf("      \"node_tests_per_ray\": %.3f,\n", c.node_tests / rays);
+		std::printf("      \"primitive_tests_per_ray\": %.3f,\n", c.primitive_tests / rays);
+		std::printf("      \"runs\": [\n");
+		for (size_t r = 0; r < runs.size(); ++r) {
+			const bench_run& run = runs[r];
+			double speedup = runs[0].seconds / run.seconds;
+			std::printf("        { \"threads\": %u, \"seconds\": %.6f, \"primary_rays_per_second\": %.0f, \"secondary_rays_per_second\": %.0f, "
+				"\"rays_per_second\": %.0f, \"speedup\": %.3f, \"efficiency\": %.3f }%s\n",
+				run.threads, run.seconds, run.counters.primary_rays / run.seconds, run.counters.secondary_rays / run.seconds,
+				run.counters.rays() / run.seconds, speedup, speedup / run.threads, r + 1 < runs.size() ? "," : "");
+		}
+		std::printf("      ]\n");
+		std::printf("    }%s\n", s + 1 < scenes.size() ? "," : "");
+	}
+
+	std::printf("  ]\n");
+	std::printf("}\n");
+	return 0;
+}
@@ -0,0 +1,97 @@
+// Noise at equal render time with each sampler: independent uniform random numbers, scrambled
+// Sobol points and blue noise dithered sequences. Renders the random scene, whose defocus blur
+// and scattering both draw on the sampler, and lit_scene, where light sampling does. Each
+// sampler gets as many samples per pixel as fit in the time budget, measured from a short
+// calibration render, and is compared against a high sample count reference. Reports RMSE of the
+// linear image, and how many times its samples independent sampling would need to match it, as
+// JSON on stdout. Build from the repo root with optimisations on, e.g.
+//   g++ -std=c++17 -O2 -pthread -mavx2 bench/bench_sampler.cpp -o bench_sampler
+//   ./bench_sampler > sampler.json
+// Arguments override the time budget per scene and sampler in seconds (default 1) and the
+// reference's samples per pixel (default 512).
+
+#include "bench_common.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+struct bench_sampler
+{
+	const char* name;
+	sampler_type type;
+};
+
+int main(int argc, char** argv)
+{
+	double budget = argc > 1 ? std::atof(argv[1]) : 1.0;
+	int reference_spp = argc > 2 ? std::atoi(argv[2]) : 512;
+	if (budget <= 0 || reference_spp <= 0) {
+		std::fprintf(stderr, "Usage: %s [seconds] [reference spp]\n", argv[0]);
+		return 1;
+	}
+
+	render_settings settings = bench_settings();
+
+	const bench_sampler samplers[] = {
+		{ "independent", sampler_type::independent },
+		{ "sobol", sampler_type::sobol },
+		{ "blue_noise", sampler_type::blue_noise },
+	};
+	const int n_samplers = 3;
+	const std::vector<bench_scene> scenes = {
+		{ "random", 1, [] { return random_scene(); } },
+		{ "lights", 0, [] { return lit_scene(); } },
+	};
+
+	std::printf("{\n");
+	std::printf("  \"image\": { \"width\": %lld, \"height\": %lld, \"max_depth\": %d },\n", settings.image_width, settings.image_height,
+		settings.max_depth);
+	std::printf("  \"budget_seconds\": %.3f,\n", budget);
+	std::printf("  \"scenes\": [\n");
+
+	for (size_t sc = 0; sc < scenes.size(); ++sc) {
+		const bench_scene& bs = scenes[sc];
+		bench_world world(bs);
+
+		// the reference uses its own seed so its noise doesn't line up with the runs it's judging,
+		// and Sobol points so it has less of it
+		std::vector<float> reference;
+		settings.seed = 1000;
+		settings.sampler = sampler_type::sobol;
+		settings.samples_per_pixel = reference_spp;
+		double reference_seconds = render_image(settings, world.cam, world.world_bvh, world.world_scene.lighting, reference);
+		std::fprintf(stderr, "%s reference, %d spp: %.3fs\n", bs.name, reference_spp, reference_seconds);
+
+		std::printf("    {\n");
+		std::printf("      \"name\": \"%s\",\n", bs.name);
+		std::printf("      \"reference\": { \"samples_per_pixel\": %d, \"seconds\": %.3f },\n", reference_spp, reference_seconds);
+		std::printf("      \"samplers\": [\n");
+
+		settings.seed = 1;
+		double independent_rmse = 0;
+		std::vector<float> image;
+		for (int m = 0; m < n_samplers; ++m) {
+			const bench_sampler& sampler = samplers[m];
+			settings.sampler = sampler.type;
+			double seconds_per_sample = time_per_sample(settings, world.cam, world.world_bvh, world.world_scene.lighting, image);
+			settings.samples_per_pixel = samples_in_budget(budget, seconds_per_sample);
+			double seconds = render_image(settings, world.cam, world.world_bvh, world.world_scene.lighting, image);
+			double error = rmse(image, reference);
+			if (m == 0)
+				independent_rmse = error;
+			// independent sampling's noise falls with the square root of the samples taken
+			double ratio = independent_rmse / error;
+			std::fprintf(stderr, "%s, %s, %d spp: %.3fs, rmse %.5f\n", bs.name, sampler.name, settings.samples_per_pixel, seconds, error);
+			std::printf("        { \"name\": \"%s\", \"samples_per_pixel\": %d, \"seconds\": %.3f, \"seconds_per_sample\": %.5f, \"rmse\": %.6f, "
+				"\"rmse_ratio\": %.3f, \"equal_noise_time_ratio\": %.3f }%s\n",
+				sampler.name, settings.samples_per_pixel, seconds, seconds_per_sample, error, ratio, ratio * ratio, m + 1 < n_samplers ? "," : "");
+		}
+		std::printf("      ]\n");
+		std::printf("    }%s\n", sc + 1 < scenes.size() ? "," : "");
+	}
+
+	std::printf("  ]\n");
+	std::printf("}\n");
+	return 0;
+}
@@ -0,0 +1,169 @@
+// Samples/sec of the closed form sampling routines in sampling.h against the rejection loops
+// they replaced (kept here as the baseline), for the disk, sphere, ball, hemisphere and cosine
+// weighted hemisphere, plus the SIMD batch versions where there are any. Every method draws its
+// uniform numbers from the thread's rng as it goes, so the rejection loops pay for the numbers
+// they throw away; their average count per sample is reported too. JSON on stdout. Build from
+// the repo root with optimisations on, e.g.
+//   g++ -std=c++17 -O2 -mavx2 bench/bench_sampling.cpp -o bench_sampling
+//   ./bench_sampling > sampling.json
+
+#include "../rtweekend.h"
+
+#include "../sampling.h"
+#include "../simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+const size_t samples_per_run = 1 << 22;
+const size_t batch_size = 1024;
+// fastest of this many runs per method
+const int repeats = 3;
+
+// uniform numbers drawn by the rejection loops, for the average per sample
+uint64_t draws = 0;
+
+inline real counted_random(real min, real max)
+{
+	draws++;
+	return static_cast<real>(random_double(min, max));
+}
+
+inline real random_real()
+{
+	return static_cast<real>(random_double());
+}
+
+vec3 rejection_in_unit_disk()
+{
+	while (true) {
+		auto p = vec3(counted_random(-1, 1), counted_random(-1, 1), 0);
+		if (p.length_squared() <= 1)
+			return p;
+	}
+}
+
+vec3 rejection_in_unit_ball()
+{
+	while (true) {
+		auto p = vec3(counted_random(-1, 1), counted_random(-1, 1), counted_random(-1, 1));
+		if (p.length_squared() < 1)
+			return p;
+	}
+}
+
+vec3 rejection_unit_vector()
+{
+	return unit_vector(rejection_in_unit_ball());
+}
+
+vec3 rejection_in_hemisphere()
+{
+	vec3 p = rejection_in_unit_ball();
+	return p.z() > 0 ? p : -p;
+}
+
+// the old lambertian scatter about +z, exactly cosine distributed though not unit length
+vec3 rejection_cosine_hemisphere()
+{
+	return vec3(0, 0, 1) + rejection_unit_vector();
+}
+
+struct bench_method
+{
+	const char* distribution;
+	const char* method;
+	// fills x, y and z with n samples
+	std::function<void(size_t, real*, real*, real*)> run;
+};
+
+// a method that makes one sample at a time
+template <typename F>
+std::function<void(size_t, real*, real*, real*)> one_at_a_time(F sample)
+{
+	return [sample](size_t n, real* x, real* y, real* z) {
+		for (size_t i = 0; i < n; ++i) {
+			vec3 p = sample();
+			x[i] = p.x();
+			y[i] = p.y();
+			z[i] = p.z();
+		}
+	};
+}
+
+int main()
+{
+	std::vector<real> u1(batch_size), u2(batch_size);
+	// draws the numbers for a batch, then maps them
+	auto batched = [&](void (*map)(const real*, const real*, size_t, real*, real*, real*)) {
+		return [&, map](size_t n, real* x, real* y, real* z) {
+			for (size_t i = 0; i < n; ++i) {
+				u1[i] = random_real();
+				u2[i] = random_real();
+			}
+			map(u1.data(), u2.data(), n, x, y, z);
+		};
+	};
+	auto disk_batch = [](const real* a, const real* b, size_t n, real* x, real* y, real* z) {
+		sample_concentric_disk_batch(a, b, n, x, y);
+		std::fill(z, z + n, static_cast<real>(0));
+	};
+
+	const std::vector<bench_method> methods = {
+		{ "disk", "rejection", one_at_a_time(rejection_in_unit_disk) },
+		{ "disk", "closed_form", one_at_a_time([] { return sample_concentric_disk(random_real(), random_real()); }) },
+		{ "disk", "batch", batched(disk_batch) },
+		{ "sphere", "rejection", one_at_a_time(rejection_unit_vector) },
+		{ "sphere", "closed_form", one_at_a_time([] { return sample_uniform_sphere(random_real(), random_real()); }) },
+		{ "sphere", "batch", batched(sample_uniform_sphere_batch) },
+		{ "ball", "rejection", one_at_a_time(rejection_in_unit_ball) },
+		{ "ball", "closed_form", one_at_a_time([] { return sample_uniform_ball(random_real(), random_real(), random_real()); }) },
+		{ "hemisphere", "rejection", one_at_a_time(rejection_in_hemisphere) },
+		{ "hemisphere", "closed_form", one_at_a_time([] { return sample_uniform_hemisphere(random_real(), random_real()); }) },
+		{ "cosine_hemisphere", "rejection", one_at_a_time(rejection_cosine_hemisphere) },
+		{ "cosine_hemisphere", "closed_form", one_at_a_time([] { return sample_cosine_hemisphere(random_real(), random_real()); }) },
+		{ "cosine_hemisphere", "batch", batched(sample_cosine_hemisphere_batch) },
+	};
+
+	std::vector<real> x(batch_size), y(batch_size), z(batch_size);
+	double checksum = 0;
+
+	std::printf("{\n");
+	std::printf("  \"simd\": \"%s\",\n", simd_name);
+	std::printf("  \"samples_per_run\": %zu,\n", samples_per_run);
+	std::printf("  \"methods\": [\n");
+	for (size_t m = 0; m < methods.size(); ++m) {
+		const bench_method& method = methods[m];
+		seed_rng(1);
+		double best = 0;
+		double draws_per_sample = 0;
+		for (int r = 0; r < repeats; ++r) {
+			draws = 0;
+			auto tp1 = bench_clock::now();
+			for (size_t done = 0; done < samples_per_run; done += batch_size) {
+				method.run(batch_size, x.data(), y.data(), z.data());
+				// touch the results so nothing's optimised away
+				checksum += x[done % batch_size] + y[0] + z[batch_size - 1];
+			}
+			std::chrono::duration<double> elapsed = bench_clock::now() - tp1;
+			if (r == 0 || elapsed.count() < best)
+				best = elapsed.count();
+			draws_per_sample = static_cast<double>(draws) / samples_per_run;
+		}
+		double rate = samples_per_run / best;
+		std::fprintf(stderr, "%s, %s: %.1fM samples/s\n", method.distribution, method.method, rate / 1e6);
+		std::printf("    { \"distribution\": \"%s\", \"method\": \"%s\", \"samples_per_second\": %.0f", method.distribution, method.method, rate);
+		if (draws_per_sample > 0)
+			std::printf(", \"draws_per_sample\": %.3f", draws_per_sample);
+		std::printf(" }%s\n", m + 1 < methods.size() ? "," : "");
+	}
+	std::printf("  ],\n");
+	std::printf("  \"checksum\": %.3f\n", checksum);
+	std::printf("}\n");
+	return 0;
+}
@@ -0,0 +1,103 @@
+// One ray against many spheres: virtual sphere::hit calls through a hittable_list vs a
+// sphere_soup, and a full BVH over spheres vs a BVH over packed soups.
+// Build from the repo root with optimisations on, and the widest SIMD your CPU has, e.g.
+//   g++ -std=c++17 -O2 -mavx2 bench/bench_sphere_soup.cpp -o bench_sphere_soup
+//   cl /std:c++17 /O2 /EHsc /arch:AVX2 bench\bench_sphere_soup.cpp
+
+#include "../rtweekend.h"
+
+#include "../sphere.h"
+#include "../sphere_soup.h"
+#include "../material.h"
+#include "../hittable_list.h"
+#include "../scene.h"
+#include "../bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+scene sphere_field(long long n_spheres, double half_extent)
+{
+	scene world;
+	auto mat = world.make_material<lambertian>(colour(0.5, 0.5, 0.5));
+	for (long long i = 0; i < n_spheres; ++i)
+		world.add<sphere>(vec3::random(-half_extent, half_extent), random_double(0.2, 0.5), mat);
+	return world;
+}
+
+std::vector<ray> random_rays(double half_extent, int n_rays)
+{
+	std::vector<ray> rays;
+	for (int i = 0; i < n_rays; ++i)
+		rays.push_back(ray(vec3::random(-half_extent, half_extent), random_unit_vector()));
+	return rays;
+}
+
+double rays_per_second(const hittable& world, const std::vector<ray>& rays, double min_seconds, long long& hits)
+{
+	long long traced = 0;
+	hits = 0;
+	hit_record rec;
+	auto tp1 = bench_clock::now();
+	std::chrono::duration<double> elapsed(0);
+	while (elapsed.count() < min_seconds) {
+		for (int k = 0; k < 256; ++k) {
+			if (world.hit(rays[traced % rays.size()], 0.001, infinity, rec))
+				hits++;
+			traced++;
+		}
+		elapsed = bench_clock::now() - tp1;
+	}
+	return traced / elapsed.count();
+}
+
+int main()
+{
+#if defined(__AVX512F__)
+	const char* simd = "AVX-512";
+#elif defined(__AVX__)
+	const char* simd = "AVX";
+#else
+	const char* simd = "scalar";
+#endif
+	std::printf("sphere_soup kernel: %s\n\n", simd);
+
+	const double min_seconds = 0.5;
+	auto rays = random_rays(2.0, 1 << 14);
+
+	// a single soup against the same spheres in a list, all packed into a small volume
+	std::printf("%8s %16s %16s %10s\n", "spheres", "list (Mray/s)", "soup (Mray/s)", "speedup");
+	for (int n : { 4, 8, 16, 64, 512 }) {
+		scene field = sphere_field(n, 2.0);
+		const hittable_list& list = field.world;
+		sphere_soup soup;
+		for (const auto* object : list.objects) {
+			auto s = static_cast<const sphere*>(object);
+			soup.add(s->origin, s->radius, s->mat_ptr);
+		}
+
+		long long hits_list, hits_soup;
+		double list_rate = rays_per_second(list, rays, min_seconds, hits_list);
+		double soup_rate = rays_per_second(soup, rays, min_seconds, hits_soup);
+		std::printf("%8d %16.3f %16.3f %9.2fx\n", n, list_rate * 1e-6, soup_rate * 1e-6, soup_rate / list_rate);
+	}
+
+	// whole scenes, BVH with sphere leaves vs BVH with soup leaves
+	std::printf("\n%8s %16s %16s %10s\n", "spheres", "bvh (Mray/s)", "soups (Mray/s)", "speedup");
+	for (long long n : { 500ll, 50000ll }) {
+		auto half_extent = 2.0 * std::cbrt(static_cast<double>(n));
+		scene field = sphere_field(n, half_extent);
+		auto scene_rays = random_rays(half_extent, 1 << 16);
+		bvh_node plain(field.world);
+		bvh_node packed(pack_sphere_soups(field, field.world));
+
+		long long hits_plain, hits_packed;
+		double plain_rate = rays_per_second(plain, scene_rays, min_seconds, hits_plain);
+		double packed_rate = rays_per_second(packed, scene_rays, min_seconds, hits_packed);
+		std::printf("%8lld %16.3f %16.3f %9.2fx\n", n, plain_rate * 1e-6, packed_rate * 1e-6, packed_rate / plain_rate);
+	}
+	return 0;
+}
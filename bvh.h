@@ -0,0 +1,303 @@
+#pragma once
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// surface area heuristic costs, relative cost of visiting a node vs testing a primitive
+const double sah_traversal_cost = 1.0;
+const double sah_intersect_cost = 1.0;
+const int sah_bins = 16;
+// past this depth splits fall back to halving the range, keeps the traversal stack bounded
+const int bvh_max_depth = 64;
+
+// Flattened bounding volume hierarchy built over an array of primitive bounds.
+// It knows nothing about what the primitives are, so objects, triangles and instances can
+// all share the same builder and traversal.
+class bvh_tree
+{
+public:
+	struct node
+	{
+		aabb box;
+		uint32_t offset; // leaf: first slot in prim_indices, interior: index of the second child
+		uint16_t count;  // number of primitives for leaves, 0 for interior nodes
+		uint16_t axis;   // split axis of interior nodes, picks which child to visit first
+	};
+
+	// nodes are stored depth-first, so the first child of node i is always node i + 1
+	std::vector<node> nodes;
+	// primitive index for every leaf slot, callers should store their primitives in this order
+	std::vector<uint32_t> prim_indices;
+
+public:
+	// intersect_cost is relative to visiting a node, lower it for primitives that are cheap to test
+	// together so the builder settles on fuller leaves
+	void build(const std::vector<aabb>& prim_boxes, int max_leaf_size = 4, double intersect_cost = sah_intersect_cost);
+
+	// Visits leaves front-to-back calling leaf(slot, t_max) for every candidate primitive,
+	// where slot indexes prim_indices. The callback should shrink t_max when it finds a
+	// closer hit so that farther nodes get culled.
+	template <typename LeafFunc>
+	void traverse(const ray& r, real t_min, real& t_max, LeafFunc&& leaf) const;
+
+private:
+	// primitives are partitioned in place during the build so every pass reads memory in order
+	struct build_prim
+	{
+		aabb box;
+		point3 centroid;
+		uint32_t index;
+	};
+
+	double prim_cost = sah_intersect_cost;
+
+	uint32_t build_recursive(std::vector<build_prim>& prims, uint32_t start, uint32_t end, int max_leaf_size, int depth);
+};
+
+void bvh_tree::build(const std::vector<aabb>& prim_boxes, int max_leaf_size, double intersect_cost)
+{
+	prim_cost = intersect_cost;
+	nodes.clear();
+	prim_indices.clear();
+	if (prim_boxes.empty())
+		return;
+
+	std::vector<build_prim> prims;
+	prims.reserve(prim_boxes.size());
+	for (size_t i = 0; i < prim_boxes.size(); ++i)
+		prims.push_back({ prim_boxes[i], prim_boxes[i].centroid(), static_cast<uint32_t>(i) });
+
+	nodes.reserve(2 * prim_boxes.size());
+	build_recursive(prims, 0, static_cast<uint32_t>(prims.size()), max_leaf_size, 0);
+	nodes.shrink_to_fit();
+
+	prim_indices.reserve(prims.size());
+	for (const auto& prim : prims)
+		prim_indices.push_back(prim.index);
+}
+
+uint32_t bvh_tree::build_recursive(std::vector<build_prim>& prims, uint32_t start, uint32_t end, int max_leaf_size, int depth)
+{
+	// note: nodes can reallocate while recursing, so only ever access it by index here
+	auto node_index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back(node());
+
+	aabb bounds, centroid_bounds;
+	for (uint32_t i = start; i < end; ++i) {
+		bounds.expand(prims[i].box);
+		centroid_bounds.expand(prims[i].centroid);
+	}
+	nodes[node_index].box = bounds;
+
+	uint32_t n = end - start;
+	if (n == 1) {
+		nodes[node_index].offset = start;
+		nodes[node_index].count = 1;
+		return node_index;
+	}
+
+	// bin every primitive along all three axes in one pass
+	aabb bin_box[3][sah_bins];
+	uint32_t bin_count[3][sah_bins] = {};
+	double bin_scale[3];
+	for (int axis = 0; axis < 3; ++axis) {
+		double extent = centroid_bounds.maximum[axis] - centroid_bounds.minimum[axis];
+		bin_scale[axis] = extent > 0.0 ? sah_bins / extent : 0.0;
+	}
+	auto bin_of = [&](const point3& c, int axis) {
+		return std::min(sah_bins - 1, static_cast<int>((c[axis] - centroid_bounds.minimum[axis]) * bin_scale[axis]));
+	};
+	for (uint32_t i = start; i < end; ++i) {
+		for (int axis = 0; axis < 3; ++axis) {
+			int b = bin_of(prims[i].centroid, axis);
+			bin_count[axis][b]++;
+			bin_box[axis][b].expand(prims[i].box);
+		}
+	}
+
+	// find the cheapest plane, plane b sits between bin b and bin b + 1
+	int best_axis = -1;
+	int best_bin = 0;
+	double best_cost = infinity;
+	for (int axis = 0; axis < 3 && depth < bvh_max_depth; ++axis) {
+		if (bin_scale[axis] == 0.0)
+			continue;
+
+		// sweep from the right for the area/count of everything past each plane
+		double right_area[sah_bins];
+		uint32_t right_count[sah_bins];
+		aabb acc;
+		uint32_t count = 0;
+		for (int b = sah_bins - 1; b > 0; --b) {
+			acc.expand(bin_box[axis][b]);
+			count += bin_count[axis][b];
+			right_area[b] = acc.surface_area();
+			right_count[b] = count;
+		}
+
+		// then from the left, scoring each plane as we pass it
+		acc = aabb();
+		count = 0;
+		for (int b = 0; b < sah_bins - 1; ++b) {
+			acc.expand(bin_box[axis][b]);
+			count += bin_count[axis][b];
+			if (count == 0 || right_count[b + 1] == 0)
+				continue;
+			double cost = count * acc.surface_area() + right_count[b + 1] * right_area[b + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = b;
+			}
+		}
+	}
+
+	double leaf_cost = prim_cost * n;
+	double parent_area = bounds.surface_area();
+	double split_cost = best_axis >= 0 && parent_area > 0.0
+		? sah_traversal_cost + prim_cost * best_cost / parent_area
+		: infinity;
+
+	if (n <= static_cast<uint32_t>(max_leaf_size) && leaf_cost <= split_cost) {
+		nodes[node_index].offset = start;
+		nodes[node_index].count = static_cast<uint16_t>(n);
+		return node_index;
+	}
+
+	uint32_t mid = start;
+	auto first = prims.begin();
+	if (best_axis >= 0) {
+		int axis = best_axis;
+		auto split = std::partition(first + start, first + end, [&](const build_prim& p) {
+			return bin_of(p.centroid, axis) <= best_bin;
+		});
+		mid = static_cast<uint32_t>(split - first);
+	}
+	if (mid == start || mid == end) {
+		// centroids coincide or we're too deep, just halve the range along the widest axis
+		int axis = bounds.longest_axis();
+		best_axis = axis;
+		mid = start + n / 2;
+		std::nth_element(first + start, first + mid, first + end, [&](const build_prim& a, const build_prim& b) {
+			return a.centroid[axis] < b.centroid[axis];
+		});
+	}
+
+	build_recursive(prims, start, mid, max_leaf_size, depth + 1);
+	uint32_t second = build_recursive(prims, mid, end, max_leaf_size, depth + 1);
+
+	nodes[node_index].offset = second;
+	nodes[node_index].count = 0;
+	nodes[node_index].axis = static_cast<uint16_t>(best_axis);
+	return node_index;
+}
+
+template <typename LeafFunc>
+void bvh_tree::traverse(const ray& r, real t_min, real& t_max, LeafFunc&& leaf) const
+{
+	if (nodes.empty())
+		return;
+
+	const point3 orig = r.origin();
+	const vec3 dir = r.direction();
+	const vec3 inv_dir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+	const bool dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+	uint32_t stack[2 * bvh_max_depth];
+	int stack_size = 0;
+	uint32_t current = 0;
+
+	while (true) {
+		const node& n = nodes[current];
+		RT_COUNT(node_tests, 1);
+		if (n.box.hit(orig, inv_dir, t_min, t_max)) {
+			if (n.count > 0) {
+				for (uint32_t i = 0; i < n.count; ++i)
+					leaf(n.offset + i, t_max);
+			} else {
+				// descend into the child nearer along the split axis, come back for the other one
+				if (dir_is_neg[n.axis]) {
+					stack[stack_size++] = current + 1;
+					current = n.offset;
+				} else {
+					stack[stack_size++] = n.offset;
+					current = current + 1;
+				}
+				continue;
+			}
+		}
+		if (stack_size == 0)
+			break;
+		current = stack[--stack_size];
+	}
+}
+
+// hittable wrapper around a bvh_tree, stands in for a hittable_list when rendering
+class bvh_node : public hittable
+{
+public:
+	std::vector<const hittable*> objects; // stored in tree order, not owned
+	bvh_tree tree;
+
+public:
+	bvh_node() {}
+	bvh_node(const hittable_list& list, int max_leaf_size = 4) : bvh_node(list.objects, max_leaf_size) {}
+	bvh_node(const std::vector<const hittable*>& src_objects, int max_leaf_size = 4);
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+};
+
+bvh_node::bvh_node(const std::vector<const hittable*>& src_objects, int max_leaf_size)
+{
+	std::vector<aabb> boxes;
+	boxes.reserve(src_objects.size());
+	for (const auto* object : src_objects) {
+		aabb box;
+		if (!object->bounding_box(box))
+			std::cerr << "No bounding box in bvh_node constructor." << std::endl;
+		boxes.push_back(box);
+	}
+
+	tree.build(boxes, max_leaf_size);
+
+	objects.reserve(src_objects.size());
+	for (auto i : tree.prim_indices)
+		objects.push_back(src_objects[i]);
+}
+
+bool bvh_node::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	// hittables only write rec on a hit, so the closest one found always ends up in rec
+	auto hit_anything = false;
+	tree.traverse(r, t_min, t_max, [&](uint32_t slot, real& closest_so_far) {
+		if (objects[slot]->hit(r, t_min, closest_so_far, rec)) {
+			hit_anything = true;
+			closest_so_far = rec.t;
+		}
+	});
+
+	return hit_anything;
+}
+
+bool bvh_node::bounding_box(aabb& output_box) const
+{
+	if (tree.nodes.empty())
+		return false;
+
+	output_box = tree.nodes[0].box;
+	return true;
+}
+
+#endif
@@ -5,6 +5,20 @@
 
 #include "rtweekend.h"
 
+#include "sampler.h"
+#include "sampling.h"
+
+// where a scene puts its camera, the image's aspect ratio is supplied when the camera is made
+struct camera_settings
+{
+	point3 lookfrom = point3(13, 2, 3);
+	point3 lookat = point3(0, 0, 0);
+	vec3 vup = vec3(0, 1, 0);
+	real vfov = 20; // degrees
+	real aperture = 0.2;
+	real focus_distance = 10;
+};
+
 class camera
 {
 public:
@@ -13,11 +27,11 @@ public:
 	vec3 horizontal_span;
 	vec3 vertical_span;
 	vec3 u, v, w;
-	double lens_radius;
+	real lens_radius;
 
 public:
 	// vfov == verticle field of view in degrees 
-	camera(point3 lookfrom, point3 lookat, vec3 vup, double vfov, double aspect_ratio, double aperture, double focus_distance) {
+	camera(point3 lookfrom, point3 lookat, vec3 vup, real vfov, real aspect_ratio, real aperture, real focus_distance) {
 		auto theta = degrees_to_radians(vfov);
 		auto h = tan(theta / 2);
 		auto viewport_height = 2.0 * h;
@@ -35,9 +49,10 @@ public:
 		lens_radius = aperture / 2;
 	}
 
-	ray get_ray(double s, double t) const
+	ray get_ray(real s, real t) const
 	{
-		vec3 random_in_lens = lens_radius * random_in_unit_disk();
+		sample2 lens = sample_2d();
+		vec3 random_in_lens = lens_radius * sample_concentric_disk(lens.u, lens.v);
 		vec3 offset = u * random_in_lens.x() + v * random_in_lens.y();
 		vec3 ray_origin = camera_origin + offset;
 		return ray(ray_origin, lower_left_corner + s * horizontal_span + t * vertical_span - ray_origin);
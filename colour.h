@@ -5,24 +5,42 @@
 
 #include "vec3.h"
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 
-void write_colour(std::vector<int>& pixels, colour pixel_colour, int samples_per_pixel)
+// luminance of a linear colour, Rec. 709 weights
+inline real luminance(const colour& c)
 {
-	auto r = pixel_colour.x();
-	auto g = pixel_colour.y();
-	auto b = pixel_colour.z();
-
-	// scale colour values to [0,1] and gamma-correct for gamma=2
-	auto scale = 1.0 / samples_per_pixel;
-	r = sqrt(scale * r);
-	g = sqrt(scale * g);
-	b = sqrt(scale * b);
-
-	pixels.push_back(static_cast<int>(256 * clamp(r, 0.0, 0.999)));
-	pixels.push_back(static_cast<int>(256 * clamp(g, 0.0, 0.999)));
-	pixels.push_back(static_cast<int>(256 * clamp(b, 0.0, 0.999)));
+	return static_cast<real>(0.2126) * c.x() + static_cast<real>(0.7152) * c.y() + static_cast<real>(0.0722) * c.z();
 }
 
-#endif
\ No newline at end of file
+// linear RGB image of a value per pixel, e.g. how many samples each took, black for zero through
+// blue, red and yellow up to white for max_value and above
+template <typename T, typename Alloc>
+std::vector<float> heatmap(const std::vector<T, Alloc>& values, double max_value)
+{
+	const colour ramp[] = { colour(0, 0, 0), colour(0, 0, 1), colour(1, 0, 0), colour(1, 1, 0), colour(1, 1, 1) };
+	const int segments = 4;
+
+	std::vector<float> pixels(values.size() * 3);
+	for (size_t i = 0; i < values.size(); ++i) {
+		auto x = clamp(static_cast<double>(values[i]) / max_value, 0.0, 1.0) * segments;
+		int k = std::min(static_cast<int>(x), segments - 1);
+		auto f = static_cast<real>(x - k);
+		colour c = (1 - f) * ramp[k] + f * ramp[k + 1];
+		// squared so the writer's gamma correction gives back the ramp
+		pixels[i * 3] = static_cast<float>(c.x() * c.x());
+		pixels[i * 3 + 1] = static_cast<float>(c.y() * c.y());
+		pixels[i * 3 + 2] = static_cast<float>(c.z() * c.z());
+	}
+	return pixels;
+}
+
+// converts a linear colour channel to 8 bits, gamma-corrected for gamma=2
+inline int to_8bit(double linear)
+{
+	return static_cast<int>(256 * clamp(sqrt(linear > 0.0 ? linear : 0.0), 0.0, 0.999));
+}
+
+#endif
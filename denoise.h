@@ -0,0 +1,206 @@
+#pragma once
+
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) guided by the first-hit AOVs, with
+// SVGF's luminance variance term (Schied et al. 2017). Colour is divided by the albedo first so
+// the filter only blurs lighting and the surfaces' own detail comes back sharp when it's
+// multiplied back in. Each iteration is a 5x5 B3 spline whose taps are twice as far apart as the
+// last's, so n of them reach 2^(n+1) - 2 pixels each way for 25n taps a pixel. A tap counts for less
+// the more its normal, depth or brightness (against the noise expected there) differs. The noise
+// is each pixel's own, measured over its samples by the accumulation buffer rather than over
+// SVGF's frame history; pixels with too few samples to say have it estimated from their
+// neighbours instead, weighted by the AOVs so it doesn't reach across edges.
+struct denoise_settings
+{
+	// tuned on the random scene at 4 to 16 samples per pixel, more iterations blur away contact
+	// shadows faster than they remove noise
+	int iterations = 2;
+	float luminance_sigma = 4;   // how many standard deviations of noise apart taps can be and still mix
+	float normal_power = 16;     // taps count for dot(normals)^normal_power, a power of two is cheapest
+	float depth_sigma = 0.005f;  // depth difference allowed per pixel of distance, relative to depth
+	unsigned int threads = 0;   // one per hardware thread when 0
+};
+
+// rows(y) for every y in [0, height), spread over n_threads threads pulling a few rows at a time
+template <typename F>
+void for_each_row(long long height, unsigned int n_threads, const F& rows)
+{
+	const long long rows_per_claim = 4;
+	std::atomic<long long> next_row(0);
+	auto work = [&] {
+		while (true) {
+			long long y0 = next_row.fetch_add(rows_per_claim);
+			if (y0 >= height)
+				return;
+			for (long long y = y0; y < std::min(height, y0 + rows_per_claim); ++y)
+				rows(y);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < n_threads; ++i)
+		threads.push_back(std::thread(work));
+	work();
+	for (std::thread& th : threads)
+		th.join();
+}
+
+// What the tap weights compare, per pixel. Normals are unit length or zero where the camera ray
+// escaped, as is depth.
+struct denoise_guide
+{
+	const float* normal;
+	const float* depth;
+	float normal_power, depth_sigma;
+
+	// the AOV part of q's weight for p, distance pixels apart
+	float weight(long long p, long long q, float distance) const
+	{
+		const float* np = normal + p * 3;
+		const float* nq = normal + q * 3;
+		float d = np[0] * nq[0] + np[1] * nq[1] + np[2] * nq[2];
+		// two escaped rays match, an escaped ray and a surface don't
+		bool p_escaped = depth[p] == 0, q_escaped = depth[q] == 0;
+		if (p_escaped || q_escaped)
+			return p_escaped == q_escaped ? 1.0f : 0.0f;
+		if (d <= 0)
+			return 0;
+		// d^normal_power by squaring, exact for powers of two
+		float w = d;
+		for (float k = 2; k <= normal_power; k *= 2)
+			w *= w;
+		float z_scale = depth_sigma * std::max(depth[p], depth[q]) * distance;
+		return w * std::exp(-std::fabs(depth[p] - depth[q]) / z_scale);
+	}
+};
+
+inline float pixel_luminance(const float* c)
+{
+	return 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+}
+
+// Denoises a linear RGB image in place with its AOVs and luminance variance (as
+// accumulation_buffer::resolve_aovs gives them), all width x height with row 0 at the bottom.
+void denoise(std::vector<float>& image, const std::vector<float>& albedo, const std::vector<float>& normal, const std::vector<float>& depth,
+	const std::vector<float>& pixel_variance, long long width, long long height, const denoise_settings& ds)
+{
+	const unsigned int n_threads = ds.threads > 0 ? ds.threads : std::max(1u, std::thread::hardware_concurrency());
+	const long long n = width * height;
+	const denoise_guide guide = { normal.data(), depth.data(), ds.normal_power, ds.depth_sigma };
+	// dark albedo would blow the noise up, those channels are filtered as they are
+	auto demodulation = [&](long long p, int c) {
+		float a = albedo[p * 3 + c];
+		return a > 0.01f ? a : 1.0f;
+	};
+
+	// lighting, and the variance of its luminance
+	std::vector<float> lighting(n * 3), filtered(n * 3), variance(n), next_variance(n), blurred_variance(n);
+	for_each_row(height, n_threads, [&](long long y) {
+		for (long long p = y * width; p < (y + 1) * width; ++p)
+			for (int c = 0; c < 3; ++c)
+				lighting[p * 3 + c] = image[p * 3 + c] / demodulation(p, c);
+	});
+	for_each_row(height, n_threads, [&](long long y) {
+		const long long radius = 3;
+		for (long long x = 0; x < width; ++x) {
+			long long p = y * width + x;
+			if (pixel_variance[p] >= 0) {
+				// scaled as the demodulation scaled the luminance
+				float a = pixel_luminance(&albedo[p * 3]);
+				variance[p] = a > 0.01f ? pixel_variance[p] / (a * a) : pixel_variance[p];
+				continue;
+			}
+			float sum_w = 0, sum_l = 0, sum_l2 = 0;
+			for (long long qy = std::max(0LL, y - radius); qy <= std::min(height - 1, y + radius); ++qy) {
+				for (long long qx = std::max(0LL, x - radius); qx <= std::min(width - 1, x + radius); ++qx) {
+					long long q = qy * width + qx;
+					float distance = std::sqrt(static_cast<float>((qx - x) * (qx - x) + (qy - y) * (qy - y)));
+					float w = q == p ? 1.0f : guide.weight(p, q, distance);
+					float l = pixel_luminance(&lighting[q * 3]);
+					sum_w += w;
+					sum_l += w * l;
+					sum_l2 += w * l * l;
+				}
+			}
+			float mean = sum_l / sum_w;
+			variance[p] = std::max(0.0f, sum_l2 / sum_w - mean * mean);
+		}
+	});
+
+	const float kernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+	for (int iteration = 0; iteration < ds.iterations; ++iteration) {
+		const long long step = 1LL << iteration;
+		// the variance the luminance weights are judged against, blurred 3x3 so one unlucky pixel
+		// doesn't stop its neighbours mixing
+		for_each_row(height, n_threads, [&](long long y) {
+			const float blur[3] = { 0.25f, 0.5f, 0.25f };
+			for (long long x = 0; x < width; ++x) {
+				float sum = 0, sum_w = 0;
+				for (int dy = -1; dy <= 1; ++dy) {
+					for (int dx = -1; dx <= 1; ++dx) {
+						long long qx = x + dx, qy = y + dy;
+						if (qx < 0 || qx >= width || qy < 0 || qy >= height)
+							continue;
+						float w = blur[dx + 1] * blur[dy + 1];
+						sum += w * variance[qy * width + qx];
+						sum_w += w;
+					}
+				}
+				blurred_variance[y * width + x] = sum / sum_w;
+			}
+		});
+		for_each_row(height, n_threads, [&](long long y) {
+			for (long long x = 0; x < width; ++x) {
+				long long p = y * width + x;
+				float lp = pixel_luminance(&lighting[p * 3]);
+				float luminance_scale = 1.0f / (ds.luminance_sigma * std::sqrt(blurred_variance[p]) + 1e-6f);
+				float sum[3] = {}, sum_w = 0, sum_variance = 0;
+				for (int dy = -2; dy <= 2; ++dy) {
+					long long qy = y + dy * step;
+					if (qy < 0 || qy >= height)
+						continue;
+					for (int dx = -2; dx <= 2; ++dx) {
+						long long qx = x + dx * step;
+						if (qx < 0 || qx >= width)
+							continue;
+						long long q = qy * width + qx;
+						float w = kernel[dx + 2] * kernel[dy + 2];
+						if (q != p) {
+							float distance = step * std::sqrt(static_cast<float>(dx * dx + dy * dy));
+							w *= guide.weight(p, q, distance);
+							if (w == 0)
+								continue;
+							w *= std::exp(-std::fabs(lp - pixel_luminance(&lighting[q * 3])) * luminance_scale);
+						}
+						for (int c = 0; c < 3; ++c)
+							sum[c] += w * lighting[q * 3 + c];
+						sum_w += w;
+						sum_variance += w * w * variance[q];
+					}
+				}
+				for (int c = 0; c < 3; ++c)
+					filtered[p * 3 + c] = sum[c] / sum_w;
+				next_variance[p] = sum_variance / (sum_w * sum_w);
+			}
+		});
+		std::swap(lighting, filtered);
+		std::swap(variance, next_variance);
+	}
+
+	for_each_row(height, n_threads, [&](long long y) {
+		for (long long p = y * width; p < (y + 1) * width; ++p)
+			for (int c = 0; c < 3; ++c)
+				image[p * 3 + c] = lighting[p * 3 + c] * demodulation(p, c);
+	});
+}
+
+#endif
@@ -0,0 +1,562 @@
+#pragma once
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "rtweekend.h"
+
+#include "accumulation.h"
+#include "net.h"
+#include "settings.h"
+#include "tiles.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Distributed rendering: a coordinator process and any number of worker processes, on this
+// machine or others, talking over TCP. Workers connect to the coordinator and are sent its
+// command line, so they build the same scene, cameras and settings, then they're handed batches
+// of tiles from one pass of one frame at a time. A worker renders each batch with all its threads
+// into an accumulation buffer of its own and sends back the tiles' raw sums, which the
+// coordinator adds to its buffer just as a render thread would have. A pixel's samples only
+// depend on the seed, the pass and where it is (see pixel_seed), and each pixel still gets one
+// add per pass with the passes in order, so the image is bit for bit the one a single process
+// renders, however the tiles were shared out.
+//
+// A worker whose connection drops (it crashed, was killed or lost the network) has its batch
+// handed to the others, and one that joins part way through gets work from the next batch on.
+// So does one that goes quiet without the connection dropping: keepalive probes catch a machine
+// that's lost power or the network, and once any batch has come back, a worker that takes ten
+// times the longest batch so far (and at least a minute) over its own is given up on. Messages are in
+// native byte order, like checkpoints, so every machine has to share it. Per-pixel timings under
+// RT_STATS stay with the workers.
+
+// a worker's first message, "RTWORKR" and a protocol version
+const char worker_magic[8] = { 'R', 'T', 'W', 'O', 'R', 'K', 'R', '1' };
+
+// what the coordinator sends after the handshake, each a uint32 and whatever follows it
+enum class coordinator_message : uint32_t
+{
+	job = 1, // a tile_job, then its tiles
+	done = 2 // nothing more to render, the worker can go
+};
+
+// a batch of tiles to render
+struct tile_job
+{
+	uint64_t frame;
+	uint64_t pass;
+	uint32_t flags;   // job_has_aovs
+	uint32_t n_tiles;
+};
+
+const uint32_t job_has_aovs = 1;
+
+// sanity limits on what's read off the wire, so a stray connection can't ask for gigabytes
+const uint32_t max_message_strings = 4096;
+const uint32_t max_message_string_length = 1 << 20;
+const uint32_t max_job_tiles = 1 << 16;
+
+template <typename T>
+bool send_value(socket_handle s, const T& value)
+{
+	return send_all(s, &value, sizeof(value));
+}
+
+template <typename T>
+bool recv_value(socket_handle s, T& value)
+{
+	return recv_all(s, &value, sizeof(value));
+}
+
+// Tile results on the wire: the tile's rows of each buffer in turn, sum, samples, then albedo,
+// normal, depth and luminance squares when there are AOVs.
+template <typename Accumulation, typename F>
+void for_each_tile_buffer(Accumulation& accum, bool aovs, const F& f)
+{
+	f(accum.sum, 3);
+	f(accum.samples, 1);
+	if (aovs) {
+		f(accum.albedo, 3);
+		f(accum.normal, 3);
+		f(accum.depth, 1);
+		f(accum.luminance_squares, 1);
+	}
+}
+
+size_t tile_result_bytes(const tile& t, bool aovs)
+{
+	size_t pixels = static_cast<size_t>(t.width()) * t.height();
+	return pixels * (3 * sizeof(float) + sizeof(int) + (aovs ? 8 * sizeof(float) : 0));
+}
+
+// appends t's part of accum to out
+void pack_tile(const accumulation_buffer& accum, const tile& t, bool aovs, std::vector<char>& out)
+{
+	for_each_tile_buffer(accum, aovs, [&](const auto& buffer, int channels) {
+		using value = typename std::decay_t<decltype(buffer)>::value_type;
+		size_t row_bytes = static_cast<size_t>(t.width()) * channels * sizeof(value);
+		for (int j = t.y0; j < t.y1; ++j) {
+			const char* row = reinterpret_cast<const char*>(&buffer[(j * accum.width + t.x0) * channels]);
+			out.insert(out.end(), row, row + row_bytes);
+		}
+	});
+}
+
+// adds a packed tile into accum, clearing it first while accum is untouched, as render_tiles does
+void merge_tile(accumulation_buffer& accum, const tile& t, bool aovs, const char* data)
+{
+	if (accum.untouched)
+		accum.clear_tile(t);
+	for_each_tile_buffer(accum, aovs, [&](auto& buffer, int channels) {
+		using value = typename std::decay_t<decltype(buffer)>::value_type;
+		size_t row_values = static_cast<size_t>(t.width()) * channels;
+		for (int j = t.y0; j < t.y1; ++j) {
+			value* row = &buffer[(j * accum.width + t.x0) * channels];
+			for (size_t k = 0; k < row_values; ++k, data += sizeof(value)) {
+				value v;
+				std::memcpy(&v, data, sizeof(value));
+				row[k] += v;
+			}
+		}
+	});
+}
+
+// how one worker got on, for the summary at the end
+struct remote_worker_stats
+{
+	std::string peer;         // its address
+	unsigned int threads = 0;
+	long long tiles = 0;      // rendered and merged
+	double busy_seconds = 0;  // from sending it a batch to having the batch back
+	bool dropped = false;     // its connection went before the coordinator was done
+	long long lost_tiles = 0; // handed to the others when it dropped
+};
+
+// The coordinator's end. Listens for workers and gives each connection a thread, which sends it
+// batches while there are tiles to render and merges what comes back.
+class render_coordinator
+{
+public:
+	render_coordinator() {}
+	render_coordinator(const render_coordinator&) = delete;
+	render_coordinator& operator=(const render_coordinator&) = delete;
+	~render_coordinator() { stop(); }
+
+	// Listens on address, host:port. Workers that connect are sent args, the coordinator's
+	// command line. False after saying why if the address can't be listened on.
+	bool start(const std::string& address, std::vector<std::string> args);
+	// Renders every tile of scheduler for one pass of frame on the workers, adding their results
+	// to accum, and returns once all of them are in, waiting for workers to connect if there are
+	// none. Calls scheduler.finished() for each tile so progress can be polled as usual.
+	void render_pass(uint64_t frame, const render_settings& settings, tile_scheduler& scheduler, accumulation_buffer& accum);
+	// tells the workers they're done, then stops listening
+	void stop();
+
+	std::vector<remote_worker_stats> worker_stats();
+
+private:
+	void serve(socket_handle s, size_t index);
+	// tiles for a batch of up to n, the ones dropped workers left first, under the lock
+	void take_batch(size_t n, std::vector<tile>& batch);
+
+	std::string listen_address;
+	socket_handle listener = no_socket;
+	std::thread acceptor;
+	std::vector<std::string> worker_args;
+
+	std::mutex m;
+	std::condition_variable work;     // tiles to hand out, or stopping
+	std::condition_variable finished; // a batch merged
+	// the pass being rendered, no scheduler between passes
+	tile_scheduler* scheduler = nullptr;
+	accumulation_buffer* accum = nullptr;
+	tile_job job = {};
+	bool drained = false;             // scheduler has handed out all its tiles
+	size_t merged = 0;                // tiles of the pass added to accum, counted under the lock so
+	                                  // render_pass sees every merge's writes once it reaches them all
+	std::deque<tile> returned;        // from workers that dropped, handed out again first
+	double longest_batch_seconds = 0; // that any worker took to send back, for the timeout on the rest
+	bool stopping = false;
+	std::vector<std::thread> connections;
+	std::vector<socket_handle> setting_up; // workers still building their scene, which stop cuts off
+	std::vector<remote_worker_stats> workers;
+	size_t connected = 0;
+};
+
+bool render_coordinator::start(const std::string& address, std::vector<std::string> args)
+{
+	std::string host;
+	int port;
+	if (!split_host_port(address, host, port)) {
+		std::cerr << "Coordinator address " << address << " isn't a host:port" << std::endl;
+		return false;
+	}
+	if (!net_startup()) {
+		std::cerr << "Couldn't start Winsock" << std::endl;
+		return false;
+	}
+	listener = listen_tcp(host, port);
+	if (listener == no_socket) {
+		std::cerr << "Couldn't listen on " << address << std::endl;
+		net_cleanup();
+		return false;
+	}
+	listen_address = address;
+	worker_args = std::move(args);
+	std::cerr << "Coordinating workers on " << address << std::endl;
+	acceptor = std::thread([this] {
+		while (true) {
+			sockaddr_in peer = {};
+			socklen_t peer_size = sizeof(peer);
+			socket_handle s = accept(listener, reinterpret_cast<sockaddr*>(&peer), &peer_size);
+			std::lock_guard<std::mutex> lock(m);
+			if (stopping) {
+				if (s != no_socket)
+					close_socket(s);
+				return;
+			}
+			if (s == no_socket)
+				continue;
+			set_no_delay(s);
+			set_keepalive(s);
+			char name[INET_ADDRSTRLEN] = "?";
+			inet_ntop(AF_INET, &peer.sin_addr, name, sizeof(name));
+			remote_worker_stats stats;
+			stats.peer = std::string(name) + ':' + std::to_string(ntohs(peer.sin_port));
+			workers.push_back(stats);
+			setting_up.push_back(s);
+			connections.push_back(std::thread(&render_coordinator::serve, this, s, workers.size() - 1));
+		}
+	});
+	return true;
+}
+
+void render_coordinator::take_batch(size_t n, std::vector<tile>& batch)
+{
+	batch.clear();
+	while (batch.size() < n && !returned.empty()) {
+		batch.push_back(returned.front());
+		returned.pop_front();
+	}
+	tile t;
+	while (batch.size() < n && !drained) {
+		if (scheduler->next(t))
+			batch.push_back(t);
+		else
+			drained = true;
+	}
+}
+
+void render_coordinator::serve(socket_handle s, size_t index)
+{
+	auto forget = [&] {
+		std::lock_guard<std::mutex> lock(m);
+		setting_up.erase(std::remove(setting_up.begin(), setting_up.end(), s), setting_up.end());
+	};
+
+	// handshake: the worker's magic, the coordinator's arguments, then the worker's thread count
+	// once it's built the scene, zero if it couldn't
+	char magic[sizeof(worker_magic)];
+	uint32_t threads = 0;
+	bool ready = recv_all(s, magic, sizeof(magic)) && std::memcmp(magic, worker_magic, sizeof(magic)) == 0
+		&& send_value(s, static_cast<uint32_t>(worker_args.size()));
+	for (size_t i = 0; ready && i < worker_args.size(); ++i)
+		ready = send_value(s, static_cast<uint32_t>(worker_args[i].size())) && send_all(s, worker_args[i].data(), worker_args[i].size());
+	ready = ready && recv_value(s, threads) && threads > 0;
+	forget();
+	if (!ready) {
+		close_socket(s);
+		return;
+	}
+
+	std::string peer;
+	{
+		std::lock_guard<std::mutex> lock(m);
+		workers[index].threads = threads;
+		peer = workers[index].peer;
+		connected++;
+	}
+	std::cerr << "Worker " << peer << " joined with " << threads << " threads" << std::endl;
+	// once an answer's started the rest of it follows straight away, a minute without any is a dead worker
+	set_timeout(s, 60000);
+
+	// enough tiles that its threads don't run dry before the last one's claimed
+	const size_t batch_size = 2 * static_cast<size_t>(threads);
+	std::vector<tile> batch;
+	std::vector<char> results;
+	while (true) {
+		tile_job batch_job;
+		accumulation_buffer* target;
+		tile_scheduler* batch_scheduler;
+		{
+			std::unique_lock<std::mutex> lock(m);
+			work.wait(lock, [&] { return stopping || (scheduler && (!returned.empty() || !drained)); });
+			if (stopping)
+				break;
+			take_batch(batch_size, batch);
+			if (batch.empty())
+				continue;
+			batch_job = job;
+			batch_job.n_tiles = static_cast<uint32_t>(batch.size());
+			target = accum;
+			batch_scheduler = scheduler;
+		}
+
+		auto tp1 = std::chrono::high_resolution_clock::now();
+		bool aovs = (batch_job.flags & job_has_aovs) != 0;
+		size_t result_bytes = 0;
+		for (const tile& t : batch)
+			result_bytes += tile_result_bytes(t, aovs);
+		results.resize(result_bytes);
+		// Waits for the answer to start, checking every second against the slowest batch any worker
+		// has sent back so far. There's no limit until one has, the scene could take any time.
+		auto await_answer = [&] {
+			while (true) {
+				int ready = wait_readable(s, 1000);
+				if (ready != 0)
+					return ready > 0;
+				double waited = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tp1).count();
+				std::lock_guard<std::mutex> lock(m);
+				if (longest_batch_seconds > 0 && waited > std::max(60.0, 10 * longest_batch_seconds))
+					return false;
+			}
+		};
+		uint32_t n_back = 0;
+		bool ok = send_value(s, coordinator_message::job) && send_value(s, batch_job) && send_all(s, batch.data(), batch.size() * sizeof(tile))
+			&& await_answer() && recv_value(s, n_back) && n_back == batch.size() && recv_all(s, results.data(), results.size());
+		if (!ok) {
+			// the tiles go back for the others and this worker's done with
+			std::lock_guard<std::mutex> lock(m);
+			returned.insert(returned.end(), batch.begin(), batch.end());
+			workers[index].dropped = true;
+			workers[index].lost_tiles += static_cast<long long>(batch.size());
+			connected--;
+			std::cerr << "Lost worker " << peer << " (dropped or stopped answering), handing its " << batch.size() << " tiles to the others"
+				<< std::endl;
+			if (connected == 0)
+				std::cerr << "Waiting for workers on " << listen_address << std::endl;
+			work.notify_all();
+			close_socket(s);
+			return;
+		}
+
+		// tiles never overlap, so batches merge side by side without the lock
+		const char* data = results.data();
+		for (const tile& t : batch) {
+			merge_tile(*target, t, aovs, data);
+			data += tile_result_bytes(t, aovs);
+			batch_scheduler->finished();
+		}
+		auto tp2 = std::chrono::high_resolution_clock::now();
+		std::lock_guard<std::mutex> lock(m);
+		merged += batch.size();
+		workers[index].tiles += static_cast<long long>(batch.size());
+		double seconds = std::chrono::duration<double>(tp2 - tp1).count();
+		workers[index].busy_seconds += seconds;
+		longest_batch_seconds = std::max(longest_batch_seconds, seconds);
+		finished.notify_all();
+	}
+
+	send_value(s, coordinator_message::done);
+	close_socket(s);
+}
+
+void render_coordinator::render_pass(uint64_t frame, const render_settings& settings, tile_scheduler& pass_scheduler,
+	accumulation_buffer& pass_accum)
+{
+	std::unique_lock<std::mutex> lock(m);
+	scheduler = &pass_scheduler;
+	accum = &pass_accum;
+	job.frame = frame;
+	job.pass = settings.pass;
+	job.flags = pass_accum.has_aovs() ? job_has_aovs : 0;
+	drained = false;
+	merged = 0;
+	if (connected == 0)
+		std::cerr << "Waiting for workers on " << listen_address << std::endl;
+	work.notify_all();
+	finished.wait(lock, [&] { return merged == pass_scheduler.tiles.size(); });
+	scheduler = nullptr;
+	accum = nullptr;
+}
+
+void render_coordinator::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m);
+		if (listener == no_socket)
+			return;
+		stopping = true;
+		// workers still loading the scene would keep their threads waiting for them
+		for (socket_handle s : setting_up)
+			interrupt_socket(s);
+	}
+	work.notify_all();
+	shutdown_socket(listener);
+	acceptor.join();
+	listener = no_socket;
+	for (std::thread& th : connections)
+		th.join();
+	connections.clear();
+	net_cleanup();
+}
+
+std::vector<remote_worker_stats> render_coordinator::worker_stats()
+{
+	std::lock_guard<std::mutex> lock(m);
+	return workers;
+}
+
+// The worker's end: connects to the coordinator, takes its arguments, then renders the batches
+// it's sent until it's told there are no more.
+class render_worker
+{
+public:
+	// renders every tile of scheduler for one pass of frame into accum with all the worker's
+	// threads, false if frame isn't one it knows
+	using render_batch = std::function<bool(uint64_t frame, const render_settings& settings, tile_scheduler& scheduler, accumulation_buffer& accum)>;
+
+public:
+	long long tiles = 0;
+	long long batches = 0;
+
+public:
+	render_worker() {}
+	render_worker(const render_worker&) = delete;
+	render_worker& operator=(const render_worker&) = delete;
+	~render_worker();
+
+	// Connects to address, host:port, trying for a while in case the coordinator is still
+	// starting, and fills args with the coordinator's arguments. False after saying why.
+	bool connect(const std::string& address, std::vector<std::string>& args);
+	// Tells the coordinator it's ready with n_threads, then renders what it's sent. True once the
+	// coordinator says it's done, false after saying why if the connection drops first.
+	bool serve(unsigned int n_threads, const render_settings& settings, const render_batch& render);
+
+private:
+	socket_handle s = no_socket;
+	bool started = false;
+};
+
+render_worker::~render_worker()
+{
+	if (s != no_socket)
+		close_socket(s);
+	if (started)
+		net_cleanup();
+}
+
+bool render_worker::connect(const std::string& address, std::vector<std::string>& args)
+{
+	std::string host;
+	int port;
+	if (!split_host_port(address, host, port)) {
+		std::cerr << "Coordinator address " << address << " isn't a host:port" << std::endl;
+		return false;
+	}
+	if (!net_startup()) {
+		std::cerr << "Couldn't start Winsock" << std::endl;
+		return false;
+	}
+	started = true;
+	const int attempts = 50;
+	for (int attempt = 0; attempt < attempts && s == no_socket; ++attempt) {
+		s = connect_tcp(host, port);
+		if (s == no_socket)
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	if (s == no_socket) {
+		std::cerr << "Couldn't reach a coordinator at " << address << std::endl;
+		return false;
+	}
+
+	uint32_t n_args = 0;
+	bool ok = send_all(s, worker_magic, sizeof(worker_magic)) && recv_value(s, n_args) && n_args <= max_message_strings;
+	args.clear();
+	for (uint32_t i = 0; ok && i < n_args; ++i) {
+		uint32_t length = 0;
+		ok = recv_value(s, length) && length <= max_message_string_length;
+		if (ok) {
+			std::string arg(length, '\0');
+			ok = recv_all(s, &arg[0], length);
+			args.push_back(std::move(arg));
+		}
+	}
+	if (!ok) {
+		std::cerr << "The coordinator at " << address << " didn't send its options" << std::endl;
+		return false;
+	}
+	std::cerr << "Working for the coordinator at " << address << std::endl;
+	return true;
+}
+
+bool render_worker::serve(unsigned int n_threads, const render_settings& settings, const render_batch& render)
+{
+	if (!send_value(s, static_cast<uint32_t>(n_threads))) {
+		std::cerr << "Lost the coordinator" << std::endl;
+		return false;
+	}
+
+	// the worker's own buffer, every tile is cleared by the thread that renders it and only the
+	// tiles just rendered are sent back
+	accumulation_buffer accum(settings.image_width, settings.image_height, settings.seed, true);
+	render_settings batch_settings = settings;
+	std::vector<tile> batch;
+	std::vector<char> results;
+	while (true) {
+		coordinator_message message;
+		if (!recv_value(s, message)) {
+			std::cerr << "Lost the coordinator" << std::endl;
+			return false;
+		}
+		if (message == coordinator_message::done)
+			return true;
+
+		tile_job job;
+		bool ok = message == coordinator_message::job && recv_value(s, job) && job.n_tiles <= max_job_tiles;
+		if (ok) {
+			batch.resize(job.n_tiles);
+			ok = recv_all(s, batch.data(), batch.size() * sizeof(tile));
+		}
+		for (const tile& t : batch)
+			ok = ok && t.x0 >= 0 && t.y0 >= 0 && t.x0 < t.x1 && t.y0 < t.y1 && t.x1 <= accum.width && t.y1 <= accum.height;
+		if (!ok) {
+			std::cerr << "Got a bad message from the coordinator" << std::endl;
+			return false;
+		}
+
+		bool aovs = (job.flags & job_has_aovs) != 0;
+		if (aovs && !accum.has_aovs())
+			accum.enable_aovs();
+		accum.untouched = true;
+		batch_settings.pass = job.pass;
+		tile_scheduler scheduler(batch);
+		if (!render(job.frame, batch_settings, scheduler, accum)) {
+			std::cerr << "The coordinator asked for frame " << job.frame << ", which this worker doesn't have" << std::endl;
+			return false;
+		}
+
+		results.clear();
+		for (const tile& t : batch)
+			pack_tile(accum, t, aovs, results);
+		if (!send_value(s, job.n_tiles) || !send_all(s, results.data(), results.size())) {
+			std::cerr << "Lost the coordinator" << std::endl;
+			return false;
+		}
+		tiles += job.n_tiles;
+		batches++;
+	}
+}
+
+#endif
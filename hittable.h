@@ -4,14 +4,15 @@
 #define HITTABLE_H
 
 #include "rtweekend.h"
+#include "aabb.h"
 
 class material;
 
 struct hit_record {
 	point3 p;
 	vec3 normal;
-	shared_ptr<material> mat_ptr;
-	double t;
+	const material* mat_ptr; // owned by the scene
+	real t;
 	bool front_face;
 
 	inline void set_face_normal(const ray& r, const vec3& outward_normal)
@@ -24,7 +25,15 @@ struct hit_record {
 class hittable
 {
 public:
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+	virtual ~hittable() = default;
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const = 0;
+	virtual bool bounding_box(aabb& output_box) const = 0;
+
+	// For shapes that can be lights: the solid angle pdf of random() picking direction from origin,
+	// and a random direction from origin towards the shape. Everything else is never sampled.
+	virtual real pdf_value(const point3& origin, const vec3& direction) const { return 0; }
+	virtual vec3 random(const point3& origin) const { return vec3(1, 0, 0); }
 };
 
 #endif
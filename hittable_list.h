@@ -6,40 +6,77 @@
 #include "rtweekend.h"
 
 #include "hittable.h"
+#include "sampler.h"
 
-#include <memory>
+#include <algorithm>
 #include <vector>
 
+// a plain list of objects, doesn't own them (see scene)
 class hittable_list : public hittable
 {
 public:
-	std::vector<shared_ptr<hittable>> objects;
+	std::vector<const hittable*> objects;
 
 public:
 	hittable_list() {}
-	hittable_list(shared_ptr<hittable> object) { add(object); }
+	hittable_list(const hittable* object) { add(object); }
 
 	void clear() { objects.clear(); }
-	void add(shared_ptr<hittable> object) { objects.push_back(object); }
+	void add(const hittable* object) { objects.push_back(object); }
 
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+	// picks one of the objects at random, so the pdf is the mean of theirs
+	virtual real pdf_value(const point3& origin, const vec3& direction) const override;
+	virtual vec3 random(const point3& origin) const override;
 };
 
-bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+bool hittable_list::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
 {
-	hit_record temp_rec;
+	// hittables only write rec on a hit, so there's no need for a temporary to copy from
     auto hit_anything = false;
     auto closest_so_far = t_max;
 
-    for (const auto& object : objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+    for (const auto* object : objects) {
+        if (object->hit(r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
 
     return hit_anything;
 }
 
+bool hittable_list::bounding_box(aabb& output_box) const
+{
+	if (objects.empty())
+		return false;
+
+	aabb temp_box;
+	output_box = aabb();
+	for (const auto* object : objects) {
+		if (!object->bounding_box(temp_box))
+			return false;
+		output_box.expand(temp_box);
+	}
+
+	return true;
+}
+
+real hittable_list::pdf_value(const point3& origin, const vec3& direction) const
+{
+	if (objects.empty())
+		return 0;
+	real sum = 0;
+	for (const auto* object : objects)
+		sum += object->pdf_value(origin, direction);
+	return sum / static_cast<real>(objects.size());
+}
+
+vec3 hittable_list::random(const point3& origin) const
+{
+	auto n = static_cast<int>(objects.size());
+	return objects[std::min(static_cast<int>(sample_1d() * n), n - 1)]->random(origin);
+}
+
 #endif
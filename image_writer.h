@@ -0,0 +1,86 @@
+#pragma once
+
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "rtweekend.h"
+
+#include "colour.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class image_format
+{
+	ppm_ascii,  // P3, the original output format
+	ppm_binary, // P6, same 8-bit image at a fraction of the size and write time
+	pfm         // linear float RGB, keeps the full range of the render
+};
+
+// Writes a linear float RGB image, row 0 at the bottom, straight to disk one output row at a
+// time. Each upscaled row is built once and written upscale_factor times, so the only copy
+// of the image is the caller's. Returns false if the file couldn't be written.
+bool write_image(const std::string& path, const std::vector<float>& pixels, long long width, long long height,
+	int upscale_factor, image_format format)
+{
+	std::ofstream file_out(path, std::ios::binary);
+	if (!file_out)
+		return false;
+
+	long long out_width = width * upscale_factor;
+	long long out_height = height * upscale_factor;
+
+	if (format == image_format::pfm) {
+		// the floats go out in the host's byte order, which the scale's sign says, negative for
+		// little-endian. Rows are stored bottom to top.
+		const uint32_t probe = 1;
+		char low_byte;
+		std::memcpy(&low_byte, &probe, 1);
+		file_out << "PF\n" << out_width << ' ' << out_height << (low_byte == 1 ? "\n-1.0\n" : "\n1.0\n");
+		std::vector<float> row(out_width * 3);
+		for (long long j = 0; j < height; ++j) {
+			for (long long i = 0; i < width; ++i)
+				for (int u = 0; u < upscale_factor; ++u)
+					std::memcpy(&row[(i * upscale_factor + u) * 3], &pixels[(j * width + i) * 3], 3 * sizeof(float));
+			for (int u = 0; u < upscale_factor; ++u)
+				file_out.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+		}
+		return static_cast<bool>(file_out);
+	}
+
+	bool ascii = format == image_format::ppm_ascii;
+	file_out << (ascii ? "P3\n" : "P6\n") << out_width << ' ' << out_height << "\n255\n";
+
+	// P3 stores every channel as text, at most "255 " so 4 chars a channel
+	std::vector<char> row(out_width * 3 * (ascii ? 4 : 1));
+	for (long long j = height - 1; j >= 0; --j) {
+		char* out = row.data();
+		for (long long i = 0; i < width; ++i) {
+			const float* p = &pixels[(j * width + i) * 3];
+			int rgb[3] = { to_8bit(p[0]), to_8bit(p[1]), to_8bit(p[2]) };
+			for (int u = 0; u < upscale_factor; ++u) {
+				for (int c = 0; c < 3; ++c) {
+					if (!ascii) {
+						*out++ = static_cast<char>(rgb[c]);
+						continue;
+					}
+					// hand-rolled integer formatting, this loop runs for every channel of the image
+					int v = rgb[c];
+					if (v >= 100)
+						*out++ = static_cast<char>('0' + v / 100);
+					if (v >= 10)
+						*out++ = static_cast<char>('0' + v / 10 % 10);
+					*out++ = static_cast<char>('0' + v % 10);
+					*out++ = c == 2 ? '\n' : ' ';
+				}
+			}
+		}
+		for (int u = 0; u < upscale_factor; ++u)
+			file_out.write(row.data(), out - row.data());
+	}
+	return static_cast<bool>(file_out);
+}
+
+#endif
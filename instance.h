@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "transform.h"
+
+// A placement of shared geometry, e.g. a mesh or a bvh_node over a group of objects, somewhere in
+// the world. Many instances can point at the same object, so memory grows with the unique
+// geometry rather than the number of copies. The scene BVH over instances and each object's own
+// acceleration structure make up a two-level hierarchy.
+class instance : public hittable
+{
+public:
+	const hittable* object; // owned by the scene, in its own object space
+	affine_transform object_to_world;
+	affine_transform world_to_object;
+	const material* mat_ptr; // replaces the object's materials, keep the object's own when null
+
+public:
+	instance(const hittable* obj, const affine_transform& transform, const material* material_override = nullptr);
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+
+private:
+	aabb box;
+	bool has_box;
+};
+
+instance::instance(const hittable* obj, const affine_transform& transform, const material* material_override)
+	: object(obj), object_to_world(transform), world_to_object(transform.inverse()), mat_ptr(material_override)
+{
+	aabb object_box;
+	has_box = object->bounding_box(object_box);
+	if (has_box)
+		box = object_to_world.apply_box(object_box);
+}
+
+bool instance::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	// the direction isn't renormalised, so t means the same thing in both spaces
+	ray local(world_to_object.apply_point(r.origin()), world_to_object.apply_vector(r.direction()));
+	if (!object->hit(local, t_min, t_max, rec))
+		return false;
+
+	rec.p = r.at(rec.t);
+	// normals go back through the inverse transpose, which keeps them facing the way they did
+	// relative to the ray, so front_face still holds
+	rec.normal = unit_vector(world_to_object.apply_transposed(rec.normal));
+	if (mat_ptr)
+		rec.mat_ptr = mat_ptr;
+	return true;
+}
+
+bool instance::bounding_box(aabb& output_box) const
+{
+	output_box = box;
+	return has_box;
+}
+
+#endif
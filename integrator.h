@@ -0,0 +1,166 @@
+#pragma once
+
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "lighting.h"
+#include "material.h"
+#include "sampler.h"
+#include "stats.h"
+
+#include <algorithm>
+
+inline bool is_black(const colour& c)
+{
+	return c.x() == 0 && c.y() == 0 && c.z() == 0;
+}
+
+// weight for a sample taken with pdf a when another strategy could have made it with pdf b (Veach's power heuristic)
+inline real power_heuristic(real a, real b)
+{
+	return a * a / (a * a + b * b);
+}
+
+// Share of emission a scattered ray found that's credited to scattering rather than to light
+// sampling. scatter_pdf is zero for camera rays and specular bounces, which light sampling
+// can't have made, so they keep all of it.
+inline real emission_weight(const scene_lighting& lighting, const ray& r, real scatter_pdf)
+{
+	if (scatter_pdf <= 0 || lighting.lights.objects.empty())
+		return 1;
+	return power_heuristic(scatter_pdf, lighting.lights.pdf_value(r.origin(), r.direction()));
+}
+
+// Next-event estimation: picks a direction towards one of the lights from rec.p and sets what
+// whatever's first along it gets multiplied by, the BRDF and cosine, weighted against the same
+// direction having been scattered into, over the light pdf. False when there's nothing to trace.
+inline bool sample_light(const scene_lighting& lighting, const ray& r_in, const hit_record& rec, ray& shadow, colour& weight)
+{
+	if (lighting.lights.objects.empty())
+		return false;
+	thread_sampler.start_light_sample();
+	vec3 direction = lighting.lights.random(rec.p);
+	auto light_pdf = lighting.lights.pdf_value(rec.p, direction);
+	if (light_pdf <= 0)
+		return false;
+	colour f = rec.mat_ptr->evaluate(r_in, rec, direction);
+	if (is_black(f))
+		return false;
+	shadow = ray(rec.p, direction);
+	weight = f * (power_heuristic(light_pdf, rec.mat_ptr->scattering_pdf(r_in, rec, direction)) / light_pdf);
+	return true;
+}
+
+// What a camera ray saw first, the auxiliary buffers (AOVs) that guide the denoiser: the
+// surface's albedo, its normal facing the camera and how far along the ray it is. Specular
+// surfaces are seen through, to what's reflected or refracted in them, with their albedo
+// multiplied in and the distance adding up, so the denoiser keeps the detail in a mirror. A ray
+// that escapes has the environment's colour (up to white) as its albedo, and zero normal and
+// depth. A path that stops while still passing through specular surfaces keeps its albedo and
+// depth so far, with no normal.
+struct first_hit
+{
+	colour albedo = colour(0, 0, 0);
+	vec3 normal = vec3(0, 0, 0);
+	real depth = 0;
+
+	// albedo of the specular surfaces passed through so far, depth only builds up once there are some
+	colour through() const { return depth > 0 ? albedo : colour(1, 1, 1); }
+
+	// summing a pixel's samples
+	void add(const first_hit& h)
+	{
+		albedo += h.albedo;
+		normal += h.normal;
+		depth += h.depth;
+	}
+};
+
+// adds the surface r hit to first, true if it's specular and the AOVs carry on along the scattered ray
+inline bool record_first_hit(const ray& r, const hit_record& rec, first_hit& first)
+{
+	first.albedo = first.through() * rec.mat_ptr->surface_albedo(rec);
+	first.depth += rec.t * r.direction().length();
+	if (rec.mat_ptr->is_specular())
+		return true;
+	first.normal = rec.normal;
+	return false;
+}
+
+inline void record_first_escape(const ray& r, const scene_lighting& lighting, first_hit& first)
+{
+	colour c = lighting.environment(r);
+	const real one = 1;
+	first.albedo = first.through() * colour(std::min(c.x(), one), std::min(c.y(), one), std::min(c.z(), one));
+	first.normal = vec3(0, 0, 0);
+	first.depth = 0;
+}
+
+// light arriving along a light sample, the emission of whatever it hits first, so a light that's
+// in the way of the one aimed at still counts
+colour shadow_radiance(const ray& shadow, const hittable& world)
+{
+	RT_COUNT(shadow_rays, 1);
+	hit_record rec;
+	if (world.hit(shadow, ray_epsilon, infinity, rec))
+		return rec.mat_ptr->emitted(shadow, rec);
+	return colour(0, 0, 0);
+}
+
+// Light along r, with at most depth bounces to go. Surfaces that can evaluate their BRDF sample
+// the lights at each bounce as well as scattering, and emission either way finds is weighted
+// with multiple importance sampling, scatter_pdf being the pdf of the bounce that made r.
+// Lights aren't sampled at the last bounce, the scattered ray that would balance it never gets
+// traced, so the path lengths counted don't depend on whether there are any lights. Each surface
+// hit moves the thread's sampler on to the next bounce's dimensions. Given a zeroed first, a
+// camera ray's call also fills in its AOVs.
+colour ray_colour(const ray& r, const hittable& world, const scene_lighting& lighting, int depth, real scatter_pdf = 0,
+	first_hit* first = nullptr)
+{
+	hit_record rec;
+
+	// stop bouncing if we've exceeded the ray bounce limit
+	if (depth <= 0)
+		return colour(0, 0, 0);
+
+	if (world.hit(r, ray_epsilon, infinity, rec)) {
+		thread_sampler.next_bounce();
+		// only passed on to the next bounce while the AOVs are following specular surfaces
+		if (first && !record_first_hit(r, rec, *first))
+			first = nullptr;
+		colour emitted = rec.mat_ptr->emitted(r, rec);
+		if (!is_black(emitted))
+			emitted = emitted * emission_weight(lighting, r, scatter_pdf);
+
+		ray scattered;
+		colour attenuation;
+		if (rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
+			auto pdf = rec.mat_ptr->scattering_pdf(r, rec, scattered.direction());
+			colour direct(0, 0, 0);
+			ray shadow;
+			colour weight;
+			if (pdf > 0 && depth > 1 && sample_light(lighting, r, rec, shadow, weight))
+				direct = weight * shadow_radiance(shadow, world);
+
+			// the next call only traces it if there's a bounce left
+			if (depth > 1)
+				RT_COUNT(secondary_rays, 1);
+			else
+				RT_COUNT(depth_cutoffs, 1);
+			return emitted + direct + attenuation * ray_colour(scattered, world, lighting, depth - 1, pdf, first);
+		}
+
+		RT_COUNT(absorbed_paths, 1);
+		return emitted;
+	}
+
+	RT_COUNT(escaped_paths, 1);
+	if (first)
+		record_first_escape(r, lighting, *first);
+	return lighting.environment(r);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include "rtweekend.h"
+
+#include "hittable_list.h"
+
+// background, a vertical gradient from white to blue
+colour sky_colour(const ray& r)
+{
+	// scale direction to unit length (-1.0 < y < 1.0)
+	vec3 unit_direction = unit_vector(r.direction());
+	// t = y component of unit_dir scaled to 0.0 <= t <= 1.0
+	auto t = 0.5 * (unit_direction.y() + 1.0);
+	// linear interpolation using t
+	return (1.0 - t) * colour(1.0, 1.0, 1.0) + t * colour(0.5, 0.7, 1.0);
+}
+
+// Where a scene's light comes from besides what paths happen to hit: the background rays escape
+// to, and the lights the integrators aim rays at directly (next-event estimation). Lights are
+// the scene's emissive spheres and quads, other emissive objects still shine when they're hit.
+struct scene_lighting
+{
+	hittable_list lights;
+	bool sky = true; // the sky gradient, or background when false
+	colour background = colour(0, 0, 0);
+
+	colour environment(const ray& r) const { return sky ? sky_colour(r) : background; }
+};
+
+#endif
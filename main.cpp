@@ -1,208 +1,482 @@
 #include "rtweekend.h"
 
 #include "colour.h"
+#include "accumulation.h"
+#include "image_writer.h"
 #include "sphere.h"
+#include "sphere_soup.h"
 #include "camera.h"
 #include "material.h"
 #include "hittable_list.h"
+#include "bvh.h"
+#include "tiles.h"
+#include "render.h"
+#include "scene_file.h"
+#include "scenes.h"
+#include "settings.h"
+#include "stats.h"
+#include "trace.h"
+#include "options.h"
+#include "affinity.h"
+#include "transform.h"
+#include "preview.h"
+#include "denoise.h"
+#include "distributed.h"
 
-#include <mutex>
+#include <algorithm>
+#include <atomic>
 #include <thread>
 #include <vector>
 #include <chrono>
-#include <sstream>
-#include <fstream>
+#include <cstdio>
 #include <iostream>
+#include <string>
 
-// options
-const auto aspect_ratio = 16.0 / 9.0;
-const long long image_width = 1280;
-const long long image_height = static_cast<int>(image_width/aspect_ratio);
-const long long upscale_factor = 1;
-const long long samples_per_pixel = 32;
-const int max_depth = 8;
+// builds with RT_STATS also write a trace of which thread rendered each tile when, for chrome://tracing or
+// Perfetto, and a heatmap of the time each pixel took
+const char* trace_path = "trace.json";
+const char* cost_path = "cost.ppm";
 
-// internal image buffer
-std::vector<int> image_buffer(image_width * image_height * 3);
-// mutex lock for image buffer
-std::mutex buffer_mutex;
+// path with suffix before its extension, out.ppm and _albedo make out_albedo.ppm
+std::string suffixed_path(const std::string& path, const std::string& suffix)
+{
+	auto dot = path.rfind('.');
+	auto slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return path + suffix;
+	return path.substr(0, dot) + suffix + path.substr(dot);
+}
 
-// for output
-auto lines_remaining = image_height;
+// where frame k of a batch goes, out.ppm becomes out_0003.ppm, a single frame keeps the path as it is
+std::string frame_path(const std::string& path, size_t frame, size_t n_frames)
+{
+	if (n_frames <= 1)
+		return path;
+	char number[16];
+	std::snprintf(number, sizeof(number), "_%04zu", frame);
+	return suffixed_path(path, number);
+}
 
-colour ray_colour(const ray& r, const hittable& world, int depth)
+int main(int argc, char** argv)
 {
-	hit_record rec;
+	// see options.h for everything that can be set, and their defaults
+	render_options options;
+	if (!parse_command_line(argc, argv, options))
+		return options.help ? 0 : 1;
+	// a worker takes the coordinator's options, then its own again on top
+	render_worker worker;
+	const bool working = !options.worker_address.empty();
+	if (working) {
+		std::vector<std::string> coordinator_args;
+		if (!worker.connect(options.worker_address, coordinator_args))
+			return 1;
+		options = render_options();
+		for (const std::string& arg : coordinator_args) {
+			if (!set_argument(options, arg))
+				return 1;
+		}
+		if (!parse_command_line(argc, argv, options))
+			return 1;
+		options.coordinator_address.clear();
+		options.interactive = false;
+	}
+	const bool coordinating = !options.coordinator_address.empty();
+	if (coordinating && options.interactive) {
+		std::cerr << "Interactive mode renders in its own process, it can't coordinate workers" << std::endl;
+		return 1;
+	}
+	const long long image_width = options.image_width;
+	const long long image_height = options.height();
+	const int samples_per_pixel = options.samples_per_pixel;
+	const bool progressive = options.passes > 1 || options.resume;
 
-	// stop bouncing if we've exceeded the ray bounce limit
-	if (depth <= 0)
-		return colour(0, 0, 0);
+	// world, built once, or once per NUMA node with --replicate so every node's threads read a copy in their own memory
+	numa_topology topology = read_numa_topology();
+	const bool pin_threads = options.pin_threads || options.replicate_scene;
+	const size_t n_replicas = options.replicate_scene ? topology.nodes.size() : 1;
+	std::vector<scene> scenes(n_replicas);
+	std::vector<bvh_node> bvhs(n_replicas);
+	std::chrono::duration<double> time_scene_load(0);
+	std::chrono::duration<double> time_bvh_build(0);
+	auto build_world = [&](size_t k) {
+		auto tp_load1 = std::chrono::high_resolution_clock::now();
+		scene& world_scene = scenes[k];
+		if (options.scene_path.empty()) {
+			seed_rng(options.seed);
+			world_scene = random_scene();
+		} else {
+			bool from_cache = false;
+			if (!load_scene(options.scene_path, world_scene, from_cache))
+				return false;
+			if (k == 0)
+				std::cerr << "Loaded " << options.scene_path << (from_cache ? " from its cache" : "") << std::endl;
+		}
+		// without light sampling emitters only count when paths hit them, plain path tracing
+		if (!options.sample_lights)
+			world_scene.lighting.lights.clear();
+		auto tp_load2 = std::chrono::high_resolution_clock::now();
+		time_scene_load += tp_load2 - tp_load1;
 
-	if (world.hit(r, 0.001, infinity, rec)) {
-		ray scattered;
-		colour attenuation;
-		if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-			return attenuation * ray_colour(scattered, world, depth - 1);
+		// acceleration structure, spheres are packed into SIMD-friendly soups that become the BVH's leaves
+		auto tp_bvh1 = std::chrono::high_resolution_clock::now();
+		bvhs[k] = bvh_node(pack_sphere_soups(world_scene, world_scene.world));
+		auto tp_bvh2 = std::chrono::high_resolution_clock::now();
+		time_bvh_build += tp_bvh2 - tp_bvh1;
+		return true;
+	};
+	if (n_replicas == 1) {
+		if (!build_world(0))
+			return 1;
+	} else {
+		// one at a time, so only the first load writes a scene file's cache
+		for (size_t k = 0; k < n_replicas; ++k) {
+			bool built = false;
+			std::thread builder([&, k] {
+				pin_this_thread(topology.nodes[k]);
+				built = build_world(k);
+			});
+			builder.join();
+			if (!built)
+				return 1;
+		}
+	}
+	const scene& world_scene = scenes[0];
+	std::cerr << "Built BVH over " << world_scene.world.objects.size() << " objects (" << bvhs[0].objects.size() << " after packing) in "
+		<< bvhs[0].tree.nodes.size() << " nodes" << (n_replicas > 1 ? ", one copy on each of " + std::to_string(n_replicas) + " NUMA nodes" : "")
+		<< std::endl;
 
-		return colour(0, 0, 0);
+	// cameras, every frame renders the same scene and BVH
+	std::vector<camera_settings> frames = options.frames;
+	for (int k = 0; k < options.orbit_frames; ++k) {
+		const camera_settings& base = world_scene.view;
+		auto spin = affine_transform::rotate(base.vup, static_cast<real>(360.0 * k / options.orbit_frames));
+		camera_settings view = base;
+		view.lookfrom = base.lookat + spin.apply_vector(base.lookfrom - base.lookat);
+		frames.push_back(view);
+	}
+	if (frames.empty())
+		frames.push_back(world_scene.view);
+	if (options.interactive && frames.size() > 1) {
+		std::cerr << "Interactive mode starts from the first of " << frames.size() << " frames" << std::endl;
+		frames.resize(1);
 	}
 
-	// sky
-	// scale direction to unit length (-1.0 < y < 1.0)
-	vec3 unit_direction = unit_vector(r.direction()); 
-	// t = y component of unit_dir scaled to 0.0 <= t <= 1.0
-	auto t = 0.5 * (unit_direction.y() + 1.0); 
-	// linear interpolation using t
-	return (1.0 - t) * colour(1.0, 1.0, 1.0) + t * colour(0.5, 0.7, 1.0); 
-}
+	render_settings settings;
+	settings.image_width = image_width;
+	settings.image_height = image_height;
+	settings.samples_per_pixel = samples_per_pixel;
+	settings.max_depth = options.max_depth;
+	settings.seed = options.seed;
+	settings.integrator = options.integrator;
+	settings.sampler = options.sampler;
+	settings.adaptive = options.adaptive;
+	settings.min_samples = options.min_samples;
+	settings.adaptive_error = options.adaptive_error;
+	if (options.adaptive && options.integrator != integrator_type::recursive)
+		std::cerr << "Adaptive sampling needs the recursive integrator, taking " << samples_per_pixel << " samples everywhere" << std::endl;
 
-hittable_list random_scene()
-{
-	hittable_list world;
-
-    auto ground_material = make_shared<lambertian>(colour(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, ground_material));
-
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
-
-            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphere_material;
-
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = colour::random() * colour::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                } else if (choose_mat < 0.95) {
-                    // metal
-                    auto albedo = colour::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                } else {
-                    // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-            }
-        }
-    }
-
-	auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
-
-    auto material2 = make_shared<lambertian>(colour(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
-
-    auto material3 = make_shared<metal>(colour(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
-
-    return world;
-}
+	// thread setup
+	unsigned int n_threads = options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	std::cerr << "Using " << n_threads << " threads, " << (options.integrator == integrator_type::wavefront ? "wavefront" : "recursive")
+		<< " integrator" << std::endl;
+	// each thread's CPU and NUMA node, only used when pinning
+	std::vector<thread_slot> slots = place_threads(topology, n_threads, options.placement);
+	if (pin_threads)
+		std::cerr << "Pinning threads across " << topology.nodes.size() << " NUMA nodes (" << topology.cpu_count() << " CPUs)" << std::endl;
+	std::atomic<unsigned int> unpinned_threads(0);
 
-// render lines from start to end, runs per-thread
-void render_lines(int start, int end, camera& cam, hittable_list& world)
-{
-	// allocate space for pixels this thread will render
-	long long n_rows = (long long)end - (long long)start;
-	std::vector<int> local_buf;
-	local_buf.reserve(n_rows * image_width * 3);
-
-	for (int j = start; j < end; ++j) {
-		for (int i = 0; i < image_width; ++i) {
-			colour pix(0, 0, 0);
-			for (int s = 0; s < samples_per_pixel; ++s) {
-				// normalise i and j & sample random point within this pixel
-				auto u = (i + random_double()) / (image_width - 1);
-				auto v = (j + random_double()) / (image_height - 1);
-				// make ray for this pixel
-				ray r = cam.get_ray(u, v);
-				// render ray
-				pix += ray_colour(r, world, max_depth);
+	// split the image into tiles
+	tile_scheduler scheduler(make_tiles(static_cast<int>(image_width), static_cast<int>(image_height), options.tile_size, options.tile_ordering));
+	std::vector<worker_stats> stats(n_threads);
+	// each thread's scratch memory, kept across passes and frames
+	std::vector<wavefront_state> scratch(n_threads);
+
+	// running sums of every sample of the current frame so far, tiles never overlap so threads add to it directly
+	accumulation_buffer accum;
+	// linear RGB image resolved from accum for the writers, and its AOVs
+	std::vector<float> image_buffer;
+	std::vector<float> albedo_buffer, normal_buffer, depth_buffer, variance_buffer;
+	std::string output_path, heatmap_path, checkpoint_path;
+	const bool want_aovs = options.write_aovs || options.denoise;
+	denoise_settings denoising;
+	denoising.threads = n_threads;
+
+	// the AOVs as images beside the output: as they are in PFMs, in 8-bit formats normals are
+	// mapped from [-1, 1] and depth is grey out to the farthest hit
+	auto write_aovs = [&]() {
+		std::vector<float> shown(normal_buffer.size());
+		bool raw = options.format() == image_format::pfm;
+		for (size_t i = 0; i < shown.size(); ++i)
+			shown[i] = raw ? normal_buffer[i] : 0.5f + 0.5f * normal_buffer[i];
+		if (!write_image(suffixed_path(output_path, "_albedo"), albedo_buffer, image_width, image_height, options.upscale_factor, options.format())
+			|| !write_image(suffixed_path(output_path, "_normal"), shown, image_width, image_height, options.upscale_factor, options.format()))
+			return false;
+		float farthest = *std::max_element(depth_buffer.begin(), depth_buffer.end());
+		for (size_t i = 0; i < depth_buffer.size(); ++i)
+			shown[i * 3] = shown[i * 3 + 1] = shown[i * 3 + 2] = raw || farthest <= 0 ? depth_buffer[i] : depth_buffer[i] / farthest;
+		return write_image(suffixed_path(output_path, "_depth"), shown, image_width, image_height, options.upscale_factor, options.format());
+	};
+
+	// resolves the samples so far, denoises them if asked and writes the image, plus the AOVs,
+	// heatmap and checkpoint when they're wanted
+	std::chrono::duration<double> time_file_write(0);
+	std::chrono::duration<double> time_denoise(0);
+	auto write_outputs = [&]() {
+		auto tp1 = std::chrono::high_resolution_clock::now();
+		accum.resolve(image_buffer);
+		if (accum.has_aovs()) {
+			accum.resolve_aovs(albedo_buffer, normal_buffer, depth_buffer, variance_buffer);
+			if (options.write_aovs && !write_aovs()) {
+				std::cerr << "Failed to write the AOVs beside " << output_path << std::endl;
+				return false;
 			}
-			write_colour(local_buf, pix, samples_per_pixel);
+			if (options.denoise) {
+				auto tp_denoise1 = std::chrono::high_resolution_clock::now();
+				denoise(image_buffer, albedo_buffer, normal_buffer, depth_buffer, variance_buffer, image_width, image_height, denoising);
+				auto denoise_time = std::chrono::high_resolution_clock::now() - tp_denoise1;
+				time_denoise += denoise_time;
+				// the file write time doesn't count it
+				tp1 += denoise_time;
+			}
+		}
+		if (!write_image(output_path, image_buffer, image_width, image_height, options.upscale_factor, options.format())) {
+			std::cerr << "Failed to write " << output_path << std::endl;
+			return false;
+		}
+		if (options.adaptive && !write_image(heatmap_path, heatmap(accum.samples, samples_per_pixel * static_cast<int>(accum.passes)),
+			image_width, image_height, options.upscale_factor, options.format())) {
+			std::cerr << "Failed to write " << heatmap_path << std::endl;
+			return false;
 		}
+		if (progressive && !accum.save(checkpoint_path)) {
+			std::cerr << "Failed to save " << checkpoint_path << std::endl;
+			return false;
+		}
+		time_file_write += std::chrono::high_resolution_clock::now() - tp1;
+		return true;
+	};
+
+	std::chrono::duration<double> time_render(0);
+	uint64_t render_allocations = 0;
+	double total_samples = 0;
+
+	// a worker renders the batches of tiles it's sent with its threads kept up between them, the
+	// coordinator writes the images
+	if (working) {
+		std::vector<camera> cameras;
+		for (const camera_settings& view : frames)
+			cameras.push_back(camera(view.lookfrom, view.lookat, view.vup, view.vfov, options.aspect(), view.aperture, view.focus_distance));
+		render_pool pool(n_threads, [&](unsigned int i) {
+			if (pin_threads && !pin_this_thread({ slots[i].cpu }))
+				unpinned_threads++;
+		});
+		uint64_t allocations_before = heap_allocations.load();
+		bool served = worker.serve(n_threads, settings,
+			[&](uint64_t frame, const render_settings& batch_settings, tile_scheduler& batch, accumulation_buffer& tiles) {
+				if (frame >= cameras.size())
+					return false;
+				auto tp1 = std::chrono::high_resolution_clock::now();
+				pool.run([&](unsigned int i) {
+					size_t replica = n_replicas > 1 ? slots[i].node : 0;
+					render_tiles(batch, batch_settings, cameras[frame], bvhs[replica], scenes[replica].lighting, tiles, scratch[i], stats[i]);
+				});
+				time_render += std::chrono::high_resolution_clock::now() - tp1;
+				return true;
+			});
+		render_allocations += heap_allocations.load() - allocations_before;
+		std::cerr << "Rendered " << worker.tiles << " tiles in " << worker.batches << " batches" << std::endl;
+		if (!served)
+			return 1;
 	}
-	// write to image buffer, wait if another thread is writing
-	buffer_mutex.lock();
-	int i = 0;
-	for (auto val : local_buf) {
-		image_buffer[(long long)start*3ll*image_width + i] = val;
-		i++;
+
+	render_coordinator coordinator;
+	if (coordinating && !coordinator.start(options.coordinator_address, std::vector<std::string>(argv + 1, argv + argc)))
+		return 1;
+
+	// the same threads and scene, kept up between passes while a viewer moves the camera, then the
+	// last view's samples are written out like any other frame
+	if (options.interactive) {
+		output_path = options.output_path;
+		heatmap_path = options.heatmap_path;
+		checkpoint_path = options.checkpoint_path;
+		accum = accumulation_buffer(image_width, image_height, options.seed, true);
+		if (want_aovs)
+			accum.enable_aovs();
+		uint64_t allocations_before = heap_allocations.load();
+		preview_session session(options, settings, frames[0], scheduler, accum, n_threads,
+			[&](unsigned int i) {
+				if (pin_threads && !pin_this_thread({ slots[i].cpu }))
+					unpinned_threads++;
+			},
+			[&](unsigned int i, const render_settings& pass_settings, const camera& cam) {
+				size_t replica = n_replicas > 1 ? slots[i].node : 0;
+				render_tiles(scheduler, pass_settings, cam, bvhs[replica], scenes[replica].lighting, accum, scratch[i], stats[i]);
+			});
+		if (!session.run())
+			return 1;
+		time_render += std::chrono::duration<double>(session.render_seconds);
+		render_allocations += heap_allocations.load() - allocations_before;
+		total_samples += static_cast<double>(accum.total_samples());
+		std::cerr << session.restarts << " views, first frames in " << session.mean_first_frame_ms << " ms on average" << std::endl;
+		std::cerr << "Writing to file...";
+		if (!write_outputs())
+			return 1;
+		std::cerr << "\nDone!" << "\n\n" << std::endl;
 	}
-	lines_remaining -= n_rows;
-	std::cerr << "Lines remaining: " << lines_remaining << std::endl;
-	buffer_mutex.unlock();
-}
 
-int main()
-{
-	// world
-	hittable_list world = random_scene();
+	for (size_t frame = 0; frame < frames.size() && !options.interactive && !working; ++frame) {
+		output_path = frame_path(options.output_path, frame, frames.size());
+		heatmap_path = frame_path(options.heatmap_path, frame, frames.size());
+		checkpoint_path = frame_path(options.checkpoint_path, frame, frames.size());
+		if (frames.size() > 1)
+			std::cerr << "Frame " << frame + 1 << " of " << frames.size() << ", writing to " << output_path << std::endl;
 
-	// camera
-	point3 lookfrom(13, 2, 3);
-	point3 lookat(0, 0, 0);
-	vec3 vup(0, 1, 0);
-	auto dist_to_focus = 10.0;
-	auto aperture = 0.2;
-	camera cam(lookfrom, lookat, vup, 20, aspect_ratio, aperture, dist_to_focus);
+		// camera
+		const camera_settings& view = frames[frame];
+		camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, options.aspect(), view.aperture, view.focus_distance);
 
-	// thread setup
-	unsigned int n_threads = std::thread::hardware_concurrency();
-	std::cerr << "Using " << n_threads << " threads" << std::endl;
-	std::vector<std::thread> threads;
-
-	// launch threads!
-	std::cerr << "Start render!\n" << std::endl;
-	std::cerr << "Lines remaining: " << lines_remaining << std::endl;
-	auto tp1 = std::chrono::high_resolution_clock::now();
-	for (unsigned int i = 0; i < n_threads; ++i) {
-		threads.push_back(std::thread(render_lines, i * image_height / n_threads, (i + 1ll) * image_height / n_threads, std::ref(cam), std::ref(world)));
-	}
-	for (std::thread& th : threads) {
-		th.join();
-	}
-	auto tp2 = std::chrono::high_resolution_clock::now();
-	std::chrono::duration<double> time_render = tp2 - tp1;
-	std::cerr << "Render finished" << std::endl;
-
-	// build output string, this is where image scaling is applied if needed
-	std::cerr << "Writing to file...";
-	std::ostringstream pixel_string;
-	auto tp3 = std::chrono::high_resolution_clock::now();
-	for (long long j = image_height - 1; j >= 0; --j) {
-		std::ostringstream line;
-		for (long long i = 0; i < image_width; ++i) {
-			for (int u = 0; u < upscale_factor; u++) {
-				line << image_buffer[image_width * j * 3 + i * 3] << ' ';
-				line << image_buffer[image_width * j * 3 + i * 3 + 1] << ' ';
-				line << image_buffer[image_width * j * 3 + i * 3 + 2] << '\n';
+		// pixels are cleared by the threads that render them, see accumulation_buffer::untouched
+		accum = accumulation_buffer(image_width, image_height, options.seed, true);
+		if (want_aovs)
+			accum.enable_aovs();
+		if (options.resume) {
+			accumulation_buffer saved;
+			if (!saved.load(checkpoint_path)) {
+				std::cerr << "No checkpoint at " << checkpoint_path << ", starting from scratch" << std::endl;
+			} else if (saved.width != image_width || saved.height != image_height || saved.seed != options.seed) {
+				std::cerr << checkpoint_path << " is for a different render (" << saved.width << 'x' << saved.height
+					<< ", seed " << saved.seed << ")" << std::endl;
+				return 1;
+			} else if (want_aovs && !saved.has_aovs()) {
+				std::cerr << checkpoint_path << " was saved without AOVs, starting from scratch" << std::endl;
+			} else {
+				accum = std::move(saved);
+				std::cerr << "Resuming from " << checkpoint_path << " after " << accum.passes << " passes" << std::endl;
 			}
 		}
-		for(int u = 0; u < upscale_factor; u++)
-			pixel_string << line.str();
+
+		// launch threads!
+		std::cerr << "Start render!\n" << std::endl;
+		for (int pass = 0; pass < options.passes; ++pass) {
+			settings.pass = accum.passes;
+			if (progressive)
+				std::cerr << "Pass " << accum.passes + 1 << std::endl;
+			std::cerr << "Tiles remaining: " << scheduler.remaining() << std::endl;
+
+			std::vector<std::thread> threads;
+			auto tp1 = std::chrono::high_resolution_clock::now();
+			uint64_t allocations_before = heap_allocations.load();
+			if (coordinating) {
+				// the workers render, this thread merges
+				threads.push_back(std::thread([&] { coordinator.render_pass(frame, settings, scheduler, accum); }));
+			} else {
+				for (unsigned int i = 0; i < n_threads; ++i) {
+					threads.push_back(std::thread([&, i] {
+						if (pin_threads && !pin_this_thread({ slots[i].cpu }))
+							unpinned_threads++;
+						size_t replica = n_replicas > 1 ? slots[i].node : 0;
+						render_tiles(scheduler, settings, cam, bvhs[replica], scenes[replica].lighting, accum, scratch[i], stats[i]);
+					}));
+				}
+			}
+			// report progress while the threads work, polling is cheap and keeps printing off the render threads
+			long long last_reported = scheduler.remaining();
+			auto tp_report = tp1;
+			while (last_reported > 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				long long remaining = scheduler.remaining();
+				auto now = std::chrono::high_resolution_clock::now();
+				if (remaining != last_reported && (remaining == 0 || now - tp_report > std::chrono::milliseconds(500))) {
+					std::cerr << "Tiles remaining: " << remaining << std::endl;
+					last_reported = remaining;
+					tp_report = now;
+				}
+			}
+			for (std::thread& th : threads) {
+				th.join();
+			}
+			auto tp2 = std::chrono::high_resolution_clock::now();
+			time_render += tp2 - tp1;
+			render_allocations += heap_allocations.load() - allocations_before;
+			accum.passes++;
+			accum.untouched = false;
+			scheduler.reset();
+
+			// previews along the way, the last pass is written below
+			bool last_pass = pass == options.passes - 1;
+			if (!last_pass && accum.passes % options.preview_interval == 0) {
+				std::cerr << "Writing preview after " << accum.passes << " passes (" << std::chrono::duration<double>(tp2 - tp1).count() << "s a pass)" << std::endl;
+				if (!write_outputs())
+					return 1;
+			}
+		}
+		std::cerr << "Render finished" << std::endl;
+		total_samples += static_cast<double>(accum.total_samples());
+
+		// write the file, this is where image scaling is applied if needed
+		std::cerr << "Writing to file...";
+		if (!write_outputs())
+			return 1;
+		if (stats_enabled) {
+			std::string frame_cost_path = frame_path(cost_path, frame, frames.size());
+			if (!write_image(frame_cost_path, cost_heatmap(accum.cost), image_width, image_height, options.upscale_factor, options.format()))
+				std::cerr << "\nFailed to write " << frame_cost_path;
+		}
+		std::cerr << "\nDone!" << "\n\n" << std::endl;
+	}
+
+	if (unpinned_threads > 0)
+		std::cerr << "Couldn't pin render threads " << unpinned_threads << " times" << std::endl;
+
+	// per-thread utilisation, idle time is measured against the whole render, or per worker when they did the rendering
+	if (coordinating) {
+		coordinator.stop();
+		for (const remote_worker_stats& w : coordinator.worker_stats()) {
+			std::cerr << "Worker " << w.peer << ": " << w.threads << " threads, " << w.tiles << " tiles, busy " << w.busy_seconds << 's';
+			if (w.dropped)
+				std::cerr << ", dropped, " << w.lost_tiles << " tiles handed on";
+			std::cerr << std::endl;
+		}
+	} else {
+		for (unsigned int i = 0; i < n_threads; ++i) {
+			auto idle = time_render.count() - stats[i].busy_seconds;
+			std::cerr << "Thread " << i << ": " << stats[i].tiles << " tiles, busy " << stats[i].busy_seconds
+				<< "s, idle " << idle << "s (" << 100.0 * stats[i].busy_seconds / time_render.count() << "% busy), out of work after "
+				<< stats[i].wall_seconds << 's' << std::endl;
+		}
 	}
-	auto tp4 = std::chrono::high_resolution_clock::now();
-	std::chrono::duration<double> time_string_convert = tp4 - tp3;
-
-	// write the file
-	auto tp5 = std::chrono::high_resolution_clock::now();
-	std::ofstream file_out;
-	file_out.open("out.ppm");
-	file_out << "P3\n" << image_width*upscale_factor << ' ' << image_height*upscale_factor << "\n255" << std::endl;
-	file_out << pixel_string.str();
-	std::cerr << "\nDone!" << "\n\n" << std::endl;
-	file_out.close();
-	auto tp6 = std::chrono::high_resolution_clock::now();
-	std::chrono::duration<double> time_file_write = tp6 - tp5;
+
+	uint64_t sampling_allocations = 0;
+	for (const auto& s : stats)
+		sampling_allocations += s.heap_allocations;
+	std::cerr << "Heap allocations: " << render_allocations << " during the render, " << sampling_allocations
+		<< " of them while rendering tiles" << std::endl;
+	if (stats_enabled) {
+		render_counters counters;
+		for (const auto& s : stats)
+			counters += s.counters;
+		double rays = static_cast<double>(counters.rays());
+		std::cerr << "Rays: " << counters.primary_rays << " primary, " << counters.secondary_rays << " secondary, "
+			<< counters.shadow_rays << " shadow, "
+			<< rays / time_render.count() << " rays/s, " << counters.node_tests / rays << " node tests and "
+			<< counters.primitive_tests / rays << " primitive tests per ray" << std::endl;
+		std::cerr << "Primitive tests: " << counters.primitive_tests << ", "
+			<< 100.0 * (counters.primitive_tests - counters.primitive_hits) / counters.primitive_tests << "% missed" << std::endl;
+		std::cerr << "Paths: " << counters.escaped_paths << " escaped, " << counters.absorbed_paths << " absorbed, "
+			<< counters.depth_cutoffs << " cut off at max depth" << std::endl;
+		if (!write_chrome_trace(trace_path, stats))
+			std::cerr << "Failed to write " << trace_path << std::endl;
+	}
+	if (!working)
+		std::cerr << "Average samples per pixel: " << total_samples / (static_cast<double>(image_width) * image_height * frames.size()) << std::endl;
 
 	// output metrics
+	std::cerr << "Scene load time: " << time_scene_load.count() << 's' << std::endl;
+	std::cerr << "BVH build time: " << time_bvh_build.count() << 's' << std::endl;
 	std::cerr << "Render time: " << time_render.count() << 's' << std::endl;
-	std::cerr << "String conversion time: " << time_string_convert.count() << 's' << std::endl;
-	std::cerr << "File write time: " << time_file_write.count() << 's' << std::endl;
+	if (!working)
+		std::cerr << "File write time: " << time_file_write.count() << 's' << std::endl;
+	if (options.denoise && !working)
+		std::cerr << "Denoise time: " << time_denoise.count() << 's' << std::endl;
 	return 0;
-}
\ No newline at end of file
+}
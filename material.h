@@ -5,75 +5,118 @@
 
 #include "rtweekend.h"
 #include "hittable.h"
+#include "sampler.h"
+#include "sampling.h"
+
+// lets integrators group hits by material and shade each group without virtual calls
+enum class material_kind
+{
+	lambertian,
+	metal,
+	dielectric,
+	emissive,
+	other
+};
 
 class material
 {
 public:
+	material_kind kind;
+
+public:
+	material(material_kind k = material_kind::other) : kind(k) {}
+	virtual ~material() = default;
+
 	virtual bool scatter(const ray& r_in, const hit_record& rec, colour& attentuation, ray& scattered) const = 0;
+
+	// light given off where r_in hit, none for anything but lights
+	virtual colour emitted(const ray& r_in, const hit_record& rec) const { return colour(0, 0, 0); }
+
+	// For sampling lights from the surface: the BRDF times the cosine towards direction, and the
+	// solid angle pdf of scatter() picking that direction. Specular materials keep both at zero,
+	// the integrators then only find light by scattering into it.
+	virtual colour evaluate(const ray& r_in, const hit_record& rec, const vec3& direction) const { return colour(0, 0, 0); }
+	virtual real scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const { return 0; }
+
+	// colour of the surface for the denoiser's albedo buffer, white for clear materials like glass
+	virtual colour surface_albedo(const hit_record& rec) const { return colour(1, 1, 1); }
+	// sharp enough that what's seen in it matters more than the surface, the denoiser's AOVs
+	// follow the reflection or refraction
+	virtual bool is_specular() const { return false; }
 };
 
 
-class lambertian : public material
+class lambertian final : public material
 {
 public:
 	colour albedo;
 public:
-	lambertian(const colour& a) : albedo(a) {}
+	lambertian(const colour& a) : material(material_kind::lambertian), albedo(a) {}
 
 	virtual bool scatter(const ray& r_in, const hit_record& rec, colour& attenuation, ray& scattered) const override
 	{
-		// scatter rays in random directions
-		//auto scatter_direction = rec.normal + random_unit_vector(); // cos3 distribution
-		//auto scatter_direction = rec.normal + random_in_unit_sphere(); // approximate lambertian diffuse
-		auto scatter_direction = random_in_hemisphere(rec.normal); // true lambertian diffuse
-
-		// catch degenerated scatter direction
-		if (scatter_direction.near_zero())
-			scatter_direction = rec.normal;
-
-		scattered = ray(rec.p, scatter_direction);
+		// cosine-weighted, the pdf cancels the BRDF's cosine so the weight is just the albedo
+		sample2 s = sample_2d();
+		scattered = ray(rec.p, local_to_world(sample_cosine_hemisphere(s.u, s.v), rec.normal));
 		attenuation = albedo;
 		return true;
 	}
+
+	virtual colour evaluate(const ray& r_in, const hit_record& rec, const vec3& direction) const override
+	{
+		// albedo / pi times the cosine, which is exactly the pdf
+		return albedo * lambertian::scattering_pdf(r_in, rec, direction);
+	}
+
+	virtual real scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override
+	{
+		return cosine_hemisphere_pdf(dot(rec.normal, unit_vector(direction)));
+	}
+
+	virtual colour surface_albedo(const hit_record& rec) const override { return albedo; }
 };
 
-class metal : public material
+class metal final : public material
 {
 public:
 	colour albedo;
-	double fuzz;
+	real fuzz;
 public:
-	metal(const colour& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+	metal(const colour& a, real f) : material(material_kind::metal), albedo(a), fuzz(f < 1 ? f : 1) {}
 
 	virtual bool scatter(const ray& r_in, const hit_record& rec, colour& attenuation, ray& scattered) const override
 	{
 		vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-		scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere());
+		sample2 s = sample_2d();
+		scattered = ray(rec.p, reflected + fuzz * sample_uniform_ball(s.u, s.v, sample_1d()));
 		attenuation = albedo;
 		return (dot(scattered.direction(), rec.normal) > 0);
 	}
+
+	virtual colour surface_albedo(const hit_record& rec) const override { return albedo; }
+	virtual bool is_specular() const override { return fuzz < 0.1; }
 };
 
-class dielectric : public material
+class dielectric final : public material
 {
 public:
-	double ri; // refractive index
+	real ri; // refractive index
 public:
-	dielectric(double refractive_index) : ri(refractive_index) {}
+	dielectric(real refractive_index) : material(material_kind::dielectric), ri(refractive_index) {}
 
 	virtual bool scatter(const ray& r_in, const hit_record& rec, colour& attenuation, ray& scattered) const override
 	{
 		attenuation = colour(1.0, 1.0, 1.0);
-		double refraction_ratio = rec.front_face ? (1.0 / ri) : (ri / 1.0);
+		real refraction_ratio = rec.front_face ? (1.0 / ri) : (ri / 1.0);
 
 		vec3 unit_direction = unit_vector(r_in.direction());
-		double cos_theta = fmin(dot(-unit_direction, rec.normal), 1.0);
-		double sin_theta = sqrt(1 - cos_theta * cos_theta);
+		real cos_theta = fmin(dot(-unit_direction, rec.normal), 1.0);
+		real sin_theta = sqrt(1 - cos_theta * cos_theta);
 
 		bool cannot_refract = (refraction_ratio * sin_theta > 1.0);
 		vec3 scattered_direction;
 
-		if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+		if (cannot_refract || reflectance(cos_theta, refraction_ratio) > sample_1d())
 			scattered_direction = reflect(unit_direction, rec.normal); // must reflect instead
 		else
 			scattered_direction = refract(unit_direction, rec.normal, refraction_ratio);
@@ -82,7 +125,7 @@ public:
 		return true;
 	}
 private:
-	static double reflectance(double cosine, double ref_idx)
+	static real reflectance(real cosine, real ref_idx)
 	{
 		// Schlick's approximation for reflectance
 		auto r0 = (1 - ref_idx) / (1 + ref_idx);
@@ -91,5 +134,31 @@ private:
 	}
 };
 
+// area light, a surface that gives off light from its front face and reflects nothing
+class diffuse_light final : public material
+{
+public:
+	colour emit;
+public:
+	diffuse_light(const colour& c) : material(material_kind::emissive), emit(c) {}
+
+	virtual bool scatter(const ray& r_in, const hit_record& rec, colour& attenuation, ray& scattered) const override
+	{
+		return false;
+	}
+
+	virtual colour emitted(const ray& r_in, const hit_record& rec) const override
+	{
+		return rec.front_face ? emit : colour(0, 0, 0);
+	}
+
+	// the light's colour, brightness aside
+	virtual colour surface_albedo(const hit_record& rec) const override
+	{
+		real brightest = std::max(emit.x(), std::max(emit.y(), emit.z()));
+		return brightest > 0 ? emit / brightest : colour(0, 0, 0);
+	}
+};
+
 #endif
 
@@ -0,0 +1,228 @@
+#pragma once
+
+#ifndef NET_H
+#define NET_H
+
+#include <cstdlib>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// The little of TCP the interactive viewer and distributed rendering need, over BSD sockets or
+// Winsock. Everything blocks; callers give each connection its own thread.
+
+#ifdef _WIN32
+using socket_handle = SOCKET;
+const socket_handle no_socket = INVALID_SOCKET;
+inline void close_socket(socket_handle s) { closesocket(s); }
+const int send_flags = 0;
+#else
+using socket_handle = int;
+const socket_handle no_socket = -1;
+inline void close_socket(socket_handle s) { close(s); }
+// a peer that goes away mid-message is an error from send, not a SIGPIPE
+#ifdef MSG_NOSIGNAL
+const int send_flags = MSG_NOSIGNAL;
+#else
+const int send_flags = 0;
+#endif
+#endif
+
+// Winsock has to be started before any socket is made, and stopped as many times as it's
+// started. Nothing to do elsewhere.
+inline bool net_startup()
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+	return true;
+#endif
+}
+
+inline void net_cleanup()
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+// wakes any thread blocked in recv on s, which then fails, but leaves s open for its owner to close
+inline void interrupt_socket(socket_handle s)
+{
+#ifdef _WIN32
+	shutdown(s, SD_BOTH);
+#else
+	shutdown(s, SHUT_RDWR);
+#endif
+}
+
+// Wakes any thread blocked on s (in accept or recv) and closes it. Shutting down first is what
+// wakes them on Linux, where closing alone doesn't.
+inline void shutdown_socket(socket_handle s)
+{
+	interrupt_socket(s);
+	close_socket(s);
+}
+
+// sends small messages straight away rather than waiting to fill a packet, every message here is
+// written whole so there's nothing to gain from holding the end of one back
+inline void set_no_delay(socket_handle s)
+{
+	int no_delay = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&no_delay), sizeof(no_delay));
+}
+
+// Has the OS probe an idle connection, so one whose peer lost power or dropped off the network
+// fails within a minute or two instead of never. The probe timings are Linux's and most BSDs', the
+// system defaults elsewhere.
+inline void set_keepalive(socket_handle s)
+{
+	int on = 1;
+	setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<const char*>(&on), sizeof(on));
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+	int idle = 30, interval = 10, count = 6;
+	setsockopt(s, IPPROTO_TCP, TCP_KEEPIDLE, reinterpret_cast<const char*>(&idle), sizeof(idle));
+	setsockopt(s, IPPROTO_TCP, TCP_KEEPINTVL, reinterpret_cast<const char*>(&interval), sizeof(interval));
+	setsockopt(s, IPPROTO_TCP, TCP_KEEPCNT, reinterpret_cast<const char*>(&count), sizeof(count));
+#endif
+}
+
+// Makes recv and send on s fail once they've waited milliseconds without moving any data, so a
+// peer that's gone quiet can't hold a thread forever. 0 waits for ever again.
+inline void set_timeout(socket_handle s, int milliseconds)
+{
+#ifdef _WIN32
+	DWORD timeout = static_cast<DWORD>(milliseconds);
+#else
+	timeval timeout;
+	timeout.tv_sec = milliseconds / 1000;
+	timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+}
+
+// 1 once s has something to recv (or has failed, which recv will then say), 0 if milliseconds
+// pass first, -1 if s can't be waited on
+inline int wait_readable(socket_handle s, int milliseconds)
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(s, &readable);
+	timeval timeout;
+	timeout.tv_sec = milliseconds / 1000;
+	timeout.tv_usec = (milliseconds % 1000) * 1000;
+	int n = select(static_cast<int>(s) + 1, &readable, nullptr, nullptr, &timeout);
+	return n < 0 ? -1 : n > 0 ? 1 : 0;
+}
+
+// "host:port" split at the last colon, false unless the port is a number from 1 to 65535
+inline bool split_host_port(const std::string& address, std::string& host, int& port)
+{
+	auto colon = address.rfind(':');
+	if (colon == std::string::npos || colon == 0)
+		return false;
+	char* end;
+	long p = std::strtol(address.c_str() + colon + 1, &end, 10);
+	if (*end != '\0' || end == address.c_str() + colon + 1 || p < 1 || p > 65535)
+		return false;
+	host = address.substr(0, colon);
+	port = static_cast<int>(p);
+	return true;
+}
+
+// a listening socket on host (a name or address, 0.0.0.0 for every interface), no_socket if it can't be had
+socket_handle listen_tcp(const std::string& host, int port)
+{
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0)
+		return no_socket;
+	socket_handle s = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+	if (s != no_socket) {
+		int reuse = 1;
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+		if (bind(s, found->ai_addr, static_cast<int>(found->ai_addrlen)) != 0 || listen(s, 16) != 0) {
+			close_socket(s);
+			s = no_socket;
+		}
+	}
+	freeaddrinfo(found);
+	return s;
+}
+
+// connected to host:port, no_socket if nothing's listening there
+socket_handle connect_tcp(const std::string& host, int port)
+{
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0)
+		return no_socket;
+	socket_handle s = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+	if (s != no_socket && connect(s, found->ai_addr, static_cast<int>(found->ai_addrlen)) != 0) {
+		close_socket(s);
+		s = no_socket;
+	}
+	freeaddrinfo(found);
+	if (s != no_socket)
+		set_no_delay(s);
+	return s;
+}
+
+// all n bytes or false, send and recv may each move only part of them
+inline bool send_all(socket_handle s, const void* data, size_t n)
+{
+	const char* p = static_cast<const char*>(data);
+	while (n > 0) {
+		int chunk = static_cast<int>(n < (1u << 30) ? n : (1u << 30));
+		int sent = static_cast<int>(send(s, p, chunk, send_flags));
+		if (sent <= 0)
+			return false;
+		p += sent;
+		n -= sent;
+	}
+	return true;
+}
+
+inline bool recv_all(socket_handle s, void* data, size_t n)
+{
+	char* p = static_cast<char*>(data);
+	while (n > 0) {
+		int chunk = static_cast<int>(n < (1u << 30) ? n : (1u << 30));
+		int got = static_cast<int>(recv(s, p, chunk, 0));
+		if (got <= 0)
+			return false;
+		p += got;
+		n -= got;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,195 @@
+#pragma once
+
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include "rtweekend.h"
+
+#include "mapped_file.h"
+#include "triangle_mesh.h"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// small parsing helpers that work within [p, end), the mapped file isn't null-terminated
+
+inline void obj_skip_spaces(const char*& p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+}
+
+inline void obj_skip_line(const char*& p, const char* end)
+{
+	while (p < end && *p != '\n')
+		p++;
+	if (p < end)
+		p++;
+}
+
+// decimal number with optional sign, fraction and exponent, false if there isn't one at p
+inline bool obj_parse_number(const char*& p, const char* end, double& out)
+{
+	obj_skip_spaces(p, end);
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	double value = 0;
+	bool digits = false;
+	while (p < end && *p >= '0' && *p <= '9') {
+		value = value * 10 + (*p++ - '0');
+		digits = true;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		double scale = 0.1;
+		while (p < end && *p >= '0' && *p <= '9') {
+			value += (*p++ - '0') * scale;
+			scale *= 0.1;
+			digits = true;
+		}
+	}
+	if (!digits) {
+		p = start;
+		return false;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool negative_exponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative_exponent = *p++ == '-';
+		int exponent = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+			exponent = exponent * 10 + (*p++ - '0');
+		value *= std::pow(10.0, negative_exponent ? -exponent : exponent);
+	}
+	out = negative ? -value : value;
+	return true;
+}
+
+inline bool obj_parse_int(const char*& p, const char* end, long long& out)
+{
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	long long value = 0;
+	const char* digits = p;
+	while (p < end && *p >= '0' && *p <= '9')
+		value = value * 10 + (*p++ - '0');
+	if (p == digits) {
+		p = start;
+		return false;
+	}
+	out = negative ? -value : value;
+	return true;
+}
+
+// Streams a Wavefront OBJ into mesh, which is built and ready to render afterwards. Reads vertex
+// positions, vertex normals and faces (polygons are split into fans), ignores everything else.
+// The file is memory-mapped and parsed in place, the only allocations are the mesh's own arrays
+// growing. Returns false, after saying why on stderr, if the file can't be read or is malformed.
+bool load_obj(const std::string& path, triangle_mesh& mesh)
+{
+	mapped_file file;
+	if (!file.open(path)) {
+		std::cerr << "Can't open mesh " << path << std::endl;
+		return false;
+	}
+
+	const char* p = file.data;
+	const char* end = file.data + file.size;
+	long long line_number = 0;
+	auto fail = [&](const char* message) {
+		std::cerr << path << ':' << line_number << ": " << message << std::endl;
+		return false;
+	};
+
+	bool any_normals = false;
+	// one polygon's corners, faces rarely have more than a handful so this is reused rather than reallocated
+	std::vector<uint32_t> face_positions, face_normals;
+
+	while (p < end) {
+		line_number++;
+		obj_skip_spaces(p, end);
+		if (p + 1 < end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+			p += 1;
+			double x, y, z;
+			if (!obj_parse_number(p, end, x) || !obj_parse_number(p, end, y) || !obj_parse_number(p, end, z))
+				return fail("vertex needs three coordinates");
+			mesh.positions.push_back(point3(static_cast<real>(x), static_cast<real>(y), static_cast<real>(z)));
+		} else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+			p += 2;
+			double x, y, z;
+			if (!obj_parse_number(p, end, x) || !obj_parse_number(p, end, y) || !obj_parse_number(p, end, z))
+				return fail("normal needs three components");
+			mesh.normals.push_back(vec3(static_cast<real>(x), static_cast<real>(y), static_cast<real>(z)));
+		} else if (p + 1 < end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+			p += 1;
+			face_positions.clear();
+			face_normals.clear();
+			bool face_has_normals = true;
+			while (true) {
+				obj_skip_spaces(p, end);
+				if (p >= end || *p == '\n' || *p == '#')
+					break;
+				// v, v/vt, v//vn or v/vt/vn, negative indices count back from the latest vertex
+				long long v, texture, vn = 0;
+				if (!obj_parse_int(p, end, v))
+					return fail("bad face index");
+				if (p < end && *p == '/') {
+					p++;
+					if (p < end && *p != '/')
+						obj_parse_int(p, end, texture); // texture coordinates aren't used
+					if (p < end && *p == '/') {
+						p++;
+						if (!obj_parse_int(p, end, vn))
+							return fail("bad normal index");
+					}
+				}
+				long long position = v < 0 ? static_cast<long long>(mesh.positions.size()) + v : v - 1;
+				if (position < 0 || position >= static_cast<long long>(mesh.positions.size()))
+					return fail("face refers to a vertex that doesn't exist");
+				face_positions.push_back(static_cast<uint32_t>(position));
+				if (vn == 0) {
+					face_has_normals = false;
+				} else {
+					long long normal = vn < 0 ? static_cast<long long>(mesh.normals.size()) + vn : vn - 1;
+					if (normal < 0 || normal >= static_cast<long long>(mesh.normals.size()))
+						return fail("face refers to a normal that doesn't exist");
+					face_normals.push_back(static_cast<uint32_t>(normal));
+				}
+			}
+			if (face_positions.size() < 3)
+				return fail("face needs at least three vertices");
+
+			if (face_has_normals && !any_normals) {
+				// first face with normals, every earlier face is flat
+				any_normals = true;
+				mesh.normal_indices.assign(mesh.indices.size(), triangle_mesh::no_normal);
+			}
+			for (size_t k = 1; k + 1 < face_positions.size(); ++k) {
+				mesh.indices.push_back(face_positions[0]);
+				mesh.indices.push_back(face_positions[k]);
+				mesh.indices.push_back(face_positions[k + 1]);
+				if (any_normals) {
+					mesh.normal_indices.push_back(face_has_normals ? face_normals[0] : triangle_mesh::no_normal);
+					mesh.normal_indices.push_back(face_has_normals ? face_normals[k] : triangle_mesh::no_normal);
+					mesh.normal_indices.push_back(face_has_normals ? face_normals[k + 1] : triangle_mesh::no_normal);
+				}
+			}
+		}
+		obj_skip_line(p, end);
+	}
+
+	if (mesh.indices.empty())
+		return fail("no faces");
+	mesh.build();
+	return true;
+}
+
+#endif
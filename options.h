@@ -0,0 +1,398 @@
+#pragma once
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "rtweekend.h"
+
+#include "affinity.h"
+#include "camera.h"
+#include "image_writer.h"
+#include "net.h"
+#include "settings.h"
+#include "tiles.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Everything a run can be told, from the command line (--name=value, or just --name for a switch)
+// or a config file given with --config=path (name = value per line, # starts a comment). Options
+// are applied in the order they're given, so later ones win. The defaults are the renderer's
+// original fixed settings.
+struct render_options
+{
+	std::string scene_path;         // the built-in random scene when empty
+	long long image_width = 1280;
+	long long image_height = 0;     // from the width and aspect ratio when 0
+	double aspect_ratio = 16.0 / 9.0;
+	int upscale_factor = 1;
+	int samples_per_pixel = 32;     // the maximum with adaptive sampling
+	int max_depth = 8;
+	uint64_t seed = 0;              // every pixel's rng is seeded from this, same seed gives the same image
+	integrator_type integrator = integrator_type::recursive;
+	sampler_type sampler = sampler_type::sobol;
+	bool sample_lights = true;      // next-event estimation, off leaves lights to be found by scattering
+
+	// adaptive sampling stops pixels once they've converged, and writes how many samples each took
+	bool adaptive = false;
+	int min_samples = 8;
+	double adaptive_error = 1.0 / 255.0;
+	std::string heatmap_path = "samples.ppm";
+
+	// first-hit albedo, normal and depth for every pixel (AOVs), which guide the denoiser and can be
+	// written beside the output as <output>_albedo, _normal and _depth
+	bool write_aovs = false;
+	bool denoise = false;
+
+	// work is split into square tiles that threads pull from a shared queue
+	unsigned int threads = 0;       // one per hardware thread when 0
+	bool pin_threads = false;       // keep each render thread on one CPU
+	thread_placement placement = thread_placement::spread; // how pinned threads are dealt out to NUMA nodes
+	bool replicate_scene = false;   // a copy of the scene and BVH on each NUMA node, implies pin
+	int tile_size = 32;
+	tile_order tile_ordering = tile_order::hilbert;
+
+	// output file, the format follows the extension (.pfm or P6 .ppm) unless it's given
+	std::string output_path = "out.ppm";
+	image_format output_format = image_format::ppm_binary;
+	bool output_format_set = false;
+
+	// progressive rendering: samples_per_pixel more samples per pixel each pass, with a preview and a
+	// checkpoint every preview_interval passes, resume picks up from the checkpoint
+	int passes = 1;
+	int preview_interval = 4;
+	bool resume = false;
+	std::string checkpoint_path = "out.ckpt";
+
+	// Batch rendering: each frame is one camera, rendered in turn with the same scene and BVH. With
+	// none the scene's own camera is used, orbit adds frames circling it around its look-at point.
+	std::vector<camera_settings> frames;
+	int orbit_frames = 0;
+
+	// interactive mode keeps refining the first frame's view, one sample per pixel a pass up to
+	// samples_per_pixel, for a viewer on port to watch and move, see preview.h
+	bool interactive = false;
+	int port = 8080;
+	int preview_downsample = 1;     // frames sent to the viewer are this many times smaller across and down
+
+	// Distributed rendering, see distributed.h: a coordinator listens on host:port and hands tiles
+	// to worker processes that connect to it, which render with the coordinator's options and then
+	// their own on top (threads, pinning and so on are each machine's).
+	std::string coordinator_address;
+	std::string worker_address;
+
+	bool help = false;              // --help was given and the usage printed, nothing to render
+
+	long long height() const { return image_height > 0 ? image_height : static_cast<long long>(image_width / aspect_ratio); }
+	double aspect() const { return image_height > 0 ? static_cast<double>(image_width) / image_height : aspect_ratio; }
+	image_format format() const;
+};
+
+image_format render_options::format() const
+{
+	if (output_format_set)
+		return output_format;
+	auto dot = output_path.rfind('.');
+	return dot != std::string::npos && output_path.substr(dot) == ".pfm" ? image_format::pfm : image_format::ppm_binary;
+}
+
+const char* options_usage =
+	"Options, as --name=value on the command line or name = value in a config file:\n"
+	"  config=path              read more options from a file\n"
+	"  scene=path               render a scene file instead of the built-in random scene\n"
+	"  width=N height=N         image size, the height defaults to the width over the aspect ratio\n"
+	"  aspect=R                 aspect ratio when no height is given, default 1.7778\n"
+	"  upscale=N                repeat each pixel N times across and down in the output\n"
+	"  spp=N depth=N            samples per pixel and maximum bounces\n"
+	"  seed=N                   rng seed\n"
+	"  integrator=recursive|wavefront\n"
+	"  sampler=sobol|blue-noise|independent\n"
+	"                           where samples' random numbers come from, default sobol\n"
+	"  nee=true|false           sample the scene's lights directly at every bounce, default true\n"
+	"  adaptive                 stop sampling pixels once they've converged\n"
+	"  min-spp=N error=E        adaptive sampling's minimum samples and target error\n"
+	"  heatmap=path             where adaptive sampling writes its sample counts\n"
+	"  aovs                     also write first-hit albedo, normal and depth images beside the output\n"
+	"  denoise                  filter the image with an edge-avoiding wavelet guided by the AOVs\n"
+	"  threads=N                render threads, default one per hardware thread\n"
+	"  pin                      keep each render thread on one CPU\n"
+	"  placement=spread|compact pinned threads alternate between NUMA nodes, or fill one before the next\n"
+	"  replicate                build a copy of the scene and BVH on each NUMA node, implies pin\n"
+	"  tile-size=N              tile edge in pixels\n"
+	"  tile-order=hilbert|scanline|centre-out\n"
+	"  output=path              output image, default out.ppm\n"
+	"  format=ppm|ppm-ascii|pfm output format, default from the output's extension\n"
+	"  passes=N                 progressive passes\n"
+	"  preview-interval=N       passes between previews and checkpoints\n"
+	"  resume                   carry on from the checkpoint\n"
+	"  checkpoint=path          checkpoint file, default out.ckpt\n"
+	"  frame=<lookfrom x y z> <lookat x y z> <vup x y z> <vfov> <aperture> <focus distance>\n"
+	"                           add a frame with this camera, repeat for a batch\n"
+	"  orbit=N                  add N frames circling the scene's camera around its look-at point\n"
+	"  interactive              keep refining and serve a live view on http://127.0.0.1:port/\n"
+	"  port=N                   interactive mode's port, default 8080\n"
+	"  preview-downsample=N     shrink interactive frames N times across and down before sending\n"
+	"  coordinator=host:port    hand tiles to worker processes connecting here instead of rendering them\n"
+	"  worker=host:port         render tiles for the coordinator at host:port until it's done\n";
+
+// whole-string number parsers, false if there's anything else in value
+inline bool parse_option_number(const std::string& value, double& out)
+{
+	char* end;
+	errno = 0;
+	out = std::strtod(value.c_str(), &end);
+	return !value.empty() && *end == '\0' && errno == 0 && std::isfinite(out);
+}
+
+inline bool parse_option_integer(const std::string& value, long long min, long long max, long long& out)
+{
+	char* end;
+	errno = 0;
+	out = std::strtoll(value.c_str(), &end, 10);
+	return !value.empty() && *end == '\0' && errno == 0 && out >= min && out <= max;
+}
+
+bool load_config(const std::string& path, render_options& options, int depth);
+
+// applies one option, where says where it came from for the error message
+bool set_option(render_options& options, const std::string& name, const std::string& value, const std::string& where, int depth = 0)
+{
+	auto fail = [&](const std::string& message) {
+		std::cerr << where << ": " << message << std::endl;
+		return false;
+	};
+	// no larger than max or what out can hold, whichever is less
+	auto integer = [&](long long min, auto& out, long long max = std::numeric_limits<long long>::max()) {
+		using integer_type = std::remove_reference_t<decltype(out)>;
+		if (static_cast<unsigned long long>(std::numeric_limits<integer_type>::max()) < static_cast<unsigned long long>(max))
+			max = static_cast<long long>(std::numeric_limits<integer_type>::max());
+		long long n;
+		if (!parse_option_integer(value, min, max, n))
+			return fail(name + " needs a whole number from " + std::to_string(min) + " to " + std::to_string(max));
+		out = static_cast<integer_type>(n);
+		return true;
+	};
+	auto number = [&](double& out) {
+		double x;
+		if (!parse_option_number(value, x) || x <= 0)
+			return fail(name + " needs a positive number");
+		out = x;
+		return true;
+	};
+	auto flag = [&](bool& out) {
+		if (!value.empty() && value != "true" && value != "false")
+			return fail(name + " is a switch, it doesn't take a value");
+		out = value != "false";
+		return true;
+	};
+
+	if (name == "config") {
+		if (depth > 8)
+			return fail("configs include each other too deeply");
+		return load_config(value, options, depth + 1);
+	} else if (name == "scene") {
+		options.scene_path = value;
+	} else if (name == "width") {
+		return integer(1, options.image_width, max_image_size);
+	} else if (name == "height") {
+		return integer(1, options.image_height, max_image_size);
+	} else if (name == "aspect") {
+		return number(options.aspect_ratio);
+	} else if (name == "upscale") {
+		return integer(1, options.upscale_factor, max_image_size);
+	} else if (name == "spp") {
+		return integer(1, options.samples_per_pixel);
+	} else if (name == "depth") {
+		return integer(1, options.max_depth);
+	} else if (name == "seed") {
+		return integer(0, options.seed);
+	} else if (name == "integrator") {
+		if (value == "recursive")
+			options.integrator = integrator_type::recursive;
+		else if (value == "wavefront")
+			options.integrator = integrator_type::wavefront;
+		else
+			return fail("integrator is recursive or wavefront");
+	} else if (name == "sampler") {
+		if (value == "sobol")
+			options.sampler = sampler_type::sobol;
+		else if (value == "blue-noise")
+			options.sampler = sampler_type::blue_noise;
+		else if (value == "independent")
+			options.sampler = sampler_type::independent;
+		else
+			return fail("sampler is sobol, blue-noise or independent");
+	} else if (name == "nee") {
+		return flag(options.sample_lights);
+	} else if (name == "adaptive") {
+		return flag(options.adaptive);
+	} else if (name == "min-spp") {
+		return integer(1, options.min_samples);
+	} else if (name == "error") {
+		return number(options.adaptive_error);
+	} else if (name == "heatmap") {
+		options.heatmap_path = value;
+	} else if (name == "aovs") {
+		return flag(options.write_aovs);
+	} else if (name == "denoise") {
+		return flag(options.denoise);
+	} else if (name == "threads") {
+		return integer(1, options.threads);
+	} else if (name == "pin") {
+		return flag(options.pin_threads);
+	} else if (name == "placement") {
+		if (value == "spread")
+			options.placement = thread_placement::spread;
+		else if (value == "compact")
+			options.placement = thread_placement::compact;
+		else
+			return fail("placement is spread or compact");
+	} else if (name == "replicate") {
+		return flag(options.replicate_scene);
+	} else if (name == "tile-size") {
+		return integer(1, options.tile_size);
+	} else if (name == "tile-order") {
+		if (value == "hilbert")
+			options.tile_ordering = tile_order::hilbert;
+		else if (value == "scanline")
+			options.tile_ordering = tile_order::scanline;
+		else if (value == "centre-out")
+			options.tile_ordering = tile_order::centre_out;
+		else
+			return fail("tile-order is hilbert, scanline or centre-out");
+	} else if (name == "output") {
+		options.output_path = value;
+	} else if (name == "format") {
+		if (value == "ppm")
+			options.output_format = image_format::ppm_binary;
+		else if (value == "ppm-ascii")
+			options.output_format = image_format::ppm_ascii;
+		else if (value == "pfm")
+			options.output_format = image_format::pfm;
+		else
+			return fail("format is ppm, ppm-ascii or pfm");
+		options.output_format_set = true;
+	} else if (name == "passes") {
+		return integer(1, options.passes);
+	} else if (name == "preview-interval") {
+		return integer(1, options.preview_interval);
+	} else if (name == "resume") {
+		return flag(options.resume);
+	} else if (name == "checkpoint") {
+		options.checkpoint_path = value;
+	} else if (name == "frame") {
+		double n[12];
+		size_t pos = 0;
+		for (int k = 0; k < 12; ++k) {
+			size_t start = value.find_first_not_of(" \t", pos);
+			size_t end = start == std::string::npos ? std::string::npos : value.find_first_of(" \t", start);
+			if (start == std::string::npos || !parse_option_number(value.substr(start, end - start), n[k]))
+				return fail("frame needs lookfrom, lookat, vup, vfov, aperture and focus distance");
+			pos = end;
+		}
+		if (pos != std::string::npos && value.find_first_not_of(" \t", pos) != std::string::npos)
+			return fail("frame takes 12 numbers");
+		camera_settings view;
+		view.lookfrom = point3(n[0], n[1], n[2]);
+		view.lookat = point3(n[3], n[4], n[5]);
+		view.vup = vec3(n[6], n[7], n[8]);
+		view.vfov = static_cast<real>(n[9]);
+		view.aperture = static_cast<real>(n[10]);
+		view.focus_distance = static_cast<real>(n[11]);
+		options.frames.push_back(view);
+	} else if (name == "orbit") {
+		return integer(1, options.orbit_frames);
+	} else if (name == "interactive") {
+		return flag(options.interactive);
+	} else if (name == "port") {
+		return integer(1, options.port, 65535);
+	} else if (name == "preview-downsample") {
+		return integer(1, options.preview_downsample);
+	} else if (name == "coordinator" || name == "worker") {
+		std::string host;
+		int port;
+		if (!split_host_port(value, host, port))
+			return fail(name + " needs a host:port");
+		(name == "coordinator" ? options.coordinator_address : options.worker_address) = value;
+	} else {
+		return fail("unknown option " + name);
+	}
+	return true;
+}
+
+// one name = value per line, or a bare name for a switch
+bool load_config(const std::string& path, render_options& options, int depth)
+{
+	std::ifstream file_in(path);
+	if (!file_in) {
+		std::cerr << "Can't open config " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	long long line_number = 0;
+	while (std::getline(file_in, line)) {
+		line_number++;
+		auto hash = line.find('#');
+		if (hash != std::string::npos)
+			line.resize(hash);
+		auto trim = [](const std::string& s) {
+			auto first = s.find_first_not_of(" \t\r");
+			auto last = s.find_last_not_of(" \t\r");
+			return first == std::string::npos ? std::string() : s.substr(first, last - first + 1);
+		};
+		auto equals = line.find('=');
+		std::string name = trim(line.substr(0, equals));
+		std::string value = equals == std::string::npos ? std::string() : trim(line.substr(equals + 1));
+		if (name.empty())
+			continue;
+		if (!set_option(options, name, value, path + ':' + std::to_string(line_number), depth))
+			return false;
+	}
+	return true;
+}
+
+// applies one --name=value (or --name) argument
+bool set_argument(render_options& options, const std::string& arg)
+{
+	auto equals = arg.find('=');
+	std::string name = arg.substr(2, equals == std::string::npos ? std::string::npos : equals - 2);
+	std::string value = equals == std::string::npos ? std::string() : arg.substr(equals + 1);
+	return set_option(options, name, value, "--" + name);
+}
+
+// false after saying why, or after printing the usage for --help, which sets options.help
+bool parse_command_line(int argc, char** argv, render_options& options)
+{
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--help" || arg == "-h") {
+			std::cout << "Usage: " << argv[0] << " [--name=value]...\n" << options_usage;
+			options.help = true;
+			return false;
+		}
+		if (arg.rfind("--", 0) != 0) {
+			std::cerr << "Unexpected argument " << arg << '\n';
+			std::cerr << "Usage: " << argv[0] << " [--name=value]...\n" << options_usage;
+			return false;
+		}
+		if (!set_argument(options, arg))
+			return false;
+	}
+	// the height can come from the aspect ratio, and upscaling multiplies both
+	long long height = options.height();
+	if (height < 1 || height > max_image_size || height * options.upscale_factor > max_image_size ||
+		options.image_width * options.upscale_factor > max_image_size) {
+		std::cerr << "The image has to be from 1 to " << max_image_size << " pixels across and down, upscaled" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,704 @@
+#pragma once
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "rtweekend.h"
+
+#include "accumulation.h"
+#include "camera.h"
+#include "colour.h"
+#include "net.h"
+#include "options.h"
+#include "settings.h"
+#include "tiles.h"
+#include "transform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Interactive mode: the scene, BVH and render threads stay up, passes of one sample per pixel
+// keep adding to the accumulation buffer, and every finished pass is published as a frame for a
+// viewer to fetch. Moving the camera cancels the pass in flight and starts the accumulation over,
+// so the first frame of a new view takes one cheap pass rather than a whole render. The viewer
+// is a page served on 127.0.0.1 by the renderer itself, so any browser will do.
+
+// 24-bit BMP of a linear RGB image, gamma corrected like the written images, each downsample x
+// downsample block of pixels averaged into one. Row 0 is the bottom row, which is how BMP
+// stores them too.
+std::string encode_bmp(const std::vector<float>& pixels, long long width, long long height, int downsample)
+{
+	long long out_width = std::max(1LL, width / downsample);
+	long long out_height = std::max(1LL, height / downsample);
+	long long row_bytes = (out_width * 3 + 3) & ~3LL;
+	long long image_bytes = row_bytes * out_height;
+	std::string bmp(static_cast<size_t>(54 + image_bytes), '\0');
+
+	auto put = [&](size_t at, uint32_t value, int bytes) {
+		for (int k = 0; k < bytes; ++k)
+			bmp[at + k] = static_cast<char>((value >> (8 * k)) & 0xff);
+	};
+	bmp[0] = 'B';
+	bmp[1] = 'M';
+	put(2, static_cast<uint32_t>(bmp.size()), 4);
+	put(10, 54, 4);                               // where the pixels start
+	put(14, 40, 4);                               // BITMAPINFOHEADER
+	put(18, static_cast<uint32_t>(out_width), 4);
+	put(22, static_cast<uint32_t>(out_height), 4); // positive, bottom row first
+	put(26, 1, 2);                                // planes
+	put(28, 24, 2);                               // bits per pixel
+	put(34, static_cast<uint32_t>(image_bytes), 4);
+	put(38, 2835, 4);                             // 72 dpi
+	put(42, 2835, 4);
+
+	double scale = 1.0 / (static_cast<double>(downsample) * downsample);
+	for (long long y = 0; y < out_height; ++y) {
+		char* row = &bmp[static_cast<size_t>(54 + y * row_bytes)];
+		for (long long x = 0; x < out_width; ++x) {
+			double c[3] = {};
+			for (long long sy = y * downsample; sy < std::min(height, (y + 1) * downsample); ++sy) {
+				const float* p = &pixels[(sy * width + x * downsample) * 3];
+				for (long long sx = 0; sx < downsample && x * downsample + sx < width; ++sx, p += 3) {
+					c[0] += p[0];
+					c[1] += p[1];
+					c[2] += p[2];
+				}
+			}
+			// blue, green, red
+			row[x * 3] = static_cast<char>(to_8bit(c[2] * scale));
+			row[x * 3 + 1] = static_cast<char>(to_8bit(c[1] * scale));
+			row[x * 3 + 2] = static_cast<char>(to_8bit(c[0] * scale));
+		}
+	}
+	return bmp;
+}
+
+// Render threads that stay up between passes. run hands every thread the same job and returns
+// once they've all finished it, without the cost of starting threads (and pinning them, and
+// their caches going cold) on every pass.
+class render_pool
+{
+public:
+	// start runs once on each new thread, before any work, thread is its index
+	render_pool(unsigned int n_threads, std::function<void(unsigned int)> start);
+	render_pool(const render_pool&) = delete;
+	render_pool& operator=(const render_pool&) = delete;
+	~render_pool();
+
+	void run(const std::function<void(unsigned int)>& job);
+
+private:
+	std::vector<std::thread> threads;
+	std::mutex m;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(unsigned int)>* current = nullptr;
+	uint64_t generation = 0; // bumped for every job, so each thread runs it exactly once
+	unsigned int busy = 0;
+	bool quit = false;
+};
+
+render_pool::render_pool(unsigned int n_threads, std::function<void(unsigned int)> start)
+{
+	for (unsigned int i = 0; i < n_threads; ++i) {
+		threads.push_back(std::thread([this, i, start] {
+			start(i);
+			uint64_t seen = 0;
+			std::unique_lock<std::mutex> lock(m);
+			while (true) {
+				wake.wait(lock, [&] { return quit || generation != seen; });
+				if (quit)
+					return;
+				seen = generation;
+				const auto* job = current;
+				lock.unlock();
+				(*job)(i);
+				lock.lock();
+				if (--busy == 0)
+					done.notify_all();
+			}
+		}));
+	}
+}
+
+render_pool::~render_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread& th : threads)
+		th.join();
+}
+
+void render_pool::run(const std::function<void(unsigned int)>& job)
+{
+	std::unique_lock<std::mutex> lock(m);
+	current = &job;
+	busy = static_cast<unsigned int>(threads.size());
+	generation++;
+	wake.notify_all();
+	done.wait(lock, [&] { return busy == 0; });
+}
+
+struct http_request
+{
+	std::string path;
+	std::string query; // after the ?, still encoded
+};
+
+struct http_response
+{
+	int status = 200;
+	std::string content_type = "text/plain";
+	std::vector<std::pair<std::string, std::string>> headers;
+	std::string body;
+};
+
+// value of name in a query string like a=1&b=2, false if it isn't there
+bool query_value(const std::string& query, const std::string& name, std::string& value)
+{
+	size_t pos = 0;
+	while (pos <= query.size()) {
+		size_t end = query.find('&', pos);
+		if (end == std::string::npos)
+			end = query.size();
+		size_t equals = query.find('=', pos);
+		if (equals != std::string::npos && equals < end && query.compare(pos, equals - pos, name) == 0 && equals - pos == name.size()) {
+			value = query.substr(equals + 1, end - equals - 1);
+			return true;
+		}
+		pos = end + 1;
+	}
+	return false;
+}
+
+// Just enough HTTP/1.0 for the viewer: GET only, on 127.0.0.1 only, a connection per request.
+// Each connection gets its own thread, so a viewer waiting on the next frame doesn't hold up the
+// camera moving. A client that connects and then goes quiet, as browsers' preconnects do, is
+// dropped after client_timeout_ms, or straight away by stop().
+class http_server
+{
+public:
+	using handler = std::function<void(const http_request&, http_response&)>;
+
+public:
+	http_server() {}
+	http_server(const http_server&) = delete;
+	http_server& operator=(const http_server&) = delete;
+	~http_server() { stop(); }
+
+	// false after saying why if the port can't be listened on
+	bool start(int port, handler h);
+	// stops accepting, wakes any client still to send its request, then waits for the requests
+	// being answered
+	void stop();
+
+	static const int client_timeout_ms = 10000;
+
+private:
+	void serve(socket_handle client);
+	void request_read(socket_handle client);
+
+	socket_handle listener = no_socket;
+	std::thread acceptor;
+	handler handle;
+	std::mutex clients_mutex;
+	std::vector<socket_handle> clients; // connections still reading their request, for stop to interrupt
+	std::atomic<int> connections{ 0 };
+	std::atomic<bool> stopping{ false };
+};
+
+bool http_server::start(int port, handler h)
+{
+	handle = std::move(h);
+	if (!net_startup()) {
+		std::cerr << "Couldn't start Winsock" << std::endl;
+		return false;
+	}
+	listener = listen_tcp("127.0.0.1", port);
+	if (listener == no_socket) {
+		std::cerr << "Couldn't listen on 127.0.0.1:" << port << std::endl;
+		net_cleanup();
+		return false;
+	}
+	acceptor = std::thread([this] {
+		while (!stopping) {
+			socket_handle client = accept(listener, nullptr, nullptr);
+			if (client == no_socket) {
+				// out of descriptors or the like, give it a moment rather than spin
+				if (!stopping)
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				continue;
+			}
+			set_timeout(client, client_timeout_ms);
+			connections++;
+			{
+				std::lock_guard<std::mutex> lock(clients_mutex);
+				clients.push_back(client);
+			}
+			std::thread([this, client] {
+				serve(client);
+				request_read(client);
+				close_socket(client);
+				connections--;
+			}).detach();
+		}
+	});
+	return true;
+}
+
+void http_server::stop()
+{
+	if (listener == no_socket)
+		return;
+	stopping = true;
+	// wakes the acceptor out of accept
+	shutdown_socket(listener);
+	acceptor.join();
+	listener = no_socket;
+	{
+		std::lock_guard<std::mutex> lock(clients_mutex);
+		for (socket_handle client : clients)
+			interrupt_socket(client);
+	}
+	while (connections > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	net_cleanup();
+}
+
+// once a client's request is in, stop leaves it to finish its answer
+void http_server::request_read(socket_handle client)
+{
+	std::lock_guard<std::mutex> lock(clients_mutex);
+	auto found = std::find(clients.begin(), clients.end(), client);
+	if (found != clients.end())
+		clients.erase(found);
+}
+
+void http_server::serve(socket_handle client)
+{
+	std::string request;
+	char buffer[2048];
+	while (request.find("\r\n\r\n") == std::string::npos && request.size() < 16384) {
+		int n = static_cast<int>(recv(client, buffer, sizeof(buffer), 0));
+		if (n <= 0)
+			return;
+		request.append(buffer, n);
+	}
+	request_read(client);
+
+	http_response response;
+	// GET /path?query HTTP/1.1
+	size_t space1 = request.find(' ');
+	size_t space2 = space1 == std::string::npos ? std::string::npos : request.find(' ', space1 + 1);
+	if (space2 == std::string::npos || request.compare(0, space1, "GET") != 0) {
+		response.status = 405;
+		response.body = "Only GET is supported\n";
+	} else {
+		std::string target = request.substr(space1 + 1, space2 - space1 - 1);
+		http_request r;
+		size_t question = target.find('?');
+		r.path = target.substr(0, question);
+		if (question != std::string::npos)
+			r.query = target.substr(question + 1);
+		handle(r, response);
+	}
+
+	const char* reason = response.status == 200 ? "OK" : response.status == 204 ? "No Content" : response.status == 400 ? "Bad Request"
+		: response.status == 404 ? "Not Found" : response.status == 405 ? "Method Not Allowed" : response.status == 410 ? "Gone" : "Error";
+	std::string head = "HTTP/1.0 " + std::to_string(response.status) + ' ' + reason + "\r\n"
+		"Content-Type: " + response.content_type + "\r\n"
+		"Content-Length: " + std::to_string(response.body.size()) + "\r\n"
+		"Cache-Control: no-store\r\n"
+		"Connection: close\r\n";
+	for (const auto& header : response.headers)
+		head += header.first + ": " + header.second + "\r\n";
+	head += "\r\n";
+	if (send_all(client, head.data(), head.size()))
+		send_all(client, response.body.data(), response.body.size());
+}
+
+// The viewer: long polls for each new frame, drag to orbit the camera around its look-at point,
+// scroll to move in and out.
+const char* preview_page = R"(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>raytracer preview</title>
+<style>
+body { margin: 0; background: #111; color: #ccc; font: 13px sans-serif; }
+img { display: block; width: 100%; image-rendering: pixelated; cursor: grab; user-select: none; }
+#status { padding: 4px 8px; }
+</style>
+</head>
+<body>
+<img id="frame" draggable="false">
+<div id="status">Waiting for the first frame</div>
+<script>
+const frame = document.getElementById('frame');
+const status = document.getElementById('status');
+let shown = 0;
+
+async function poll() {
+	while (true) {
+		try {
+			const r = await fetch('/frame.bmp?after=' + shown);
+			if (r.status == 410) {
+				status.textContent = 'Renderer stopped';
+				return;
+			}
+			if (r.status == 200) {
+				shown = +r.headers.get('X-Frame');
+				const old = frame.src;
+				frame.src = URL.createObjectURL(await r.blob());
+				if (old)
+					URL.revokeObjectURL(old);
+				status.textContent = r.headers.get('X-Status');
+			}
+		} catch (e) {
+			await new Promise(ok => setTimeout(ok, 500));
+		}
+	}
+}
+
+// moves made while a request is out are added up and sent together
+let drag = null, yaw = 0, pitch = 0, sending = false;
+function send() {
+	if (sending || (yaw == 0 && pitch == 0))
+		return;
+	sending = true;
+	const url = '/orbit?yaw=' + yaw + '&pitch=' + pitch;
+	yaw = pitch = 0;
+	fetch(url).finally(() => { sending = false; send(); });
+}
+frame.onmousedown = e => { drag = [e.clientX, e.clientY]; };
+window.onmouseup = () => { drag = null; };
+window.onmousemove = e => {
+	if (!drag)
+		return;
+	yaw -= (e.clientX - drag[0]) * 0.3;
+	pitch += (e.clientY - drag[1]) * 0.3;
+	drag = [e.clientX, e.clientY];
+	send();
+};
+frame.onwheel = e => {
+	e.preventDefault();
+	fetch('/dolly?scale=' + Math.pow(1.001, e.deltaY));
+};
+poll();
+</script>
+</body>
+</html>
+)";
+
+// renders this thread's share of a pass, pulling tiles from the scheduler given to preview_session
+using preview_pass = std::function<void(unsigned int thread, const render_settings& settings, const camera& cam)>;
+
+// Runs interactive mode until the viewer (or anyone) asks /quit. Besides the page and its
+// frames the server answers
+//   /orbit?yaw=&pitch=            turn the camera around its look-at point, in degrees
+//   /dolly?scale=                 scale the distance to the look-at point
+//   /camera?lookfrom=x,y,z&lookat=x,y,z&vup=x,y,z&vfov=&aperture=&focus=   any of them
+//   /status                       the view and how far it's got, as JSON
+//   /quit
+class preview_session
+{
+public:
+	double render_seconds = 0;      // time spent in passes, finished or not
+	uint64_t restarts = 0;
+	double first_frame_ms = 0;      // from the last camera change to its first frame
+	double mean_first_frame_ms = 0; // over every view
+
+public:
+	// renders into the caller's scheduler and accum, with threads started by start
+	preview_session(const render_options& options, const render_settings& settings, const camera_settings& view,
+		tile_scheduler& scheduler, accumulation_buffer& accum, unsigned int n_threads,
+		std::function<void(unsigned int)> start, preview_pass pass);
+
+	// false if the server couldn't start
+	bool run();
+
+private:
+	void handle(const http_request& request, http_response& response);
+	// under the lock
+	void request_view(const camera_settings& next);
+	std::string status_text() const;
+
+	const render_options& options;
+	render_settings settings;
+	tile_scheduler& scheduler;
+	accumulation_buffer& accum;
+	render_pool pool;
+	preview_pass pass;
+	http_server server;
+
+	std::mutex m;
+	std::condition_variable wake;      // the render loop, waiting for something to do
+	std::condition_variable new_frame; // viewers, waiting for the next frame
+	camera_settings view;              // the latest view asked for
+	bool view_changed = true;
+	bool refining = false;             // the pass in flight adds to a view that's already been shown
+	bool quit = false;
+	std::chrono::steady_clock::time_point change_time;
+	uint64_t frame_number = 0;
+	std::shared_ptr<const std::string> frame_bmp;
+	double pass_ms = 0;
+};
+
+preview_session::preview_session(const render_options& o, const render_settings& s, const camera_settings& v,
+	tile_scheduler& t, accumulation_buffer& a, unsigned int n_threads, std::function<void(unsigned int)> start, preview_pass p)
+	: options(o), settings(s), scheduler(t), accum(a), pool(n_threads, std::move(start)), pass(std::move(p)), view(v),
+	change_time(std::chrono::steady_clock::now())
+{
+	// a sample per pixel a pass, so every pass is as quick as it can be
+	settings.samples_per_pixel = 1;
+	settings.adaptive = false;
+}
+
+void preview_session::request_view(const camera_settings& next)
+{
+	view = next;
+	view_changed = true;
+	change_time = std::chrono::steady_clock::now();
+	// a view's first pass is left to finish so there's still something to see while the camera
+	// keeps moving, refining one nobody's looking at any more is wasted
+	if (refining)
+		scheduler.cancel();
+	wake.notify_all();
+}
+
+std::string preview_session::status_text() const
+{
+	char text[160];
+	std::snprintf(text, sizeof(text), "%lldx%lld, %llu/%d spp, first frame %.1f ms, %.1f ms a pass",
+		static_cast<long long>(accum.width), static_cast<long long>(accum.height), static_cast<unsigned long long>(accum.passes),
+		options.samples_per_pixel, first_frame_ms, pass_ms);
+	return text;
+}
+
+void preview_session::handle(const http_request& request, http_response& response)
+{
+	// Both leave out alone when the parameter isn't there and are false only for a malformed one,
+	// so a bad request never gets as far as the view.
+	auto number = [&](const char* name, double& out) {
+		std::string value;
+		if (!query_value(request.query, name, value))
+			return true;
+		double n;
+		if (!parse_option_number(value, n))
+			return false;
+		out = n;
+		return true;
+	};
+	auto triple = [&](const char* name, vec3& out) {
+		std::string value;
+		if (!query_value(request.query, name, value))
+			return true;
+		double n[3];
+		size_t pos = 0;
+		for (int k = 0; k < 3; ++k) {
+			size_t end = value.find(',', pos);
+			if ((k < 2) == (end == std::string::npos) || !parse_option_number(value.substr(pos, end - pos), n[k]))
+				return false;
+			pos = end + 1;
+		}
+		out = vec3(n[0], n[1], n[2]);
+		return true;
+	};
+
+	if (request.path == "/") {
+		response.content_type = "text/html";
+		response.body = preview_page;
+	} else if (request.path == "/frame.bmp") {
+		// the first frame after the one the viewer has, waiting up to a second for it
+		double after = 0;
+		if (!number("after", after)) {
+			response.status = 400;
+			response.body = "after is a frame number\n";
+			return;
+		}
+		std::unique_lock<std::mutex> lock(m);
+		new_frame.wait_for(lock, std::chrono::seconds(1), [&] { return quit || (frame_bmp && frame_number > after); });
+		if (quit) {
+			response.status = 410;
+		} else if (!frame_bmp || frame_number <= after) {
+			response.status = 204;
+		} else {
+			auto bmp = frame_bmp;
+			response.headers.push_back({ "X-Frame", std::to_string(frame_number) });
+			response.headers.push_back({ "X-Status", status_text() });
+			lock.unlock();
+			response.content_type = "image/bmp";
+			response.body = *bmp;
+		}
+	} else if (request.path == "/orbit") {
+		double yaw = 0, pitch = 0;
+		if (!number("yaw", yaw) || !number("pitch", pitch)) {
+			response.status = 400;
+			response.body = "yaw and pitch are degrees\n";
+			return;
+		}
+		std::lock_guard<std::mutex> lock(m);
+		camera_settings next = view;
+		vec3 up = unit_vector(next.vup);
+		vec3 offset = affine_transform::rotate(up, static_cast<real>(yaw)).apply_vector(next.lookfrom - next.lookat);
+		// pitch stops short of the poles, where the camera would flip over
+		real elevation = std::asin(clamp(dot(unit_vector(offset), up), -1.0, 1.0)) * 180 / pi;
+		real target = clamp(elevation + pitch, -89.0, 89.0);
+		offset = affine_transform::rotate(cross(offset, up), target - elevation).apply_vector(offset);
+		next.lookfrom = next.lookat + offset;
+		request_view(next);
+	} else if (request.path == "/dolly") {
+		double scale = 0;
+		if (!number("scale", scale) || scale <= 0) {
+			response.status = 400;
+			response.body = "dolly needs a positive scale\n";
+			return;
+		}
+		std::lock_guard<std::mutex> lock(m);
+		camera_settings next = view;
+		vec3 offset = next.lookfrom - next.lookat;
+		// stays in focus on the look-at point if it was
+		real distance = std::max(static_cast<real>(1e-3), static_cast<real>(offset.length() * scale));
+		next.focus_distance *= distance / offset.length();
+		next.lookfrom = next.lookat + distance * unit_vector(offset);
+		request_view(next);
+	} else if (request.path == "/camera") {
+		std::lock_guard<std::mutex> lock(m);
+		camera_settings next = view;
+		double vfov = next.vfov, aperture = next.aperture, focus = next.focus_distance;
+		if (!triple("lookfrom", next.lookfrom) || !triple("lookat", next.lookat) || !triple("vup", next.vup)) {
+			response.status = 400;
+			response.body = "lookfrom, lookat and vup are x,y,z\n";
+			return;
+		}
+		if (!number("vfov", vfov) || !number("aperture", aperture) || !number("focus", focus)) {
+			response.status = 400;
+			response.body = "vfov, aperture and focus are numbers\n";
+			return;
+		}
+		if (vfov <= 0 || vfov >= 180 || aperture < 0 || focus <= 0) {
+			response.status = 400;
+			response.body = "vfov is between 0 and 180 degrees, aperture can't be negative and focus has to be positive\n";
+			return;
+		}
+		// the camera builds its basis from these, which falls apart if they line up
+		vec3 direction = next.lookat - next.lookfrom;
+		if (direction.near_zero() || cross(direction, next.vup).near_zero()) {
+			response.status = 400;
+			response.body = "lookfrom and lookat have to differ, and vup can't point along the view\n";
+			return;
+		}
+		next.vfov = static_cast<real>(vfov);
+		next.aperture = static_cast<real>(aperture);
+		next.focus_distance = static_cast<real>(focus);
+		request_view(next);
+	} else if (request.path == "/status") {
+		std::lock_guard<std::mutex> lock(m);
+		char json[512];
+		std::snprintf(json, sizeof(json),
+			"{ \"frame\": %llu, \"samples_per_pixel\": %llu, \"target_samples_per_pixel\": %d, \"restarts\": %llu, "
+			"\"first_frame_ms\": %.3f, \"mean_first_frame_ms\": %.3f, \"pass_ms\": %.3f, "
+			"\"lookfrom\": [%g, %g, %g], \"lookat\": [%g, %g, %g], \"vfov\": %g }\n",
+			static_cast<unsigned long long>(frame_number), static_cast<unsigned long long>(accum.passes), options.samples_per_pixel,
+			static_cast<unsigned long long>(restarts), first_frame_ms, mean_first_frame_ms, pass_ms,
+			static_cast<double>(view.lookfrom.x()), static_cast<double>(view.lookfrom.y()), static_cast<double>(view.lookfrom.z()),
+			static_cast<double>(view.lookat.x()), static_cast<double>(view.lookat.y()), static_cast<double>(view.lookat.z()),
+			static_cast<double>(view.vfov));
+		response.content_type = "application/json";
+		response.body = json;
+	} else if (request.path == "/quit") {
+		std::lock_guard<std::mutex> lock(m);
+		quit = true;
+		scheduler.cancel();
+		wake.notify_all();
+		new_frame.notify_all();
+		response.body = "Stopping\n";
+	} else {
+		response.status = 404;
+		response.body = "Not found\n";
+	}
+}
+
+bool preview_session::run()
+{
+	if (!server.start(options.port, [this](const http_request& request, http_response& response) { handle(request, response); }))
+		return false;
+	std::cerr << "Interactive preview on http://127.0.0.1:" << options.port << "/, refining to " << options.samples_per_pixel
+		<< " spp, /quit to stop" << std::endl;
+
+	camera cam(view.lookfrom, view.lookat, view.vup, view.vfov, options.aspect(), view.aperture, view.focus_distance);
+	std::chrono::steady_clock::time_point restart_time;
+	double first_frame_total_ms = 0;
+	std::function<void(unsigned int)> job = [&](unsigned int i) { pass(i, settings, cam); };
+	std::vector<float> image;
+
+	std::unique_lock<std::mutex> lock(m);
+	while (!quit) {
+		if (view_changed) {
+			// nothing's cleared here, each tile is cleared by the thread that renders it first
+			cam = camera(view.lookfrom, view.lookat, view.vup, view.vfov, options.aspect(), view.aperture, view.focus_distance);
+			accum.passes = 0;
+			accum.untouched = true;
+			restart_time = change_time;
+			view_changed = false;
+		}
+		if (accum.passes >= static_cast<uint64_t>(options.samples_per_pixel)) {
+			wake.wait(lock, [&] { return quit || view_changed; });
+			continue;
+		}
+		settings.pass = accum.passes;
+		refining = accum.passes > 0;
+		scheduler.reset();
+		lock.unlock();
+
+		auto tp1 = std::chrono::steady_clock::now();
+		pool.run(job);
+		auto tp2 = std::chrono::steady_clock::now();
+		render_seconds += std::chrono::duration<double>(tp2 - tp1).count();
+		// a finished pass is a good frame even if the camera's moved since
+		bool finished = scheduler.remaining() == 0;
+		std::shared_ptr<const std::string> bmp;
+		if (finished) {
+			accum.resolve(image);
+			bmp = std::make_shared<const std::string>(encode_bmp(image, accum.width, accum.height, options.preview_downsample));
+		}
+
+		lock.lock();
+		refining = false;
+		if (!finished)
+			continue;
+		accum.passes++;
+		accum.untouched = false;
+		pass_ms = std::chrono::duration<double, std::milli>(tp2 - tp1).count();
+		frame_number++;
+		frame_bmp = bmp;
+		if (accum.passes == 1) {
+			first_frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - restart_time).count();
+			first_frame_total_ms += first_frame_ms;
+			mean_first_frame_ms = first_frame_total_ms / ++restarts;
+			std::cerr << "First frame in " << first_frame_ms << " ms" << std::endl;
+		}
+		new_frame.notify_all();
+	}
+	lock.unlock();
+	server.stop();
+	return true;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+
+#ifndef QUAD_H
+#define QUAD_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "sampler.h"
+#include "stats.h"
+
+#include <cmath>
+
+// Parallelogram with one corner at corner and sides u and v, facing along cross(u, v). Mostly
+// for area lights, which emit from the front face only.
+class quad : public hittable
+{
+public:
+	point3 corner;
+	vec3 u, v;
+	const material* mat_ptr;
+
+public:
+	quad(const point3& q, const vec3& edge_u, const vec3& edge_v, const material* mp);
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+	// samples a point uniformly over the area, converted to a pdf over solid angle
+	virtual real pdf_value(const point3& o, const vec3& direction) const override;
+	virtual vec3 random(const point3& o) const override;
+
+private:
+	vec3 normal;   // unit
+	real offset;   // of the plane along normal
+	vec3 w;        // turns a point on the plane into its (u, v) coordinates
+	real area;
+};
+
+quad::quad(const point3& q, const vec3& edge_u, const vec3& edge_v, const material* mp) : corner(q), u(edge_u), v(edge_v), mat_ptr(mp)
+{
+	vec3 n = cross(u, v);
+	normal = unit_vector(n);
+	offset = dot(normal, corner);
+	w = n / dot(n, n);
+	area = n.length();
+}
+
+bool quad::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	RT_COUNT(primitive_tests, 1);
+	auto denominator = dot(normal, r.direction());
+	if (std::fabs(denominator) < 1e-8)
+		return false;
+	auto t = (offset - dot(normal, r.origin())) / denominator;
+	if (t < t_min || t > t_max)
+		return false;
+
+	point3 p = r.at(t);
+	vec3 planar = p - corner;
+	auto alpha = dot(w, cross(planar, v));
+	auto beta = dot(w, cross(u, planar));
+	if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1)
+		return false;
+
+	rec.t = t;
+	rec.p = p;
+	rec.set_face_normal(r, normal);
+	rec.mat_ptr = mat_ptr;
+	RT_COUNT(primitive_hits, 1);
+	return true;
+}
+
+bool quad::bounding_box(aabb& output_box) const
+{
+	// flat along one axis for axis-aligned quads, which the slab test copes with
+	output_box = aabb();
+	output_box.expand(corner);
+	output_box.expand(corner + u);
+	output_box.expand(corner + v);
+	output_box.expand(corner + u + v);
+	return true;
+}
+
+real quad::pdf_value(const point3& o, const vec3& direction) const
+{
+	vec3 d = unit_vector(direction);
+	auto denominator = dot(normal, d);
+	if (std::fabs(denominator) < 1e-8)
+		return 0;
+	auto t = (offset - dot(normal, o)) / denominator;
+	if (t <= 0)
+		return 0;
+	vec3 planar = o + t * d - corner;
+	auto alpha = dot(w, cross(planar, v));
+	auto beta = dot(w, cross(u, planar));
+	if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1)
+		return 0;
+	// area pdf 1 / area over the solid angle the patch subtends, distance^2 / cos
+	return t * t / (std::fabs(denominator) * area);
+}
+
+vec3 quad::random(const point3& o) const
+{
+	sample2 s = sample_2d();
+	point3 p = corner + static_cast<real>(s.u) * u + static_cast<real>(s.v) * v;
+	return p - o;
+}
+
+#endif
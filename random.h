@@ -62,7 +62,7 @@ public:
     friend bool operator==(xorshift const &, xorshift const &);
     friend bool operator!=(xorshift const &, xorshift const &);
 
-    xorshift() : m_seed(0xc1f651c67c62c6e0ull) {}
+    constexpr xorshift() : m_seed(0xc1f651c67c62c6e0ull) {}
     explicit xorshift(std::random_device &rd)
     {
         seed(rd);
@@ -73,6 +73,12 @@ public:
         m_seed = uint64_t(rd()) << 31 | uint64_t(rd());
     }
 
+    void seed(uint64_t s)
+    {
+        // an all-zero state would only ever produce zeros
+        m_seed = s ? s : 0xc1f651c67c62c6e0ull;
+    }
+
     result_type operator()()
     {
         uint64_t result = m_seed * 0xd989bcacc137dcd5ull;
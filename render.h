@@ -0,0 +1,143 @@
+#pragma once
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "rtweekend.h"
+
+#include "accumulation.h"
+#include "allocation_counter.h"
+#include "camera.h"
+#include "colour.h"
+#include "hittable.h"
+#include "integrator.h"
+#include "lighting.h"
+#include "material.h"
+#include "sampler.h"
+#include "settings.h"
+#include "stats.h"
+#include "tiles.h"
+#include "wavefront.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// Running mean and variance of a pixel's brightness (Welford's method), tells adaptive
+// sampling when a pixel has converged.
+struct pixel_variance
+{
+	long long n = 0;
+	double mean = 0;
+	double m2 = 0; // sum of squared differences from the mean
+
+	void add(double x)
+	{
+		n++;
+		double delta = x - mean;
+		mean += delta / n;
+		m2 += delta * (x - mean);
+	}
+
+	// true once the 95% confidence interval of the mean is within max_error either side after
+	// gamma correction, d(sqrt(x))/dx = 1/(2 sqrt(x)) converts the linear error to displayed
+	bool converged(double max_error) const
+	{
+		if (n < 2)
+			return false;
+		double std_error = std::sqrt(m2 / (n - 1) / n);
+		double display_error = 1.96 * std_error / (2 * std::sqrt(std::max(mean, 1e-4)));
+		return display_error <= max_error;
+	}
+};
+
+// render a single tile, adding its samples straight into the accumulation buffer, and what each
+// camera ray hit first when the buffer has AOVs
+void render_tile(const tile& t, const render_settings& settings, const camera& cam, const hittable& world, const scene_lighting& lighting,
+	accumulation_buffer& accum)
+{
+	const bool aovs = accum.has_aovs();
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			RT_STATS_ONLY(double pixel_start = stats_clock_seconds();)
+			colour pix(0, 0, 0);
+			first_hit pixel_hits;
+			real luminance_squares = 0;
+			pixel_variance variance;
+			seed_rng(pixel_seed(settings, j * settings.image_width + i));
+			thread_sampler.start_pixel(settings, i, j);
+			int s = 0;
+			while (s < settings.samples_per_pixel) {
+				thread_sampler.start_sample(settings.pass * settings.samples_per_pixel + s);
+				// normalise i and j & sample random point within this pixel
+				sample2 jitter = sample_2d();
+				auto u = (i + jitter.u) / (settings.image_width - 1);
+				auto v = (j + jitter.v) / (settings.image_height - 1);
+				// make ray for this pixel
+				ray r = cam.get_ray(u, v);
+				RT_COUNT(primary_rays, 1);
+				// render ray
+				first_hit hit;
+				colour sample = ray_colour(r, world, lighting, settings.max_depth, 0, aovs ? &hit : nullptr);
+				pix += sample;
+				if (aovs) {
+					pixel_hits.add(hit);
+					real l = luminance(sample);
+					luminance_squares += l * l;
+				}
+				s++;
+				if (settings.adaptive) {
+					variance.add(luminance(sample));
+					if (s >= settings.min_samples && variance.converged(settings.adaptive_error))
+						break;
+				}
+			}
+			accum.add(j * settings.image_width + i, pix, s);
+			if (aovs)
+				accum.add_aovs(j * settings.image_width + i, pixel_hits.albedo, pixel_hits.normal, pixel_hits.depth, luminance_squares);
+			RT_STATS_ONLY(accum.cost[j * settings.image_width + i] += static_cast<float>(stats_clock_seconds() - pixel_start);)
+		}
+	}
+}
+
+// Pull tiles until there are none left, runs per-thread. wavefront is the thread's own and is
+// kept between passes, it's sized for the biggest tile up front so rendering tiles doesn't
+// allocate, stats.heap_allocations says whether that held.
+void render_tiles(tile_scheduler& scheduler, const render_settings& settings, const camera& cam, const hittable& world,
+	const scene_lighting& lighting, accumulation_buffer& accum, wavefront_state& wavefront, worker_stats& stats)
+{
+	auto tp_start = std::chrono::high_resolution_clock::now();
+
+	if (settings.integrator == integrator_type::wavefront) {
+		size_t n_pixels = scheduler.max_tile_pixels();
+		wavefront.reserve(wavefront_paths(n_pixels, settings.samples_per_pixel), n_pixels);
+	}
+	// room for every tile up front, so recording them doesn't allocate either
+	RT_STATS_ONLY(stats.tile_times.reserve(stats.tile_times.size() + scheduler.tiles.size());)
+	uint64_t allocations_before = thread_heap_allocations;
+	render_counters counters_before = current_thread_counters();
+
+	tile t;
+	while (scheduler.next(t)) {
+		auto tp1 = std::chrono::high_resolution_clock::now();
+		if (accum.untouched)
+			accum.clear_tile(t);
+		if (settings.integrator == integrator_type::wavefront)
+			render_tile_wavefront(t, settings, cam, world, lighting, accum, wavefront);
+		else
+			render_tile(t, settings, cam, world, lighting, accum);
+		auto tp2 = std::chrono::high_resolution_clock::now();
+		scheduler.finished();
+		stats.busy_seconds += std::chrono::duration<double>(tp2 - tp1).count();
+		stats.tiles++;
+		RT_STATS_ONLY(stats.tile_times.push_back({ t.x0, t.y0, t.x1, t.y1, settings.pass,
+			std::chrono::duration<double>(tp1.time_since_epoch()).count(), std::chrono::duration<double>(tp2.time_since_epoch()).count() });)
+	}
+	stats.heap_allocations += thread_heap_allocations - allocations_before;
+	stats.counters += current_thread_counters() - counters_before;
+	auto tp_end = std::chrono::high_resolution_clock::now();
+	stats.wall_seconds += std::chrono::duration<double>(tp_end - tp_start).count();
+}
+
+#endif
@@ -15,32 +15,81 @@ using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
 
+// Scalar type for geometry and colour maths, define RT_USE_FLOAT for a single precision build.
+// Halves the size of scene data and hit records and doubles the SIMD width in sphere_soup.
+#ifdef RT_USE_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
-const double infinity = std::numeric_limits<double>::infinity();
-const double pi = 3.1415926535897932385;
+const real infinity = std::numeric_limits<real>::infinity();
+const real pi = static_cast<real>(3.1415926535897932385);
+// closest a bounced ray may hit anything, keeps it from re-hitting the surface it left.
+// float hit points are only good to ~1e-7 of their magnitude so it has to be looser there
+#ifdef RT_USE_FLOAT
+const real ray_epsilon = 0.002f;
+#else
+const real ray_epsilon = 0.001;
+#endif
 
 // RNG engine setup
-std::random_device rd;
-xorshift rng(rd);
-std::uniform_real_distribution<double> d01(0.0, 1.0);
+// each thread owns its generator, so sampling never touches shared state. The renderer
+// reseeds it for every pixel which keeps renders reproducible for any thread count.
+thread_local xorshift rng;
 
 // Utility functions
-inline double degrees_to_radians(double degrees)
+inline real degrees_to_radians(real degrees)
 {
 	return degrees * pi / 180.0;
 }
 
+inline uint64_t mix_seed(uint64_t a, uint64_t b)
+{
+	// combine two values into a well distributed seed (splitmix64 finaliser)
+	uint64_t z = a * UINT64_C(0x9E3779B97F4A7C15) + b + UINT64_C(0x632BE59BD9B4E019);
+	z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+inline void seed_rng(uint64_t seed)
+{
+	rng.seed(seed);
+}
+
+// Largest value below 1 that's still below 1 once it's a real. Anything in [0, 1) has to stay
+// under this to stay in [0, 1) in a float build, where rounding can carry it up to 1.0f.
+const double below_one = std::nextafter(static_cast<real>(1), static_cast<real>(0));
+
+// 32 random bits as a value in [0, 1). A float build keeps only the top 24, as many as a float
+// holds exactly, a double build all of them.
+inline double to_unit(uint32_t x)
+{
+#ifdef RT_USE_FLOAT
+	return (x >> 8) * 0x1p-24;
+#else
+	return x * (1.0 / 4294967296.0);
+#endif
+}
+
 inline double random_double()
 {
 	// returns random double in [0.0, 1.0)
-	return d01(rng);
+	return to_unit(rng());
 }
 
 inline double random_double(double min, double max)
 {
 	// returns random double in [min, max)
-	std::uniform_real_distribution<double> d(min, max);
-	return d(rng);
+	return min + (max - min) * random_double();
+}
+
+inline int random_int(int min, int max)
+{
+	// returns random integer in [min, max]
+	return static_cast<int>(random_double(min, max + 1));
 }
 
 inline double clamp(double x, double min, double max)
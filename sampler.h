@@ -0,0 +1,342 @@
+#pragma once
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.h"
+
+#include "settings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Where the numbers for a path's random decisions come from. Each sample of a pixel is a point
+// in a space with a dimension per decision, so a low discrepancy sequence can spread a pixel's
+// samples evenly over the decisions that matter most: where in the pixel, where on the lens,
+// then a block of dimensions for each bounce. Every decision always reads the same dimensions,
+// whichever branch the path takes, so the sequences line up from one sample to the next.
+//   independent  the thread's rng, the same uniform random numbers as always
+//   sobol        the first two Sobol dimensions, Owen scrambled and shuffled per pixel and per
+//                decision (Burley 2020), so decisions don't correlate with each other
+//   blue_noise   the R1/R2 additive recurrences, shifted per pixel by a blue noise mask, which
+//                pushes low sample count error into high spatial frequencies
+const int pixel_dimension = 0;         // 2D
+const int lens_dimension = 2;          // 2D
+const int first_bounce_dimension = 4;
+
+// dimensions within a bounce's block
+const int scatter_dimension = 0;       // up to 3, as many as the material needs to scatter
+const int light_choice_dimension = 3;  // 1D, which light to aim at
+const int light_point_dimension = 4;   // 2D, where on the light
+const int bounce_dimensions = 6;
+
+struct sample2
+{
+	double u, v;
+};
+
+// Blue noise threshold mask made with void-and-cluster (Ulichney 1993): every pixel holds its
+// rank over the size^2 pixels, so the pixels under any threshold are spread as evenly as they can
+// be. Tiles toroidally. Built once, the first time it's asked for.
+class blue_noise_mask
+{
+public:
+	static const int size = 64;
+
+public:
+	static const blue_noise_mask& get();
+
+	// rank in [0, 1), x and y wrap
+	double value(int x, int y) const { return values[(y & (size - 1)) * size + (x & (size - 1))]; }
+
+private:
+	blue_noise_mask();
+
+	std::vector<double> values;
+};
+
+const blue_noise_mask& blue_noise_mask::get()
+{
+	static const blue_noise_mask mask;
+	return mask;
+}
+
+blue_noise_mask::blue_noise_mask()
+{
+	const int n = size * size;
+	// energy a set pixel adds to every other, a gaussian of the wrapped distance between them
+	const double sigma = 1.5;
+	std::vector<double> kernel(n);
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			int dx = std::min(x, size - x);
+			int dy = std::min(y, size - y);
+			kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+		}
+	}
+
+	std::vector<double> energy(n, 0);
+	std::vector<char> set(n, 0);
+	auto toggle = [&](int p, bool on) {
+		set[p] = on;
+		double sign = on ? 1 : -1;
+		int px = p % size, py = p / size;
+		for (int y = 0; y < size; ++y) {
+			const double* row = &kernel[((y - py) & (size - 1)) * size];
+			for (int x = 0; x < size; ++x)
+				energy[y * size + x] += sign * row[(x - px) & (size - 1)];
+		}
+	};
+	// the set pixel with the most energy around it, or the unset one with the least
+	auto tightest_cluster = [&] {
+		int best = -1;
+		for (int p = 0; p < n; ++p)
+			if (set[p] && (best < 0 || energy[p] > energy[best]))
+				best = p;
+		return best;
+	};
+	auto largest_void = [&] {
+		int best = -1;
+		for (int p = 0; p < n; ++p)
+			if (!set[p] && (best < 0 || energy[p] < energy[best]))
+				best = p;
+		return best;
+	};
+
+	// a tenth of the pixels at random, then moved from clusters to voids until it's settled
+	xorshift pattern_rng;
+	pattern_rng.seed(UINT64_C(0x5EED0B1E));
+	int initial = n / 10;
+	for (int k = 0; k < initial;) {
+		int p = static_cast<int>(pattern_rng() % n);
+		if (!set[p]) {
+			toggle(p, true);
+			k++;
+		}
+	}
+	while (true) {
+		int cluster = tightest_cluster();
+		toggle(cluster, false);
+		int gap = largest_void();
+		toggle(gap, true);
+		if (gap == cluster)
+			break;
+	}
+	std::vector<char> initial_set = set;
+	std::vector<double> initial_energy = energy;
+
+	// ranks below the initial pattern's size come from taking its tightest clusters away, the
+	// rest from filling the largest voids
+	std::vector<int> rank(n);
+	for (int k = initial; k > 0; --k) {
+		int cluster = tightest_cluster();
+		toggle(cluster, false);
+		rank[cluster] = k - 1;
+	}
+	set = initial_set;
+	energy = initial_energy;
+	for (int k = initial; k < n; ++k) {
+		int gap = largest_void();
+		toggle(gap, true);
+		rank[gap] = k;
+	}
+
+	values.resize(n);
+	for (int p = 0; p < n; ++p)
+		values[p] = (rank[p] + 0.5) / n;
+}
+
+inline uint32_t reverse_bits(uint32_t x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+// well mixed 32 bits from x (Wellons' lowbias32)
+inline uint32_t hash32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// A hash in which each bit only depends on the bits below it (Laine and Karras 2011, with
+// Burley's constants). On a bit-reversed value that's Owen scrambling, a random permutation of
+// the value's subintervals at every level picked by seed.
+inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+// Second Sobol dimension with its bits reversed, ready to be Owen scrambled (the first dimension
+// is just the index's bits reversed). Its generator matrix is linear over xor, so it's looked up
+// a byte of the index at a time: a loop over the bits of a shuffled index runs all 32 times with
+// a branch the predictor can't learn.
+struct sobol_second_table
+{
+	uint32_t bytes[4][256];
+
+	sobol_second_table()
+	{
+		for (int k = 0; k < 4; ++k) {
+			for (uint32_t b = 0; b < 256; ++b) {
+				uint32_t result = 0;
+				uint32_t index = b << (8 * k);
+				for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+					if (index & 1)
+						result ^= v;
+				bytes[k][b] = reverse_bits(result);
+			}
+		}
+	}
+};
+
+const sobol_second_table sobol_second_bytes;
+
+inline uint32_t sobol_second_reversed(uint32_t index)
+{
+	const auto& t = sobol_second_bytes.bytes;
+	return t[0][index & 0xff] ^ t[1][(index >> 8) & 0xff] ^ t[2][(index >> 16) & 0xff] ^ t[3][index >> 24];
+}
+
+// Per-thread source of a path's sample values. The integrators set where a path is up to, pixel,
+// sample and bounce, and the code making each decision asks for as many values as it needs.
+class path_sampler
+{
+public:
+	sampler_type type = sampler_type::independent;
+
+public:
+	// the pixel the sequences are scrambled or shifted for, independent draws from whatever the
+	// thread's rng was last seeded with
+	void start_pixel(const render_settings& settings, int x, int y);
+	// index counts up through every pass's samples so later passes carry on the sequences
+	void start_sample(uint64_t index);
+	// moves to the block of dimensions for bounce (0 for what the camera ray hits), the recursive
+	// integrator counts them with next_bounce, the wavefront one picks a path up at one
+	void start_bounce(int bounce);
+	void next_bounce() { start_bounce(bounce + 1); }
+	void start_light_sample() { dimension = bounce_start() + light_choice_dimension; }
+
+	// next value or pair of values in [0, 1)
+	double get_1d();
+	sample2 get_2d();
+
+private:
+	int bounce_start() const { return first_bounce_dimension + bounce * bounce_dimensions; }
+	uint32_t dimension_seed() const { return hash32(pixel_hash ^ (static_cast<uint32_t>(dimension) * 0x9e3779b9u)); }
+
+	uint32_t pixel_hash = 0;
+	int x = 0, y = 0;
+	uint32_t index = 0;
+	uint32_t reversed_index = 0;
+	int dimension = 0;
+	int bounce = -1;
+	const blue_noise_mask* mask = nullptr;
+};
+
+// the sampler of the thread that's rendering
+thread_local path_sampler thread_sampler;
+
+inline double sample_1d()
+{
+	return thread_sampler.get_1d();
+}
+
+inline sample2 sample_2d()
+{
+	return thread_sampler.get_2d();
+}
+
+void path_sampler::start_pixel(const render_settings& settings, int pixel_x, int pixel_y)
+{
+	type = settings.sampler;
+	x = pixel_x;
+	y = pixel_y;
+	uint64_t pixel_index = static_cast<uint64_t>(pixel_y) * settings.image_width + pixel_x;
+	// the same for every pass, the sample index is what moves on
+	pixel_hash = static_cast<uint32_t>(mix_seed(settings.seed, pixel_index));
+	if (type == sampler_type::blue_noise && !mask)
+		mask = &blue_noise_mask::get();
+}
+
+void path_sampler::start_sample(uint64_t sample_index)
+{
+	index = static_cast<uint32_t>(sample_index);
+	reversed_index = reverse_bits(index);
+	dimension = 0;
+	bounce = -1;
+}
+
+void path_sampler::start_bounce(int b)
+{
+	bounce = b;
+	dimension = bounce_start();
+}
+
+double path_sampler::get_1d()
+{
+	switch (type) {
+	case sampler_type::sobol: {
+		// the index shuffled, then the first Sobol dimension scrambled, which is the index's bits
+		// reversed so the scramble's own reversal undoes it
+		uint32_t seed = dimension_seed();
+		uint32_t i = reverse_bits(laine_karras_permutation(reversed_index, seed));
+		dimension++;
+		return to_unit(reverse_bits(laine_karras_permutation(i, hash32(seed + 1))));
+	}
+	case sampler_type::blue_noise: {
+		// golden ratio steps, offset by the mask shifted a different way for every dimension
+		uint32_t shift = dimension_seed();
+		double u = mask->value(x + static_cast<int>(shift & 63), y + static_cast<int>((shift >> 6) & 63));
+		dimension++;
+		u += index * 0.6180339887498949;
+		return std::min(u - std::floor(u), below_one);
+	}
+	default:
+		dimension++;
+		return random_double();
+	}
+}
+
+sample2 path_sampler::get_2d()
+{
+	switch (type) {
+	case sampler_type::sobol: {
+		uint32_t seed = dimension_seed();
+		uint32_t i = reverse_bits(laine_karras_permutation(reversed_index, seed));
+		dimension += 2;
+		return { to_unit(reverse_bits(laine_karras_permutation(i, hash32(seed + 1)))),
+			to_unit(reverse_bits(laine_karras_permutation(sobol_second_reversed(i), hash32(seed + 2)))) };
+	}
+	case sampler_type::blue_noise: {
+		// the plastic number's steps (Roberts' R2), each coordinate offset by the mask at its own shift
+		uint32_t shift = dimension_seed();
+		double u = mask->value(x + static_cast<int>(shift & 63), y + static_cast<int>((shift >> 6) & 63));
+		double v = mask->value(x + static_cast<int>((shift >> 12) & 63), y + static_cast<int>((shift >> 18) & 63));
+		dimension += 2;
+		u += index * 0.7548776662466927;
+		v += index * 0.5698402909980532;
+		return { std::min(u - std::floor(u), below_one), std::min(v - std::floor(v), below_one) };
+	}
+	default:
+		dimension += 2;
+		double u = random_double();
+		return { u, random_double() };
+	}
+}
+
+#endif
@@ -0,0 +1,249 @@
+#pragma once
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "rtweekend.h"
+
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Closed form mappings from uniform numbers in [0, 1) to the distributions the renderer samples,
+// each with its pdf. Nothing rejects, so a sample always takes the same count of numbers (which
+// low discrepancy samplers rely on) and the cost doesn't depend on the numbers. Everything is
+// built on the concentric disk, which keeps samples that are close in the square close after
+// mapping, so stratified input stays stratified. Directions are about +z, local_to_world turns
+// them to be about a normal.
+
+// coefficients of x^2k in cos(x) and x^2k+1 in sin(x), highest first: Taylor series to x^15,
+// good to double precision for x in [-pi/4, pi/4], which is all the disk needs
+const real cos_quarter_terms[] = { -1.0 / 87178291200.0, 1.0 / 479001600.0, -1.0 / 3628800.0, 1.0 / 40320.0, -1.0 / 720.0, 1.0 / 24.0, -1.0 / 2.0, 1.0 };
+const real sin_quarter_terms[] = { -1.0 / 1307674368000.0, 1.0 / 6227020800.0, -1.0 / 39916800.0, 1.0 / 362880.0, -1.0 / 5040.0, 1.0 / 120.0, -1.0 / 6.0, 1.0 };
+const int quarter_terms = 8;
+
+// sine and cosine of x in [-pi/4, pi/4], a fraction of the cost of std::sin and std::cos
+inline void sincos_quarter(real x, real& s, real& c)
+{
+	real x2 = x * x;
+	c = cos_quarter_terms[0];
+	s = sin_quarter_terms[0];
+	for (int k = 1; k < quarter_terms; ++k) {
+		c = c * x2 + cos_quarter_terms[k];
+		s = s * x2 + sin_quarter_terms[k];
+	}
+	s *= x;
+}
+
+// Uniform in the unit disk, Shirley and Chiu's concentric map: squares around the centre of
+// [-1, 1]^2 go to circles, pdf 1/pi over area. Whichever of a and b is bigger is the radius and
+// the other sets the angle within its quarter, selected rather than branched on.
+inline vec3 sample_concentric_disk(real u1, real u2)
+{
+	real a = 2 * u1 - 1;
+	real b = 2 * u2 - 1;
+	bool a_major = std::fabs(a) >= std::fabs(b);
+	real r = a_major ? a : b;
+	real minor = a_major ? b : a;
+	// both zero only at the centre, where the angle doesn't matter
+	real phi = (pi / 4) * (minor / (r != 0 ? r : 1));
+	real s, c;
+	sincos_quarter(phi, s, c);
+	// b major is at pi/2 - phi, which swaps the sine and cosine
+	return a_major ? vec3(r * c, r * s, 0) : vec3(r * s, r * c, 0);
+}
+
+inline real concentric_disk_pdf()
+{
+	return 1 / pi;
+}
+
+// Uniform over the cap of directions within acos(cos_theta_max) of +z. The disk's r^2 is
+// uniform, so it sets z evenly between 1 and cos_theta_max, and the disk point is scaled out to
+// the sphere at that height. pdf 1 / (2 pi (1 - cos_theta_max)) over solid angle.
+inline vec3 sample_uniform_cone(real u1, real u2, real cos_theta_max)
+{
+	vec3 d = sample_concentric_disk(u1, u2);
+	real r2 = d.x() * d.x() + d.y() * d.y();
+	real h = 1 - cos_theta_max;
+	real scale = std::sqrt(std::max(static_cast<real>(0), h * (2 - r2 * h)));
+	return vec3(d.x() * scale, d.y() * scale, 1 - r2 * h);
+}
+
+inline real uniform_cone_pdf(real cos_theta_max)
+{
+	return 1 / (2 * pi * (1 - cos_theta_max));
+}
+
+// uniform over the hemisphere about +z, pdf 1/(2 pi)
+inline vec3 sample_uniform_hemisphere(real u1, real u2)
+{
+	return sample_uniform_cone(u1, u2, 0);
+}
+
+inline real uniform_hemisphere_pdf()
+{
+	return 1 / (2 * pi);
+}
+
+// uniform over all directions, pdf 1/(4 pi)
+inline vec3 sample_uniform_sphere(real u1, real u2)
+{
+	return sample_uniform_cone(u1, u2, -1);
+}
+
+inline real uniform_sphere_pdf()
+{
+	return 1 / (4 * pi);
+}
+
+// uniform in the unit ball, a direction pushed out to the cube root of a third number, pdf 3/(4 pi) over volume
+inline vec3 sample_uniform_ball(real u1, real u2, real u3)
+{
+	return std::cbrt(u3) * sample_uniform_sphere(u1, u2);
+}
+
+inline real uniform_ball_pdf()
+{
+	return 3 / (4 * pi);
+}
+
+// Cosine-weighted about +z, the disk lifted straight up onto the hemisphere (Malley's method),
+// pdf cos(theta)/pi over solid angle.
+inline vec3 sample_cosine_hemisphere(real u1, real u2)
+{
+	vec3 d = sample_concentric_disk(u1, u2);
+	real z = std::sqrt(std::max(static_cast<real>(0), 1 - d.x() * d.x() - d.y() * d.y()));
+	return vec3(d.x(), d.y(), z);
+}
+
+inline real cosine_hemisphere_pdf(real cos_theta)
+{
+	return cos_theta > 0 ? cos_theta / pi : 0;
+}
+
+// a direction sampled about +z, turned to be about unit vector n
+inline vec3 local_to_world(const vec3& local, const vec3& n)
+{
+	vec3 u, v;
+	orthonormal_basis(n, u, v);
+	return local.x() * u + local.y() * v + local.z() * n;
+}
+
+// uniformly random direction from the thread's rng, for setting up scenes and benchmarks
+inline vec3 random_unit_vector()
+{
+	return sample_uniform_sphere(static_cast<real>(random_double()), static_cast<real>(random_double()));
+}
+
+// Batches: the disk, cosine hemisphere and sphere mappings over arrays, sample i from u1[i] and
+// u2[i] written to x[i], y[i] (and z[i]). Whole vectors of lanes at a time where the build has
+// SIMD and the scalar functions for the rest. Results match the scalar ones to rounding, which
+// the square roots magnify near the disk's edge (to ~1e-4 in single precision).
+
+#if RT_SIMD
+inline void simd_sincos_quarter(simd_real x, simd_real& s, simd_real& c)
+{
+	simd_real x2 = simd_mul(x, x);
+	c = simd_set1(cos_quarter_terms[0]);
+	s = simd_set1(sin_quarter_terms[0]);
+	for (int k = 1; k < quarter_terms; ++k) {
+		c = simd_add(simd_mul(c, x2), simd_set1(cos_quarter_terms[k]));
+		s = simd_add(simd_mul(s, x2), simd_set1(sin_quarter_terms[k]));
+	}
+	s = simd_mul(s, x);
+}
+
+// the concentric map a vector at a time
+inline void simd_concentric_disk(simd_real u1, simd_real u2, simd_real& x, simd_real& y)
+{
+	const simd_real zero = simd_set1(0);
+	const simd_real one = simd_set1(1);
+	const simd_real two = simd_set1(2);
+	simd_real a = simd_sub(simd_mul(two, u1), one);
+	simd_real b = simd_sub(simd_mul(two, u2), one);
+	simd_real abs_a = simd_max(a, simd_sub(zero, a));
+	simd_real abs_b = simd_max(b, simd_sub(zero, b));
+	simd_mask a_major = simd_ge(abs_a, abs_b);
+	simd_real r = simd_blend(a_major, b, a);
+	simd_real minor = simd_blend(a_major, a, b);
+	// both zero only at the centre, where the angle doesn't matter
+	simd_real denominator = simd_blend(simd_le(simd_max(abs_a, abs_b), zero), r, one);
+	simd_real phi = simd_mul(simd_set1(pi / 4), simd_div(minor, denominator));
+	simd_real s, c;
+	simd_sincos_quarter(phi, s, c);
+	// b major lanes are at pi/2 - phi, which swaps the sine and cosine
+	x = simd_mul(r, simd_blend(a_major, s, c));
+	y = simd_mul(r, simd_blend(a_major, c, s));
+}
+#endif
+
+void sample_concentric_disk_batch(const real* u1, const real* u2, size_t n, real* x, real* y)
+{
+	size_t i = 0;
+#if RT_SIMD
+	for (; i + simd_width <= n; i += simd_width) {
+		simd_real dx, dy;
+		simd_concentric_disk(simd_load(u1 + i), simd_load(u2 + i), dx, dy);
+		simd_store(x + i, dx);
+		simd_store(y + i, dy);
+	}
+#endif
+	for (; i < n; ++i) {
+		vec3 d = sample_concentric_disk(u1[i], u2[i]);
+		x[i] = d.x();
+		y[i] = d.y();
+	}
+}
+
+void sample_cosine_hemisphere_batch(const real* u1, const real* u2, size_t n, real* x, real* y, real* z)
+{
+	size_t i = 0;
+#if RT_SIMD
+	const simd_real zero = simd_set1(0);
+	const simd_real one = simd_set1(1);
+	for (; i + simd_width <= n; i += simd_width) {
+		simd_real dx, dy;
+		simd_concentric_disk(simd_load(u1 + i), simd_load(u2 + i), dx, dy);
+		simd_real r2 = simd_add(simd_mul(dx, dx), simd_mul(dy, dy));
+		simd_store(x + i, dx);
+		simd_store(y + i, dy);
+		simd_store(z + i, simd_sqrt(simd_max(zero, simd_sub(one, r2))));
+	}
+#endif
+	for (; i < n; ++i) {
+		vec3 d = sample_cosine_hemisphere(u1[i], u2[i]);
+		x[i] = d.x();
+		y[i] = d.y();
+		z[i] = d.z();
+	}
+}
+
+void sample_uniform_sphere_batch(const real* u1, const real* u2, size_t n, real* x, real* y, real* z)
+{
+	size_t i = 0;
+#if RT_SIMD
+	const simd_real zero = simd_set1(0);
+	const simd_real one = simd_set1(1);
+	const simd_real two = simd_set1(2);
+	for (; i + simd_width <= n; i += simd_width) {
+		simd_real dx, dy;
+		simd_concentric_disk(simd_load(u1 + i), simd_load(u2 + i), dx, dy);
+		simd_real r2 = simd_add(simd_mul(dx, dx), simd_mul(dy, dy));
+		// the cone mapping with h = 2
+		simd_real scale = simd_mul(two, simd_sqrt(simd_max(zero, simd_sub(one, r2))));
+		simd_store(x + i, simd_mul(dx, scale));
+		simd_store(y + i, simd_mul(dy, scale));
+		simd_store(z + i, simd_sub(one, simd_mul(two, r2)));
+	}
+#endif
+	for (; i < n; ++i) {
+		vec3 d = sample_uniform_sphere(u1[i], u2[i]);
+		x[i] = d.x();
+		y[i] = d.y();
+		z[i] = d.z();
+	}
+}
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "rtweekend.h"
+
+#include "arena.h"
+#include "camera.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "lighting.h"
+#include "material.h"
+
+#include <utility>
+#include <vector>
+
+// Owns every material and object in a scene. Everything else, hittable_list, bvh_node and
+// hit_record included, only holds plain pointers into it, so nothing touches a reference
+// count while rendering. They're made in one arena, laid out in the order the scene was built
+// and freed together when it goes. Objects never move once made, so the scene itself can be
+// moved freely.
+class scene
+{
+public:
+	arena storage;        // every material and object made, including ones only reachable through others
+	hittable_list world;  // top level objects to render
+	scene_lighting lighting; // background, and lights that are also in world
+	camera_settings view;
+
+public:
+	scene() {}
+
+	// make a material owned by the scene
+	template <typename M, typename... Args>
+	M* make_material(Args&&... args);
+
+	// make an object owned by the scene without adding it to world, e.g. to group it later
+	template <typename H, typename... Args>
+	H* make(Args&&... args);
+
+	// make an object and add it to world
+	template <typename H, typename... Args>
+	H* add(Args&&... args);
+};
+
+template <typename M, typename... Args>
+M* scene::make_material(Args&&... args)
+{
+	return storage.make<M>(std::forward<Args>(args)...);
+}
+
+template <typename H, typename... Args>
+H* scene::make(Args&&... args)
+{
+	return storage.make<H>(std::forward<Args>(args)...);
+}
+
+template <typename H, typename... Args>
+H* scene::add(Args&&... args)
+{
+	H* ptr = make<H>(std::forward<Args>(args)...);
+	world.add(ptr);
+	return ptr;
+}
+
+#endif
@@ -0,0 +1,554 @@
+#pragma once
+
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "instance.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "obj_loader.h"
+#include "quad.h"
+#include "scene.h"
+#include "sphere.h"
+#include "transform.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Scenes can be loaded from text files, one statement per line, # starts a comment:
+//
+//   camera <lookfrom x y z> <lookat x y z> <vup x y z> <vfov> <aperture> <focus distance>
+//   material <name> lambertian <r g b>
+//   material <name> metal <r g b> <fuzz>
+//   material <name> dielectric <refractive index>
+//   material <name> light <r g b>
+//   background <r g b>
+//   sphere <centre x y z> <radius> <material name>
+//   quad <corner x y z> <side u x y z> <side v x y z> <material name>
+//   mesh <obj path> <material name>
+//   object <name> <obj path>
+//   instance <object name> <material name> [translate <x y z>] [scale <s> | scale <x y z>] [rotate <axis x y z> <degrees>]...
+//
+// Spheres and quads made of a light material are sampled directly by the integrators, quads
+// give off light from the side cross(u, v) faces. A background replaces the sky gradient.
+// An object is a mesh that's loaded once and only drawn through its instances, each of which
+// places it with its own transform and material. An instance's transforms apply in the order
+// they're written. Materials and objects have to be declared before they're used. Mesh paths
+// are relative to the scene file and can't contain spaces. The first load of a scene writes a binary
+// cache next to it (<path>.cache), later loads map the cache and build the scene straight from
+// it without parsing anything. The cache is rebuilt whenever the text file's size or
+// modification time changes. Meshes are cached by path only, they're always read from their OBJ.
+
+// on-disk records, plain data in native byte order so the cache can be used in place once mapped
+struct scene_material_record
+{
+	uint32_t kind; // material_kind
+	uint32_t padding;
+	double params[4]; // lambertian: albedo, metal: albedo and fuzz, dielectric: refractive index, light: emitted colour
+};
+
+struct scene_sphere_record
+{
+	double center[3];
+	double radius;
+	uint32_t material; // index into the material records
+	uint32_t padding;
+};
+
+struct scene_mesh_record
+{
+	char path[248]; // null-terminated, as written in the scene file
+	uint32_t material;
+	uint32_t padding;
+};
+
+// an object's path goes in a mesh record, its material is unused
+const uint32_t scene_no_material = 0xffffffff;
+
+struct scene_instance_record
+{
+	double transform[12]; // object to world, row-major 3x4
+	uint32_t object;      // index into the object records
+	uint32_t material;
+};
+
+struct scene_quad_record
+{
+	double corner[3];
+	double u[3], v[3];
+	uint32_t material;
+	uint32_t padding;
+};
+
+struct scene_cache_header
+{
+	char magic[8];
+	uint64_t source_size;  // of the text file the cache was made from
+	int64_t source_time;   // its modification time, in the filesystem clock's ticks
+	uint32_t material_count;
+	uint32_t sphere_count;
+	uint32_t mesh_count;
+	uint32_t object_count;
+	uint32_t instance_count;
+	uint32_t quad_count;
+	uint32_t has_background;
+	uint32_t padding;
+	double camera[12]; // lookfrom, lookat, vup, vfov, aperture, focus distance
+	double background[3];
+};
+
+static_assert(std::is_trivially_copyable<scene_cache_header>::value && sizeof(scene_cache_header) % 8 == 0, "cache header must be plain data");
+static_assert(sizeof(scene_material_record) == 40 && sizeof(scene_sphere_record) == 40 && sizeof(scene_mesh_record) == 256
+	&& sizeof(scene_instance_record) == 104 && sizeof(scene_quad_record) == 80,
+	"cache records must have a fixed layout");
+
+// "RTSCENE" and a format version
+const char scene_cache_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '4' };
+
+// everything a scene file describes, as records
+struct scene_records
+{
+	camera_settings view;
+	std::vector<scene_material_record> materials;
+	std::vector<scene_sphere_record> spheres;
+	std::vector<scene_mesh_record> meshes;
+	std::vector<scene_mesh_record> objects;
+	std::vector<scene_instance_record> instances;
+	std::vector<scene_quad_record> quads;
+	bool has_background = false;
+	double background[3] = {};
+};
+
+// the same records wherever they live, in scene_records or straight out of a mapped cache
+struct scene_record_arrays
+{
+	camera_settings view;
+	const scene_material_record* materials;
+	size_t material_count;
+	const scene_sphere_record* spheres;
+	size_t sphere_count;
+	const scene_mesh_record* meshes;
+	size_t mesh_count;
+	const scene_mesh_record* objects;
+	size_t object_count;
+	const scene_instance_record* instances;
+	size_t instance_count;
+	const scene_quad_record* quads;
+	size_t quad_count;
+	bool has_background;
+	double background[3];
+};
+
+// parses scene text, reports the first error with its line number and returns false
+bool parse_scene_text(const char* text, size_t size, const std::string& name, scene_records& out)
+{
+	std::unordered_map<std::string, uint32_t> material_names;
+	std::unordered_map<std::string, uint32_t> object_names;
+	std::string line;
+	std::vector<std::string> tokens;
+	long long line_number = 0;
+	size_t pos = 0;
+
+	while (pos < size) {
+		size_t end = pos;
+		while (end < size && text[end] != '\n')
+			end++;
+		line.assign(text + pos, end - pos);
+		pos = end + 1;
+		line_number++;
+
+		auto hash = line.find('#');
+		if (hash != std::string::npos)
+			line.resize(hash);
+		tokens.clear();
+		size_t i = 0;
+		while (i < line.size()) {
+			while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i])))
+				i++;
+			size_t start = i;
+			while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i])))
+				i++;
+			if (i > start)
+				tokens.push_back(line.substr(start, i - start));
+		}
+		if (tokens.empty())
+			continue;
+
+		auto fail = [&](const std::string& message) {
+			std::cerr << name << ':' << line_number << ": " << message << std::endl;
+			return false;
+		};
+		// numbers from tokens[first], false if any are missing or malformed
+		double numbers[12];
+		auto read_numbers = [&](size_t first, size_t count) {
+			if (tokens.size() < first + count)
+				return false;
+			for (size_t k = 0; k < count; ++k) {
+				char* parsed_end;
+				numbers[k] = std::strtod(tokens[first + k].c_str(), &parsed_end);
+				if (*parsed_end != '\0')
+					return false;
+			}
+			return true;
+		};
+
+		const std::string& keyword = tokens[0];
+		if (keyword == "camera") {
+			if (tokens.size() != 13 || !read_numbers(1, 12))
+				return fail("camera needs lookfrom, lookat, vup, vfov, aperture and focus distance");
+			out.view.lookfrom = point3(numbers[0], numbers[1], numbers[2]);
+			out.view.lookat = point3(numbers[3], numbers[4], numbers[5]);
+			out.view.vup = vec3(numbers[6], numbers[7], numbers[8]);
+			out.view.vfov = static_cast<real>(numbers[9]);
+			out.view.aperture = static_cast<real>(numbers[10]);
+			out.view.focus_distance = static_cast<real>(numbers[11]);
+		} else if (keyword == "material") {
+			if (tokens.size() < 3)
+				return fail("material needs a name and a type");
+			scene_material_record m = {};
+			const std::string& type = tokens[2];
+			size_t n_params;
+			if (type == "lambertian") {
+				m.kind = static_cast<uint32_t>(material_kind::lambertian);
+				n_params = 3;
+			} else if (type == "metal") {
+				m.kind = static_cast<uint32_t>(material_kind::metal);
+				n_params = 4;
+			} else if (type == "dielectric") {
+				m.kind = static_cast<uint32_t>(material_kind::dielectric);
+				n_params = 1;
+			} else if (type == "light") {
+				m.kind = static_cast<uint32_t>(material_kind::emissive);
+				n_params = 3;
+			} else {
+				return fail("unknown material type " + type);
+			}
+			if (tokens.size() != 3 + n_params || !read_numbers(3, n_params))
+				return fail(type + " takes " + std::to_string(n_params) + " numbers");
+			for (size_t k = 0; k < n_params; ++k)
+				m.params[k] = numbers[k];
+			material_names[tokens[1]] = static_cast<uint32_t>(out.materials.size());
+			out.materials.push_back(m);
+		} else if (keyword == "sphere") {
+			if (tokens.size() != 6 || !read_numbers(1, 4))
+				return fail("sphere needs a centre, a radius and a material");
+			auto found = material_names.find(tokens[5]);
+			if (found == material_names.end())
+				return fail("no material called " + tokens[5]);
+			scene_sphere_record s = {};
+			s.center[0] = numbers[0];
+			s.center[1] = numbers[1];
+			s.center[2] = numbers[2];
+			s.radius = numbers[3];
+			s.material = found->second;
+			out.spheres.push_back(s);
+		} else if (keyword == "quad") {
+			if (tokens.size() != 11 || !read_numbers(1, 9))
+				return fail("quad needs a corner, two sides and a material");
+			auto found = material_names.find(tokens[10]);
+			if (found == material_names.end())
+				return fail("no material called " + tokens[10]);
+			scene_quad_record q = {};
+			for (int k = 0; k < 3; ++k) {
+				q.corner[k] = numbers[k];
+				q.u[k] = numbers[3 + k];
+				q.v[k] = numbers[6 + k];
+			}
+			if (cross(vec3(q.u[0], q.u[1], q.u[2]), vec3(q.v[0], q.v[1], q.v[2])).length_squared() == 0)
+				return fail("quad's sides can't be parallel");
+			q.material = found->second;
+			out.quads.push_back(q);
+		} else if (keyword == "background") {
+			if (tokens.size() != 4 || !read_numbers(1, 3))
+				return fail("background needs a colour");
+			out.has_background = true;
+			for (int k = 0; k < 3; ++k)
+				out.background[k] = numbers[k];
+		} else if (keyword == "mesh") {
+			if (tokens.size() != 3)
+				return fail("mesh needs an OBJ path and a material");
+			if (tokens[1].size() >= sizeof(scene_mesh_record::path))
+				return fail("mesh path is too long");
+			auto found = material_names.find(tokens[2]);
+			if (found == material_names.end())
+				return fail("no material called " + tokens[2]);
+			scene_mesh_record m = {};
+			std::memcpy(m.path, tokens[1].c_str(), tokens[1].size());
+			m.material = found->second;
+			out.meshes.push_back(m);
+		} else if (keyword == "object") {
+			if (tokens.size() != 3)
+				return fail("object needs a name and an OBJ path");
+			if (tokens[2].size() >= sizeof(scene_mesh_record::path))
+				return fail("object path is too long");
+			scene_mesh_record m = {};
+			std::memcpy(m.path, tokens[2].c_str(), tokens[2].size());
+			m.material = scene_no_material;
+			object_names[tokens[1]] = static_cast<uint32_t>(out.objects.size());
+			out.objects.push_back(m);
+		} else if (keyword == "instance") {
+			if (tokens.size() < 3)
+				return fail("instance needs an object and a material");
+			auto found_object = object_names.find(tokens[1]);
+			if (found_object == object_names.end())
+				return fail("no object called " + tokens[1]);
+			auto found_material = material_names.find(tokens[2]);
+			if (found_material == material_names.end())
+				return fail("no material called " + tokens[2]);
+
+			affine_transform transform;
+			size_t k = 3;
+			while (k < tokens.size()) {
+				const std::string& op = tokens[k];
+				affine_transform step;
+				if (op == "translate" && read_numbers(k + 1, 3)) {
+					step = affine_transform::translate(vec3(numbers[0], numbers[1], numbers[2]));
+					k += 4;
+				} else if (op == "rotate" && read_numbers(k + 1, 4)) {
+					if (numbers[0] == 0 && numbers[1] == 0 && numbers[2] == 0)
+						return fail("rotation axis can't be zero");
+					step = affine_transform::rotate(vec3(numbers[0], numbers[1], numbers[2]), static_cast<real>(numbers[3]));
+					k += 5;
+				} else if (op == "scale" && read_numbers(k + 1, 3)) {
+					step = affine_transform::scale(vec3(numbers[0], numbers[1], numbers[2]));
+					k += 4;
+				} else if (op == "scale" && read_numbers(k + 1, 1)) {
+					step = affine_transform::scale(vec3(numbers[0], numbers[0], numbers[0]));
+					k += 2;
+				} else {
+					return fail("bad transform " + op + ", expected translate x y z, scale s, scale x y z or rotate x y z degrees");
+				}
+				if (op == "scale" && (numbers[0] == 0 || step.m[1][1] == 0 || step.m[2][2] == 0))
+					return fail("scale can't be zero");
+				transform = step * transform;
+			}
+
+			scene_instance_record instance = {};
+			for (int row = 0; row < 3; ++row)
+				for (int column = 0; column < 4; ++column)
+					instance.transform[4 * row + column] = transform.m[row][column];
+			instance.object = found_object->second;
+			instance.material = found_material->second;
+			out.instances.push_back(instance);
+		} else {
+			return fail("unknown statement " + keyword);
+		}
+	}
+	return true;
+}
+
+// records as they are in memory, the cache's arrays follow its header back to back
+scene_record_arrays scene_arrays(const scene_records& records)
+{
+	return { records.view, records.materials.data(), records.materials.size(), records.spheres.data(), records.spheres.size(),
+		records.meshes.data(), records.meshes.size(), records.objects.data(), records.objects.size(),
+		records.instances.data(), records.instances.size(), records.quads.data(), records.quads.size(),
+		records.has_background, { records.background[0], records.background[1], records.background[2] } };
+}
+
+// Makes the scene's materials and objects from records, which may live in a mapped cache. Mesh
+// paths are relative to directory. Fails if a mesh can't be loaded.
+bool build_scene(scene& out, const scene_record_arrays& records, const std::filesystem::path& directory)
+{
+	out.view = records.view;
+	std::vector<const material*> made(records.material_count);
+	for (size_t i = 0; i < records.material_count; ++i) {
+		const double* p = records.materials[i].params;
+		switch (static_cast<material_kind>(records.materials[i].kind)) {
+		case material_kind::lambertian: made[i] = out.make_material<lambertian>(colour(p[0], p[1], p[2])); break;
+		case material_kind::metal: made[i] = out.make_material<metal>(colour(p[0], p[1], p[2]), static_cast<real>(p[3])); break;
+		case material_kind::emissive: made[i] = out.make_material<diffuse_light>(colour(p[0], p[1], p[2])); break;
+		default: made[i] = out.make_material<dielectric>(static_cast<real>(p[0])); break;
+		}
+	}
+
+	if (records.has_background) {
+		out.lighting.sky = false;
+		out.lighting.background = colour(records.background[0], records.background[1], records.background[2]);
+	}
+
+	out.world.objects.reserve(out.world.objects.size() + records.sphere_count + records.quad_count + records.instance_count);
+	for (size_t i = 0; i < records.sphere_count; ++i) {
+		const auto& s = records.spheres[i];
+		auto made_sphere = out.add<sphere>(point3(s.center[0], s.center[1], s.center[2]), static_cast<real>(s.radius), made[s.material]);
+		if (made[s.material]->kind == material_kind::emissive)
+			out.lighting.lights.add(made_sphere);
+	}
+	for (size_t i = 0; i < records.quad_count; ++i) {
+		const auto& q = records.quads[i];
+		auto made_quad = out.add<quad>(point3(q.corner[0], q.corner[1], q.corner[2]), vec3(q.u[0], q.u[1], q.u[2]),
+			vec3(q.v[0], q.v[1], q.v[2]), made[q.material]);
+		if (made[q.material]->kind == material_kind::emissive)
+			out.lighting.lights.add(made_quad);
+	}
+
+	for (size_t i = 0; i < records.mesh_count; ++i) {
+		auto mesh = out.add<triangle_mesh>();
+		mesh->mat_ptr = made[records.meshes[i].material];
+		if (!load_obj((directory / records.meshes[i].path).string(), *mesh))
+			return false;
+	}
+
+	// objects are owned by the scene but left out of the world, only their instances are in it
+	std::vector<const hittable*> objects(records.object_count);
+	for (size_t i = 0; i < records.object_count; ++i) {
+		auto mesh = out.make<triangle_mesh>();
+		if (!load_obj((directory / records.objects[i].path).string(), *mesh))
+			return false;
+		objects[i] = mesh;
+	}
+	for (size_t i = 0; i < records.instance_count; ++i) {
+		const auto& inst = records.instances[i];
+		affine_transform transform;
+		for (int row = 0; row < 3; ++row)
+			for (int column = 0; column < 4; ++column)
+				transform.m[row][column] = static_cast<real>(inst.transform[4 * row + column]);
+		out.add<instance>(objects[inst.object], transform, made[inst.material]);
+	}
+	return true;
+}
+
+// Written beside the cache and renamed over it once complete, so a render stopped partway, or a
+// second process loading the same scene, never finds a half written cache.
+bool write_scene_cache(const std::string& path, const scene_cache_header& header, const scene_records& records)
+{
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream file_out(tmp_path, std::ios::binary);
+		if (!file_out)
+			return false;
+		file_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file_out.write(reinterpret_cast<const char*>(records.materials.data()), records.materials.size() * sizeof(scene_material_record));
+		file_out.write(reinterpret_cast<const char*>(records.spheres.data()), records.spheres.size() * sizeof(scene_sphere_record));
+		file_out.write(reinterpret_cast<const char*>(records.meshes.data()), records.meshes.size() * sizeof(scene_mesh_record));
+		file_out.write(reinterpret_cast<const char*>(records.objects.data()), records.objects.size() * sizeof(scene_mesh_record));
+		file_out.write(reinterpret_cast<const char*>(records.instances.data()), records.instances.size() * sizeof(scene_instance_record));
+		file_out.write(reinterpret_cast<const char*>(records.quads.data()), records.quads.size() * sizeof(scene_quad_record));
+		// closed here so a failure to flush the end of it counts too
+		file_out.close();
+		if (!file_out) {
+			std::remove(tmp_path.c_str());
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tmp_path, path, error);
+	if (error)
+		std::remove(tmp_path.c_str());
+	return !error;
+}
+
+// Loads the scene at path into out, from its binary cache when that's up to date. from_cache
+// says which way it went. Returns false, after saying why on stderr, if the scene can't be loaded.
+bool load_scene(const std::string& path, scene& out, bool& from_cache)
+{
+	std::error_code error;
+	auto source_size = std::filesystem::file_size(path, error);
+	if (error) {
+		std::cerr << "Can't open scene " << path << std::endl;
+		return false;
+	}
+	auto source_time = static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+	std::string cache_path = path + ".cache";
+	auto directory = std::filesystem::path(path).parent_path();
+
+	// the cache is only trusted if it was made from this exact file and is the length its header says
+	mapped_file cache;
+	if (cache.open(cache_path) && cache.size >= sizeof(scene_cache_header)) {
+		scene_cache_header header;
+		std::memcpy(&header, cache.data, sizeof(header));
+		size_t expected = sizeof(header) + header.material_count * sizeof(scene_material_record)
+			+ static_cast<size_t>(header.sphere_count) * sizeof(scene_sphere_record)
+			+ static_cast<size_t>(header.mesh_count) * sizeof(scene_mesh_record)
+			+ static_cast<size_t>(header.object_count) * sizeof(scene_mesh_record)
+			+ static_cast<size_t>(header.instance_count) * sizeof(scene_instance_record)
+			+ static_cast<size_t>(header.quad_count) * sizeof(scene_quad_record);
+		if (std::memcmp(header.magic, scene_cache_magic, sizeof(header.magic)) == 0 && header.source_size == source_size
+			&& header.source_time == source_time && cache.size == expected) {
+			// records follow the header back to back, all 8-byte aligned in a page-aligned mapping
+			auto materials = reinterpret_cast<const scene_material_record*>(cache.data + sizeof(header));
+			auto spheres = reinterpret_cast<const scene_sphere_record*>(materials + header.material_count);
+			auto meshes = reinterpret_cast<const scene_mesh_record*>(spheres + header.sphere_count);
+			auto objects = meshes + header.mesh_count;
+			auto instances = reinterpret_cast<const scene_instance_record*>(objects + header.object_count);
+			auto quads = reinterpret_cast<const scene_quad_record*>(instances + header.instance_count);
+			bool valid = true;
+			for (uint32_t i = 0; i < header.material_count && valid; ++i)
+				valid = materials[i].kind <= static_cast<uint32_t>(material_kind::emissive);
+			for (uint32_t i = 0; i < header.sphere_count && valid; ++i)
+				valid = spheres[i].material < header.material_count;
+			for (uint32_t i = 0; i < header.mesh_count && valid; ++i)
+				valid = meshes[i].material < header.material_count && std::memchr(meshes[i].path, 0, sizeof(meshes[i].path));
+			for (uint32_t i = 0; i < header.object_count && valid; ++i)
+				valid = std::memchr(objects[i].path, 0, sizeof(objects[i].path)) != nullptr;
+			for (uint32_t i = 0; i < header.instance_count && valid; ++i)
+				valid = instances[i].object < header.object_count && instances[i].material < header.material_count;
+			for (uint32_t i = 0; i < header.quad_count && valid; ++i)
+				valid = quads[i].material < header.material_count;
+			if (valid) {
+				const double* c = header.camera;
+				scene_record_arrays arrays = { camera_settings(), materials, header.material_count, spheres, header.sphere_count,
+					meshes, header.mesh_count, objects, header.object_count, instances, header.instance_count, quads, header.quad_count,
+					header.has_background != 0, { header.background[0], header.background[1], header.background[2] } };
+				arrays.view.lookfrom = point3(c[0], c[1], c[2]);
+				arrays.view.lookat = point3(c[3], c[4], c[5]);
+				arrays.view.vup = vec3(c[6], c[7], c[8]);
+				arrays.view.vfov = static_cast<real>(c[9]);
+				arrays.view.aperture = static_cast<real>(c[10]);
+				arrays.view.focus_distance = static_cast<real>(c[11]);
+				from_cache = true;
+				return build_scene(out, arrays, directory);
+			}
+		}
+	}
+	cache.close();
+
+	mapped_file text;
+	scene_records records;
+	if (source_size > 0) {
+		if (!text.open(path)) {
+			std::cerr << "Can't open scene " << path << std::endl;
+			return false;
+		}
+		if (!parse_scene_text(text.data, text.size, path, records))
+			return false;
+	}
+	from_cache = false;
+	if (!build_scene(out, scene_arrays(records), directory))
+		return false;
+
+	scene_cache_header header = {};
+	std::memcpy(header.magic, scene_cache_magic, sizeof(header.magic));
+	header.source_size = source_size;
+	header.source_time = source_time;
+	header.material_count = static_cast<uint32_t>(records.materials.size());
+	header.sphere_count = static_cast<uint32_t>(records.spheres.size());
+	header.mesh_count = static_cast<uint32_t>(records.meshes.size());
+	header.object_count = static_cast<uint32_t>(records.objects.size());
+	header.instance_count = static_cast<uint32_t>(records.instances.size());
+	header.quad_count = static_cast<uint32_t>(records.quads.size());
+	header.has_background = records.has_background;
+	std::memcpy(header.background, records.background, sizeof(header.background));
+	const camera_settings& v = records.view;
+	double camera[12] = { v.lookfrom.x(), v.lookfrom.y(), v.lookfrom.z(), v.lookat.x(), v.lookat.y(), v.lookat.z(),
+		v.vup.x(), v.vup.y(), v.vup.z(), v.vfov, v.aperture, v.focus_distance };
+	std::memcpy(header.camera, camera, sizeof(camera));
+	// a missing cache only costs the next load a parse, so failing to write one isn't an error
+	if (!write_scene_cache(cache_path, header, records))
+		std::cerr << "Couldn't write scene cache " << cache_path << std::endl;
+	return true;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+
+#include "material.h"
+#include "quad.h"
+#include "scene.h"
+#include "sphere.h"
+
+#include <cmath>
+#include <vector>
+
+// the final scene from the first book, draws from the calling thread's rng so seed it first
+scene random_scene()
+{
+	scene world;
+
+    auto ground_material = world.make_material<lambertian>(colour(0.5, 0.5, 0.5));
+    world.add<sphere>(point3(0,-1000,0), 1000, ground_material);
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                const material* sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = colour::random() * colour::random();
+                    sphere_material = world.make_material<lambertian>(albedo);
+                    world.add<sphere>(center, 0.2, sphere_material);
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = colour::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = world.make_material<metal>(albedo, fuzz);
+                    world.add<sphere>(center, 0.2, sphere_material);
+                } else {
+                    // glass
+                    sphere_material = world.make_material<dielectric>(1.5);
+                    world.add<sphere>(center, 0.2, sphere_material);
+                }
+            }
+        }
+    }
+
+	auto material1 = world.make_material<dielectric>(1.5);
+    world.add<sphere>(point3(0, 1, 0), 1.0, material1);
+
+    auto material2 = world.make_material<lambertian>(colour(0.4, 0.2, 0.1));
+    world.add<sphere>(point3(-4, 1, 0), 1.0, material2);
+
+    auto material3 = world.make_material<metal>(colour(0.7, 0.6, 0.5), 0.0);
+    world.add<sphere>(point3(4, 1, 0), 1.0, material3);
+
+    return world;
+}
+
+// Stress scene: n small spheres strewn over the ground at about the random scene's density, so
+// most of them are out towards the horizon. Materials are shared between spheres.
+scene many_spheres_scene(long long n)
+{
+	scene world;
+	world.world.objects.reserve(n + 1);
+
+	auto ground_material = world.make_material<lambertian>(colour(0.5, 0.5, 0.5));
+	world.add<sphere>(point3(0, -1000, 0), 1000, ground_material);
+
+	std::vector<const material*> materials;
+	for (int i = 0; i < 16; ++i)
+		materials.push_back(world.make_material<lambertian>(colour::random() * colour::random()));
+	for (int i = 0; i < 4; ++i)
+		materials.push_back(world.make_material<metal>(colour::random(0.5, 1), random_double(0, 0.5)));
+	materials.push_back(world.make_material<dielectric>(1.5));
+
+	auto half_extent = 0.5 * std::sqrt(static_cast<double>(n));
+	for (long long i = 0; i < n; ++i) {
+		point3 center(random_double(-half_extent, half_extent), 0.2, random_double(-half_extent, half_extent));
+		world.add<sphere>(center, 0.2, materials[random_int(0, static_cast<int>(materials.size()) - 1)]);
+	}
+	return world;
+}
+
+// the random scene's layout with every sphere made of glass, so nearly every path refracts
+scene glass_scene()
+{
+	scene world;
+
+	auto ground_material = world.make_material<lambertian>(colour(0.5, 0.5, 0.5));
+	world.add<sphere>(point3(0, -1000, 0), 1000, ground_material);
+
+	const material* glass[3] = { world.make_material<dielectric>(1.33), world.make_material<dielectric>(1.5),
+		world.make_material<dielectric>(2.4) };
+	for (int a = -11; a < 11; a++) {
+		for (int b = -11; b < 11; b++) {
+			point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+			if ((center - point3(4, 0.2, 0)).length() > 0.9)
+				world.add<sphere>(center, 0.2, glass[random_int(0, 2)]);
+		}
+	}
+
+	world.add<sphere>(point3(0, 1, 0), 1.0, glass[0]);
+	world.add<sphere>(point3(-4, 1, 0), 1.0, glass[1]);
+	world.add<sphere>(point3(4, 1, 0), 1.0, glass[2]);
+	return world;
+}
+
+// Night-time version of the random scene's three big spheres, lit only by a small, bright
+// sphere and a dim panel overhead. Nearly all of the light comes from something a path is
+// unlikely to hit by chance, which is where sampling the lights pays off.
+scene lit_scene()
+{
+	scene world;
+	world.lighting.sky = false;
+	world.lighting.background = colour(0, 0, 0);
+
+	auto ground_material = world.make_material<lambertian>(colour(0.5, 0.5, 0.5));
+	world.add<sphere>(point3(0, -1000, 0), 1000, ground_material);
+	world.add<sphere>(point3(0, 1, 0), 1.0, world.make_material<dielectric>(1.5));
+	world.add<sphere>(point3(-4, 1, 0), 1.0, world.make_material<lambertian>(colour(0.4, 0.2, 0.1)));
+	world.add<sphere>(point3(4, 1, 0), 1.0, world.make_material<metal>(colour(0.7, 0.6, 0.5), 0.2));
+	for (int a = -4; a < 4; a++)
+		world.add<sphere>(point3(a + 0.5, 0.2, 2.5), 0.2, world.make_material<lambertian>(colour(0.2 + 0.1 * (a + 4), 0.5, 0.8 - 0.1 * (a + 4))));
+
+	auto bulb = world.add<sphere>(point3(2, 2.5, 2), 0.15, world.make_material<diffuse_light>(colour(60, 50, 40)));
+	world.lighting.lights.add(bulb);
+	// faces down, cross(u, v) points at the ground
+	auto panel = world.add<quad>(point3(-3, 5, -1), vec3(3, 0, 0), vec3(0, 0, 2), world.make_material<diffuse_light>(colour(2, 2, 2.5)));
+	world.lighting.lights.add(panel);
+	return world;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "rtweekend.h"
+
+// how each pixel's samples get turned into colour
+enum class integrator_type
+{
+	recursive, // ray_colour, one path at a time
+	wavefront  // whole tiles of paths advanced a bounce at a time, shaded in batches per material
+};
+
+// where the numbers for each sample's random decisions come from, see sampler.h
+enum class sampler_type
+{
+	independent, // uniform random numbers from the thread's rng
+	sobol,       // scrambled Sobol points
+	blue_noise   // low discrepancy sequences dithered per pixel with a blue noise mask
+};
+
+// pixels across or down, for the image as rendered and once it's upscaled
+const long long max_image_size = 1 << 16;
+
+// what to render, shared read-only by every render thread
+struct render_settings
+{
+	long long image_width = 1280;
+	long long image_height = 720;
+	int samples_per_pixel = 32; // the maximum when sampling adaptively
+	int max_depth = 8;
+	// every pixel's rng is seeded from this, same seed gives the same image
+	uint64_t seed = 0;
+	// progressive renders take samples_per_pixel more samples each pass, every pass draws fresh random numbers
+	uint64_t pass = 0;
+	integrator_type integrator = integrator_type::recursive;
+	sampler_type sampler = sampler_type::sobol;
+	// Adaptive sampling stops a pixel early once it's converged: after at least min_samples, when
+	// the 95% confidence interval of its brightness is within adaptive_error either side, measured
+	// after gamma correction (so 1/255 is about one output level). Recursive integrator only.
+	bool adaptive = false;
+	int min_samples = 8;
+	double adaptive_error = 1.0 / 255.0;
+};
+
+// rng seed for one pixel's samples, every pixel of every pass gets its own stream so the image
+// doesn't depend on how the work is split between threads. Pass 0 matches a plain render.
+inline uint64_t pixel_seed(const render_settings& settings, uint64_t pixel_index)
+{
+	uint64_t s = mix_seed(settings.seed, pixel_index);
+	return settings.pass == 0 ? s : mix_seed(s, settings.pass);
+}
+
+#endif
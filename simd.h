@@ -0,0 +1,122 @@
+#pragma once
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "rtweekend.h"
+
+// Thin wrappers over whichever vector instructions the build targets, in the precision of
+// real. Kernels are written once against these and get 4-16 lanes depending on the build.
+// RT_SIMD is 0 when there's nothing wider than scalar, kernels should fall back to a plain loop.
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#define RT_SIMD 1
+#else
+#define RT_SIMD 0
+#endif
+
+#if defined(__AVX512F__) && defined(RT_USE_FLOAT)
+
+using simd_real = __m512;
+using simd_mask = __mmask16;
+const int simd_width = 16;
+const char* const simd_name = "AVX-512 (16 x float)";
+
+inline simd_real simd_set1(real x) { return _mm512_set1_ps(x); }
+inline simd_real simd_load(const real* p) { return _mm512_loadu_ps(p); }
+inline void simd_store(real* p, simd_real a) { _mm512_storeu_ps(p, a); }
+inline simd_real simd_lane_index() { return _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0); }
+inline simd_real simd_add(simd_real a, simd_real b) { return _mm512_add_ps(a, b); }
+inline simd_real simd_sub(simd_real a, simd_real b) { return _mm512_sub_ps(a, b); }
+inline simd_real simd_mul(simd_real a, simd_real b) { return _mm512_mul_ps(a, b); }
+inline simd_real simd_div(simd_real a, simd_real b) { return _mm512_div_ps(a, b); }
+inline simd_real simd_max(simd_real a, simd_real b) { return _mm512_max_ps(a, b); }
+inline simd_real simd_sqrt(simd_real a) { return _mm512_sqrt_ps(a); }
+inline simd_mask simd_ge(simd_real a, simd_real b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+inline simd_mask simd_le(simd_real a, simd_real b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+inline simd_mask simd_and(simd_mask a, simd_mask b) { return a & b; }
+inline simd_mask simd_or(simd_mask a, simd_mask b) { return a | b; }
+inline simd_real simd_blend(simd_mask m, simd_real if_false, simd_real if_true) { return _mm512_mask_blend_ps(m, if_false, if_true); }
+inline int simd_mask_bits(simd_mask m) { return static_cast<int>(m); }
+
+#elif defined(__AVX512F__)
+
+using simd_real = __m512d;
+using simd_mask = __mmask8;
+const int simd_width = 8;
+const char* const simd_name = "AVX-512 (8 x double)";
+
+inline simd_real simd_set1(real x) { return _mm512_set1_pd(x); }
+inline simd_real simd_load(const real* p) { return _mm512_loadu_pd(p); }
+inline void simd_store(real* p, simd_real a) { _mm512_storeu_pd(p, a); }
+inline simd_real simd_lane_index() { return _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0); }
+inline simd_real simd_add(simd_real a, simd_real b) { return _mm512_add_pd(a, b); }
+inline simd_real simd_sub(simd_real a, simd_real b) { return _mm512_sub_pd(a, b); }
+inline simd_real simd_mul(simd_real a, simd_real b) { return _mm512_mul_pd(a, b); }
+inline simd_real simd_div(simd_real a, simd_real b) { return _mm512_div_pd(a, b); }
+inline simd_real simd_max(simd_real a, simd_real b) { return _mm512_max_pd(a, b); }
+inline simd_real simd_sqrt(simd_real a) { return _mm512_sqrt_pd(a); }
+inline simd_mask simd_ge(simd_real a, simd_real b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+inline simd_mask simd_le(simd_real a, simd_real b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+inline simd_mask simd_and(simd_mask a, simd_mask b) { return a & b; }
+inline simd_mask simd_or(simd_mask a, simd_mask b) { return a | b; }
+inline simd_real simd_blend(simd_mask m, simd_real if_false, simd_real if_true) { return _mm512_mask_blend_pd(m, if_false, if_true); }
+inline int simd_mask_bits(simd_mask m) { return static_cast<int>(m); }
+
+#elif defined(__AVX__) && defined(RT_USE_FLOAT)
+
+using simd_real = __m256;
+using simd_mask = __m256;
+const int simd_width = 8;
+const char* const simd_name = "AVX (8 x float)";
+
+inline simd_real simd_set1(real x) { return _mm256_set1_ps(x); }
+inline simd_real simd_load(const real* p) { return _mm256_loadu_ps(p); }
+inline void simd_store(real* p, simd_real a) { _mm256_storeu_ps(p, a); }
+inline simd_real simd_lane_index() { return _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0); }
+inline simd_real simd_add(simd_real a, simd_real b) { return _mm256_add_ps(a, b); }
+inline simd_real simd_sub(simd_real a, simd_real b) { return _mm256_sub_ps(a, b); }
+inline simd_real simd_mul(simd_real a, simd_real b) { return _mm256_mul_ps(a, b); }
+inline simd_real simd_div(simd_real a, simd_real b) { return _mm256_div_ps(a, b); }
+inline simd_real simd_max(simd_real a, simd_real b) { return _mm256_max_ps(a, b); }
+inline simd_real simd_sqrt(simd_real a) { return _mm256_sqrt_ps(a); }
+inline simd_mask simd_ge(simd_real a, simd_real b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline simd_mask simd_le(simd_real a, simd_real b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline simd_mask simd_and(simd_mask a, simd_mask b) { return _mm256_and_ps(a, b); }
+inline simd_mask simd_or(simd_mask a, simd_mask b) { return _mm256_or_ps(a, b); }
+inline simd_real simd_blend(simd_mask m, simd_real if_false, simd_real if_true) { return _mm256_blendv_ps(if_false, if_true, m); }
+inline int simd_mask_bits(simd_mask m) { return _mm256_movemask_ps(m); }
+
+#elif defined(__AVX__)
+
+using simd_real = __m256d;
+using simd_mask = __m256d;
+const int simd_width = 4;
+const char* const simd_name = "AVX (4 x double)";
+
+inline simd_real simd_set1(real x) { return _mm256_set1_pd(x); }
+inline simd_real simd_load(const real* p) { return _mm256_loadu_pd(p); }
+inline void simd_store(real* p, simd_real a) { _mm256_storeu_pd(p, a); }
+inline simd_real simd_lane_index() { return _mm256_set_pd(3, 2, 1, 0); }
+inline simd_real simd_add(simd_real a, simd_real b) { return _mm256_add_pd(a, b); }
+inline simd_real simd_sub(simd_real a, simd_real b) { return _mm256_sub_pd(a, b); }
+inline simd_real simd_mul(simd_real a, simd_real b) { return _mm256_mul_pd(a, b); }
+inline simd_real simd_div(simd_real a, simd_real b) { return _mm256_div_pd(a, b); }
+inline simd_real simd_max(simd_real a, simd_real b) { return _mm256_max_pd(a, b); }
+inline simd_real simd_sqrt(simd_real a) { return _mm256_sqrt_pd(a); }
+inline simd_mask simd_ge(simd_real a, simd_real b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+inline simd_mask simd_le(simd_real a, simd_real b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+inline simd_mask simd_and(simd_mask a, simd_mask b) { return _mm256_and_pd(a, b); }
+inline simd_mask simd_or(simd_mask a, simd_mask b) { return _mm256_or_pd(a, b); }
+inline simd_real simd_blend(simd_mask m, simd_real if_false, simd_real if_true) { return _mm256_blendv_pd(if_false, if_true, m); }
+inline int simd_mask_bits(simd_mask m) { return _mm256_movemask_pd(m); }
+
+#else
+
+const int simd_width = 1;
+const char* const simd_name = "scalar";
+
+#endif
+
+#endif
@@ -4,36 +4,60 @@
 #define SPHERE_H
 
 #include "hittable.h"
+#include "sampler.h"
+#include "sampling.h"
+#include "stats.h"
 #include "vec3.h"
 
+#include <algorithm>
+#include <cmath>
+
 class sphere : public hittable
 {
 public:
 	point3 origin;
-	double radius;
-	shared_ptr<material> mat_ptr;
+	real radius;
+	const material* mat_ptr;
 
 public:
-	sphere() : origin(point3(0,0,-1)), radius(0.5) {}
-	sphere(point3 orig, double r, shared_ptr<material> mp) : origin(orig), radius(r), mat_ptr(mp) {}
+	sphere() : origin(point3(0,0,-1)), radius(0.5), mat_ptr(nullptr) {}
+	sphere(point3 orig, real r, const material* mp) : origin(orig), radius(r), mat_ptr(mp) {}
 
-	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+	// samples the cone of directions the sphere covers from origin, uniformly by solid angle
+	virtual real pdf_value(const point3& o, const vec3& direction) const override;
+	virtual vec3 random(const point3& o) const override;
 };
 
-bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const
+bool sphere::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
 {
+	// Numerically robust form (Ray Tracing Gems, ch. 7). The discriminant comes from how close
+	// the ray passes to the centre rather than b^2 - 4ac, and the nearer root is derived from the
+	// farther one, so neither cancels catastrophically. Double precision barely notices, but a
+	// float build can't resolve the 1000 unit ground sphere without it.
+	RT_COUNT(primitive_tests, 1);
 	vec3 o_c = r.origin() - origin;
 	auto a = dot(r.direction(), r.direction());
-	auto b = 2.0 * dot(r.direction(), o_c);
+	auto half_b = dot(r.direction(), o_c);
 	auto c = dot(o_c, o_c) - (radius * radius);
-	auto discriminant = b * b - 4 * a * c;
+	vec3 closest_approach = o_c - (half_b / a) * r.direction();
+	auto discriminant = a * (radius * radius - dot(closest_approach, closest_approach));
 
 	if (discriminant < 0)
 		return false;
 
-	auto root = (-b - std::sqrt(discriminant)) / (2.0 * a);
+	auto q = -half_b - std::copysign(std::sqrt(discriminant), half_b);
+	if (q == 0)
+		return false;
+	auto near_root = c / q;
+	auto far_root = q / a;
+	if (near_root > far_root)
+		std::swap(near_root, far_root);
+
+	auto root = near_root;
 	if (root < t_min || root > t_max) {
-		root = (-b + std::sqrt(discriminant)) / (2.0 * a);
+		root = far_root;
 		if (root < t_min || root > t_max) {
 			return false;
 		}
@@ -44,8 +68,39 @@ bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) cons
 	vec3 outward_normal = (rec.p - origin) / radius;
 	rec.set_face_normal(r, outward_normal);
 	rec.mat_ptr = mat_ptr;
+	RT_COUNT(primitive_hits, 1);
 
 	return true;
 }
 
+bool sphere::bounding_box(aabb& output_box) const
+{
+	output_box = aabb(origin - vec3(radius, radius, radius), origin + vec3(radius, radius, radius));
+	return true;
+}
+
+real sphere::pdf_value(const point3& o, const vec3& direction) const
+{
+	auto distance_squared = (origin - o).length_squared();
+	if (distance_squared <= radius * radius)
+		return 0;
+	// only whether the direction is in the cone matters, not where it lands on the sphere
+	vec3 d = unit_vector(direction);
+	auto along = dot(origin - o, d);
+	if (along <= 0 || distance_squared - along * along > radius * radius)
+		return 0;
+	return uniform_cone_pdf(std::sqrt(1 - radius * radius / distance_squared));
+}
+
+vec3 sphere::random(const point3& o) const
+{
+	vec3 to_centre = origin - o;
+	auto distance_squared = to_centre.length_squared();
+	sample2 s = sample_2d();
+	if (distance_squared <= radius * radius)
+		return sample_uniform_sphere(s.u, s.v);
+	auto cos_theta_max = std::sqrt(1 - radius * radius / distance_squared);
+	return local_to_world(sample_uniform_cone(s.u, s.v, cos_theta_max), to_centre / std::sqrt(distance_squared));
+}
+
 #endif
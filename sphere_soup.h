@@ -0,0 +1,198 @@
+#pragma once
+
+#ifndef SPHERE_SOUP_H
+#define SPHERE_SOUP_H
+
+#include "rtweekend.h"
+
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "scene.h"
+#include "simd.h"
+#include "stats.h"
+#include "sphere.h"
+
+#include <bitset>
+#include <vector>
+
+// Many spheres stored as structure-of-arrays, so one ray can be tested against several
+// spheres at once with whatever SIMD the build targets (see simd.h), scalar otherwise.
+// Meant to hold a handful of spatially close spheres, e.g. the contents of one BVH leaf.
+class sphere_soup : public hittable
+{
+public:
+	std::vector<real> center_x, center_y, center_z;
+	std::vector<real> radius;
+	std::vector<real> radius_squared;
+	std::vector<uint32_t> mat_index;
+	std::vector<const material*> materials; // each distinct material once
+
+public:
+	sphere_soup() {}
+
+	void add(const point3& center, real r, const material* mat);
+	size_t size() const { return radius.size(); }
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+
+private:
+	aabb box;
+};
+
+void sphere_soup::add(const point3& center, real r, const material* mat)
+{
+	center_x.push_back(center.x());
+	center_y.push_back(center.y());
+	center_z.push_back(center.z());
+	radius.push_back(r);
+	radius_squared.push_back(r * r);
+
+	// soups are small so a linear search for the material is fine
+	uint32_t m = 0;
+	while (m < materials.size() && materials[m] != mat)
+		m++;
+	if (m == materials.size())
+		materials.push_back(mat);
+	mat_index.push_back(m);
+
+	box.expand(aabb(center - vec3(r, r, r), center + vec3(r, r, r)));
+}
+
+bool sphere_soup::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	const vec3 d = r.direction();
+	const point3 o = r.origin();
+	const real inv_a = 1 / dot(d, d);
+	const size_t n = size();
+	RT_COUNT(primitive_tests, n);
+
+	// Same robust maths as sphere::hit with everything divided through by a, so the roots are
+	// -half_b/a +- sqrt((r^2 - |closest approach|^2) / a). Only the closest t and its index are tracked.
+	real closest = t_max;
+	long long best = -1;
+	size_t i = 0;
+
+#if RT_SIMD
+	{
+		const simd_real ox = simd_set1(o.x()), oy = simd_set1(o.y()), oz = simd_set1(o.z());
+		const simd_real dx = simd_set1(d.x()), dy = simd_set1(d.y()), dz = simd_set1(d.z());
+		const simd_real a_inv = simd_set1(inv_a), t_lo = simd_set1(t_min), zero = simd_set1(0);
+		const simd_real step = simd_set1(static_cast<real>(simd_width));
+		simd_real best_t = simd_set1(t_max);
+		simd_real best_i = simd_set1(-1);
+		simd_real lane_i = simd_lane_index();
+		for (; i + simd_width <= n; i += simd_width) {
+			simd_real ocx = simd_sub(ox, simd_load(&center_x[i]));
+			simd_real ocy = simd_sub(oy, simd_load(&center_y[i]));
+			simd_real ocz = simd_sub(oz, simd_load(&center_z[i]));
+			simd_real hb = simd_mul(simd_add(simd_add(simd_mul(ocx, dx), simd_mul(ocy, dy)), simd_mul(ocz, dz)), a_inv);
+			simd_real px = simd_sub(ocx, simd_mul(hb, dx));
+			simd_real py = simd_sub(ocy, simd_mul(hb, dy));
+			simd_real pz = simd_sub(ocz, simd_mul(hb, dz));
+			simd_real dist2 = simd_add(simd_add(simd_mul(px, px), simd_mul(py, py)), simd_mul(pz, pz));
+			simd_real disc = simd_mul(simd_sub(simd_load(&radius_squared[i]), dist2), a_inv);
+			simd_mask real_roots = simd_ge(disc, zero);
+			simd_real sqrtd = simd_sqrt(simd_max(disc, zero));
+			simd_real t0 = simd_sub(simd_sub(zero, hb), sqrtd);
+			simd_real t1 = simd_add(simd_sub(zero, hb), sqrtd);
+			simd_mask ok0 = simd_and(simd_ge(t0, t_lo), simd_le(t0, best_t));
+			simd_mask ok1 = simd_and(simd_ge(t1, t_lo), simd_le(t1, best_t));
+			simd_mask ok = simd_and(simd_or(ok0, ok1), real_roots);
+			RT_COUNT(primitive_hits, std::bitset<simd_width>(simd_mask_bits(ok)).count());
+			best_t = simd_blend(ok, best_t, simd_blend(ok0, t1, t0));
+			best_i = simd_blend(ok, best_i, lane_i);
+			lane_i = simd_add(lane_i, step);
+		}
+		real lanes_t[simd_width], lanes_i[simd_width];
+		simd_store(lanes_t, best_t);
+		simd_store(lanes_i, best_i);
+		for (int k = 0; k < simd_width; ++k) {
+			if (lanes_i[k] >= 0 && lanes_t[k] <= closest) {
+				closest = lanes_t[k];
+				best = static_cast<long long>(lanes_i[k]);
+			}
+		}
+	}
+#endif
+
+	// scalar fallback, also picks up whatever's left over after the SIMD loop
+	for (; i < n; ++i) {
+		real ocx = o.x() - center_x[i], ocy = o.y() - center_y[i], ocz = o.z() - center_z[i];
+		real hb = (ocx * d.x() + ocy * d.y() + ocz * d.z()) * inv_a;
+		real px = ocx - hb * d.x(), py = ocy - hb * d.y(), pz = ocz - hb * d.z();
+		real disc = (radius_squared[i] - (px * px + py * py + pz * pz)) * inv_a;
+		if (disc < 0)
+			continue;
+		real sqrtd = std::sqrt(disc);
+		real root = -hb - sqrtd;
+		if (root < t_min || root > closest) {
+			root = -hb + sqrtd;
+			if (root < t_min || root > closest)
+				continue;
+		}
+		closest = root;
+		best = static_cast<long long>(i);
+		RT_COUNT(primitive_hits, 1);
+	}
+
+	if (best < 0)
+		return false;
+
+	rec.t = closest;
+	rec.p = r.at(rec.t);
+	point3 center(center_x[best], center_y[best], center_z[best]);
+	vec3 outward_normal = (rec.p - center) / radius[best];
+	rec.set_face_normal(r, outward_normal);
+	rec.mat_ptr = materials[mat_index[best]];
+
+	return true;
+}
+
+bool sphere_soup::bounding_box(aabb& output_box) const
+{
+	if (radius.empty())
+		return false;
+
+	output_box = box;
+	return true;
+}
+
+// Groups the spheres in list into soups of up to soup_size spatially close spheres, using the
+// BVH builder to do the grouping. Anything that isn't a sphere is passed through untouched.
+// The soups are owned by owner.
+hittable_list pack_sphere_soups(scene& owner, const hittable_list& list, int soup_size = simd_width > 8 ? simd_width : 8)
+{
+	hittable_list packed;
+	std::vector<const sphere*> spheres;
+	std::vector<aabb> boxes;
+	for (const auto* object : list.objects) {
+		auto s = dynamic_cast<const sphere*>(object);
+		aabb box;
+		if (!s || !s->bounding_box(box)) {
+			packed.add(object);
+			continue;
+		}
+		spheres.push_back(s);
+		boxes.push_back(box);
+	}
+
+	// one SIMD test costs about as much as one scalar test, which pushes the builder towards full leaves
+	bvh_tree grouping;
+	grouping.build(boxes, soup_size, 1.0 / soup_size);
+	for (const auto& node : grouping.nodes) {
+		if (node.count == 0)
+			continue;
+		auto soup = owner.make<sphere_soup>();
+		for (uint32_t k = 0; k < node.count; ++k) {
+			const auto& s = spheres[grouping.prim_indices[node.offset + k]];
+			soup->add(s->origin, s->radius, s->mat_ptr);
+		}
+		packed.add(soup);
+	}
+
+	return packed;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+
+// Hot path counters and timings for benchmarking and profiling. They're only collected in builds
+// that define RT_STATS, otherwise RT_COUNT and RT_STATS_ONLY compile to nothing and every count
+// reads as zero. Each thread counts into its own copy, render_tiles adds each thread's share to
+// its stats and they're merged once the render's done.
+struct render_counters
+{
+	uint64_t primary_rays = 0;    // camera rays
+	uint64_t secondary_rays = 0;  // rays traced after a scatter
+	uint64_t shadow_rays = 0;     // rays aimed at lights
+	uint64_t node_tests = 0;      // BVH node boxes tested, including meshes' own trees
+	uint64_t primitive_tests = 0; // spheres and triangles tested
+	uint64_t primitive_hits = 0;  // tests that found a hit closer than any so far, the rest missed
+	uint64_t escaped_paths = 0;   // paths that left the scene and picked up the sky
+	uint64_t absorbed_paths = 0;  // paths a material didn't scatter
+	uint64_t depth_cutoffs = 0;   // paths still going when they ran out of bounces
+
+	uint64_t rays() const { return primary_rays + secondary_rays + shadow_rays; }
+
+	render_counters& operator+=(const render_counters& other)
+	{
+		primary_rays += other.primary_rays;
+		secondary_rays += other.secondary_rays;
+		shadow_rays += other.shadow_rays;
+		node_tests += other.node_tests;
+		primitive_tests += other.primitive_tests;
+		primitive_hits += other.primitive_hits;
+		escaped_paths += other.escaped_paths;
+		absorbed_paths += other.absorbed_paths;
+		depth_cutoffs += other.depth_cutoffs;
+		return *this;
+	}
+
+	render_counters operator-(const render_counters& other) const
+	{
+		render_counters out = *this;
+		out.primary_rays -= other.primary_rays;
+		out.secondary_rays -= other.secondary_rays;
+		out.shadow_rays -= other.shadow_rays;
+		out.node_tests -= other.node_tests;
+		out.primitive_tests -= other.primitive_tests;
+		out.primitive_hits -= other.primitive_hits;
+		out.escaped_paths -= other.escaped_paths;
+		out.absorbed_paths -= other.absorbed_paths;
+		out.depth_cutoffs -= other.depth_cutoffs;
+		return out;
+	}
+};
+
+// when one thread rendered one tile, for the trace
+struct tile_timing
+{
+	int x0, y0, x1, y1;
+	uint64_t pass;
+	double start, end; // seconds on the high resolution clock
+};
+
+#ifdef RT_STATS
+const bool stats_enabled = true;
+inline thread_local render_counters thread_counters;
+#define RT_COUNT(counter, n) (thread_counters.counter += (n))
+#define RT_STATS_ONLY(...) __VA_ARGS__
+#else
+const bool stats_enabled = false;
+#define RT_COUNT(counter, n) ((void)0)
+#define RT_STATS_ONLY(...)
+#endif
+
+inline double stats_clock_seconds()
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// the calling thread's counts so far
+inline render_counters current_thread_counters()
+{
+#ifdef RT_STATS
+	return thread_counters;
+#else
+	return render_counters();
+#endif
+}
+
+#endif
@@ -0,0 +1,152 @@
+#pragma once
+
+#ifndef TILES_H
+#define TILES_H
+
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// rectangle of pixels [x0, x1) x [y0, y1), the unit of work handed to render threads
+struct tile
+{
+	int x0, y0;
+	int x1, y1;
+
+	int width() const { return x1 - x0; }
+	int height() const { return y1 - y0; }
+};
+
+// order tiles are handed out in
+enum class tile_order
+{
+	scanline,   // row by row
+	hilbert,    // along a hilbert curve, neighbouring tiles render close together in time
+	centre_out  // nearest to the image centre first, the interesting part of the frame shows up first
+};
+
+// hilbert curve index of (x, y) on an n x n grid, n must be a power of two
+inline long long hilbert_index(long long n, long long x, long long y)
+{
+	long long d = 0;
+	for (long long s = n / 2; s > 0; s /= 2) {
+		long long rx = (x & s) > 0;
+		long long ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+		// rotate the quadrant so the curve stays continuous
+		if (ry == 0) {
+			if (rx == 1) {
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+// splits the image into tile_size x tile_size tiles (smaller along the right and top edges)
+std::vector<tile> make_tiles(int image_width, int image_height, int tile_size, tile_order order)
+{
+	int tiles_x = (image_width + tile_size - 1) / tile_size;
+	int tiles_y = (image_height + tile_size - 1) / tile_size;
+
+	std::vector<tile> tiles;
+	tiles.reserve(static_cast<size_t>(tiles_x) * tiles_y);
+	for (int ty = 0; ty < tiles_y; ++ty) {
+		for (int tx = 0; tx < tiles_x; ++tx) {
+			tile t;
+			t.x0 = tx * tile_size;
+			t.y0 = ty * tile_size;
+			t.x1 = std::min(t.x0 + tile_size, image_width);
+			t.y1 = std::min(t.y0 + tile_size, image_height);
+			tiles.push_back(t);
+		}
+	}
+
+	if (order == tile_order::hilbert) {
+		long long n = 1;
+		while (n < tiles_x || n < tiles_y)
+			n *= 2;
+		std::stable_sort(tiles.begin(), tiles.end(), [&](const tile& a, const tile& b) {
+			return hilbert_index(n, a.x0 / tile_size, a.y0 / tile_size) < hilbert_index(n, b.x0 / tile_size, b.y0 / tile_size);
+		});
+	} else if (order == tile_order::centre_out) {
+		auto cx = image_width / 2.0;
+		auto cy = image_height / 2.0;
+		auto dist2 = [&](const tile& t) {
+			auto dx = (t.x0 + t.x1) / 2.0 - cx;
+			auto dy = (t.y0 + t.y1) / 2.0 - cy;
+			return dx * dx + dy * dy;
+		};
+		std::stable_sort(tiles.begin(), tiles.end(), [&](const tile& a, const tile& b) {
+			return dist2(a) < dist2(b);
+		});
+	}
+
+	return tiles;
+}
+
+// Hands tiles out to render threads in order. Claiming a tile is a single atomic increment,
+// so threads that finish early just keep pulling work until the queue runs dry.
+class tile_scheduler
+{
+public:
+	std::vector<tile> tiles;
+
+public:
+	tile_scheduler(std::vector<tile> t) : tiles(std::move(t)), next_tile(0), finished_tiles(0) {}
+
+	bool next(tile& t)
+	{
+		auto i = next_tile.fetch_add(1, std::memory_order_relaxed);
+		if (i >= tiles.size())
+			return false;
+		t = tiles[i];
+		return true;
+	}
+
+	size_t max_tile_pixels() const
+	{
+		size_t largest = 0;
+		for (const tile& t : tiles)
+			largest = std::max(largest, static_cast<size_t>(t.width()) * t.height());
+		return largest;
+	}
+
+	// Render threads call this once a tile is done, anyone can poll remaining() for progress. A
+	// finished tile's pixels are visible to whoever sees it counted.
+	void finished() { finished_tiles.fetch_add(1, std::memory_order_release); }
+	long long remaining() const { return static_cast<long long>(tiles.size() - finished_tiles.load(std::memory_order_acquire)); }
+
+	void reset()
+	{
+		next_tile.store(0);
+		finished_tiles.store(0);
+	}
+
+	// hands out no more tiles this pass, threads finish the ones they have and stop, remaining()
+	// stays above zero so the pass can be told apart from a finished one
+	void cancel() { next_tile.store(tiles.size()); }
+
+private:
+	std::atomic<size_t> next_tile;
+	std::atomic<size_t> finished_tiles;
+};
+
+// per-thread timings, filled in by each render thread and read back after joining
+struct worker_stats
+{
+	long long tiles = 0;
+	double busy_seconds = 0; // time spent rendering tiles
+	double wall_seconds = 0; // time from the render starting to this thread running out of work, summed over passes
+	uint64_t heap_allocations = 0; // made while rendering tiles, should stay at zero
+	render_counters counters;      // this thread's share, only counted with RT_STATS
+	std::vector<tile_timing> tile_times; // every tile this thread rendered, also only with RT_STATS
+};
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "rtweekend.h"
+
+#include "colour.h"
+#include "stats.h"
+#include "tiles.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Writes every tile each thread rendered as a Chrome trace (the JSON event format that
+// chrome://tracing and Perfetto open), one track per thread. Times start from the first tile.
+bool write_chrome_trace(const std::string& path, const std::vector<worker_stats>& stats)
+{
+	std::FILE* file_out = std::fopen(path.c_str(), "w");
+	if (!file_out)
+		return false;
+
+	double origin = 0;
+	bool any = false;
+	for (const auto& s : stats) {
+		for (const auto& t : s.tile_times) {
+			origin = any ? std::min(origin, t.start) : t.start;
+			any = true;
+		}
+	}
+
+	std::fprintf(file_out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t thread = 0; thread < stats.size(); ++thread) {
+		std::fprintf(file_out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%zu,\"args\":{\"name\":\"render thread %zu\"}}",
+			first ? "" : ",\n", thread, thread);
+		first = false;
+		for (const auto& t : stats[thread].tile_times) {
+			std::fprintf(file_out, ",\n{\"name\":\"tile %d,%d\",\"cat\":\"tile\",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f,"
+				"\"args\":{\"x0\":%d,\"y0\":%d,\"x1\":%d,\"y1\":%d,\"pass\":%llu}}",
+				t.x0, t.y0, thread, (t.start - origin) * 1e6, (t.end - t.start) * 1e6, t.x0, t.y0, t.x1, t.y1,
+				static_cast<unsigned long long>(t.pass));
+		}
+	}
+	std::fprintf(file_out, "\n]}\n");
+	return std::fclose(file_out) == 0;
+}
+
+// heatmap of the time spent on each pixel, white at the 99th percentile so a few slow pixels
+// don't flatten the rest
+template <typename Alloc>
+std::vector<float> cost_heatmap(const std::vector<float, Alloc>& cost)
+{
+	if (cost.empty())
+		return {};
+	std::vector<float> sorted(cost.begin(), cost.end());
+	auto high = sorted.begin() + static_cast<long long>((sorted.size() - 1) * 0.99);
+	std::nth_element(sorted.begin(), high, sorted.end());
+	return heatmap(cost, *high > 0 ? *high : 1.0);
+}
+
+#endif
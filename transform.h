@@ -0,0 +1,145 @@
+#pragma once
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+
+#include <cmath>
+
+// 3x4 affine matrix, the rotation/scale part in the first three columns and the translation in
+// the last. Points get the translation, vectors don't.
+class affine_transform
+{
+public:
+	real m[3][4];
+
+public:
+	affine_transform() : m{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } } {}
+
+	static affine_transform translate(const vec3& offset);
+	static affine_transform scale(const vec3& factors);
+	// rotation about axis by angle degrees, anticlockwise looking down the axis
+	static affine_transform rotate(const vec3& axis, real degrees);
+
+	// applies other first, then this
+	affine_transform operator*(const affine_transform& other) const;
+	affine_transform inverse() const;
+
+	point3 apply_point(const point3& p) const
+	{
+		return point3(m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+					  m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+					  m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]);
+	}
+
+	vec3 apply_vector(const vec3& v) const
+	{
+		return vec3(m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+					m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+					m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+	}
+
+	// multiplies by the transpose, on an inverse transform this takes normals the other way
+	vec3 apply_transposed(const vec3& n) const
+	{
+		return vec3(m[0][0] * n[0] + m[1][0] * n[1] + m[2][0] * n[2],
+					m[0][1] * n[0] + m[1][1] * n[1] + m[2][1] * n[2],
+					m[0][2] * n[0] + m[1][2] * n[1] + m[2][2] * n[2]);
+	}
+
+	// bounds of the transformed box, from all eight corners
+	aabb apply_box(const aabb& box) const;
+};
+
+affine_transform affine_transform::translate(const vec3& offset)
+{
+	affine_transform t;
+	t.m[0][3] = offset.x();
+	t.m[1][3] = offset.y();
+	t.m[2][3] = offset.z();
+	return t;
+}
+
+affine_transform affine_transform::scale(const vec3& factors)
+{
+	affine_transform t;
+	t.m[0][0] = factors.x();
+	t.m[1][1] = factors.y();
+	t.m[2][2] = factors.z();
+	return t;
+}
+
+affine_transform affine_transform::rotate(const vec3& axis, real degrees)
+{
+	// Rodrigues' rotation formula as a matrix
+	vec3 a = unit_vector(axis);
+	real theta = degrees_to_radians(degrees);
+	real c = std::cos(theta), s = std::sin(theta), k = 1 - c;
+	affine_transform t;
+	t.m[0][0] = c + a.x() * a.x() * k;
+	t.m[0][1] = a.x() * a.y() * k - a.z() * s;
+	t.m[0][2] = a.x() * a.z() * k + a.y() * s;
+	t.m[1][0] = a.y() * a.x() * k + a.z() * s;
+	t.m[1][1] = c + a.y() * a.y() * k;
+	t.m[1][2] = a.y() * a.z() * k - a.x() * s;
+	t.m[2][0] = a.z() * a.x() * k - a.y() * s;
+	t.m[2][1] = a.z() * a.y() * k + a.x() * s;
+	t.m[2][2] = c + a.z() * a.z() * k;
+	return t;
+}
+
+affine_transform affine_transform::operator*(const affine_transform& other) const
+{
+	affine_transform t;
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			t.m[i][j] = m[i][0] * other.m[0][j] + m[i][1] * other.m[1][j] + m[i][2] * other.m[2][j];
+			if (j == 3)
+				t.m[i][j] += m[i][3];
+		}
+	}
+	return t;
+}
+
+affine_transform affine_transform::inverse() const
+{
+	// inverse of the 3x3 part from its cofactors, then undo the translation
+	real c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	real c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	real c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	real det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+	real inv_det = 1 / det;
+
+	affine_transform t;
+	t.m[0][0] = c00 * inv_det;
+	t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+	t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+	t.m[1][0] = c01 * inv_det;
+	t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+	t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+	t.m[2][0] = c02 * inv_det;
+	t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+	t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+	vec3 offset = t.apply_vector(vec3(m[0][3], m[1][3], m[2][3]));
+	t.m[0][3] = -offset.x();
+	t.m[1][3] = -offset.y();
+	t.m[2][3] = -offset.z();
+	return t;
+}
+
+aabb affine_transform::apply_box(const aabb& box) const
+{
+	aabb out;
+	for (int corner = 0; corner < 8; ++corner) {
+		point3 p((corner & 1) ? box.maximum.x() : box.minimum.x(),
+				 (corner & 2) ? box.maximum.y() : box.minimum.y(),
+				 (corner & 4) ? box.maximum.z() : box.minimum.z());
+		out.expand(apply_point(p));
+	}
+	return out;
+}
+
+#endif
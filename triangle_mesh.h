@@ -0,0 +1,159 @@
+#pragma once
+
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "stats.h"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// Indexed triangles in flat arrays with their own BVH, so a mesh of any size is a single object
+// to the scene's BVH. Triangles are stored in tree order once build() has run.
+class triangle_mesh : public hittable
+{
+public:
+	std::vector<point3> positions;
+	std::vector<vec3> normals;             // optional per-vertex normals for smooth shading
+	std::vector<uint32_t> indices;         // 3 positions per triangle
+	std::vector<uint32_t> normal_indices;  // 3 normals per triangle, or no_normal for a flat triangle; empty if there are no normals
+	const material* mat_ptr = nullptr;
+	bvh_tree tree;
+
+	static constexpr uint32_t no_normal = 0xffffffff;
+
+public:
+	triangle_mesh() {}
+
+	size_t triangle_count() const { return indices.size() / 3; }
+
+	// call once the mesh is filled in, before rendering
+	void build(int max_leaf_size = 4);
+
+	virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+};
+
+void triangle_mesh::build(int max_leaf_size)
+{
+	size_t n = triangle_count();
+	std::vector<aabb> boxes(n);
+	for (size_t i = 0; i < n; ++i) {
+		boxes[i].expand(positions[indices[3 * i]]);
+		boxes[i].expand(positions[indices[3 * i + 1]]);
+		boxes[i].expand(positions[indices[3 * i + 2]]);
+	}
+	tree.build(boxes, max_leaf_size);
+
+	// reorder the triangles to match the leaves, so a leaf slot is a triangle index
+	std::vector<uint32_t> ordered(indices.size());
+	std::vector<uint32_t> ordered_normals(normal_indices.size());
+	for (size_t slot = 0; slot < n; ++slot) {
+		size_t tri = tree.prim_indices[slot];
+		for (int k = 0; k < 3; ++k) {
+			ordered[3 * slot + k] = indices[3 * tri + k];
+			if (!normal_indices.empty())
+				ordered_normals[3 * slot + k] = normal_indices[3 * tri + k];
+		}
+	}
+	indices = std::move(ordered);
+	normal_indices = std::move(ordered_normals);
+}
+
+bool triangle_mesh::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+	// Watertight ray/triangle test (Woop, Benthin and Wald 2013). Vertices are moved into a space
+	// where the ray runs along +z from the origin, so edge tests are 2D and neighbouring
+	// triangles agree exactly about which side of a shared edge the ray passes.
+	const point3 o = r.origin();
+	const vec3 d = r.direction();
+	int kz = std::fabs(d.x()) > std::fabs(d.y()) ? (std::fabs(d.x()) > std::fabs(d.z()) ? 0 : 2) : (std::fabs(d.y()) > std::fabs(d.z()) ? 1 : 2);
+	int kx = kz == 2 ? 0 : kz + 1;
+	int ky = kx == 2 ? 0 : kx + 1;
+	// keep the winding the same when the dominant direction is negative
+	if (d[kz] < 0)
+		std::swap(kx, ky);
+	const real sz = 1 / d[kz];
+	const real sx = d[kx] * sz;
+	const real sy = d[ky] * sz;
+
+	long long best = -1;
+	real best_u = 0, best_v = 0;
+	real closest = t_max;
+	tree.traverse(r, t_min, closest, [&](uint32_t tri, real& closest_so_far) {
+		RT_COUNT(primitive_tests, 1);
+		const vec3 a = positions[indices[3 * tri]] - o;
+		const vec3 b = positions[indices[3 * tri + 1]] - o;
+		const vec3 c = positions[indices[3 * tri + 2]] - o;
+		const real ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+		const real bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+		const real cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
+
+		// scaled barycentrics, the ray misses unless all three have the same sign
+		real u = cx * by - cy * bx;
+		real v = ax * cy - ay * cx;
+		real w = bx * ay - by * ax;
+#ifdef RT_USE_FLOAT
+		// exactly on an edge in float, redo it in double so the shared edge is decided consistently
+		if (u == 0 || v == 0 || w == 0) {
+			u = static_cast<real>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+			v = static_cast<real>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+			w = static_cast<real>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+		}
+#endif
+		if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+			return;
+		real det = u + v + w;
+		if (det == 0)
+			return;
+
+		real t = (u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz]) / det;
+		if (t < t_min || t > closest_so_far)
+			return;
+
+		closest_so_far = t;
+		best = tri;
+		RT_COUNT(primitive_hits, 1);
+		// weights of vertices b and c, a's is whatever's left
+		best_u = v / det;
+		best_v = w / det;
+	});
+
+	if (best < 0)
+		return false;
+
+	const point3& p0 = positions[indices[3 * best]];
+	const point3& p1 = positions[indices[3 * best + 1]];
+	const point3& p2 = positions[indices[3 * best + 2]];
+	rec.t = closest;
+	rec.p = r.at(rec.t);
+	vec3 geometric_normal = unit_vector(cross(p1 - p0, p2 - p0));
+	rec.set_face_normal(r, geometric_normal);
+
+	if (!normal_indices.empty() && normal_indices[3 * best] != no_normal) {
+		vec3 shading_normal = unit_vector((1 - best_u - best_v) * normals[normal_indices[3 * best]]
+			+ best_u * normals[normal_indices[3 * best + 1]] + best_v * normals[normal_indices[3 * best + 2]]);
+		// keep the interpolated normal on the side the ray arrived from, like the geometric one
+		rec.normal = dot(shading_normal, rec.normal) < 0 ? -shading_normal : shading_normal;
+	}
+	rec.mat_ptr = mat_ptr;
+
+	return true;
+}
+
+bool triangle_mesh::bounding_box(aabb& output_box) const
+{
+	if (tree.nodes.empty())
+		return false;
+
+	output_box = tree.nodes[0].box;
+	return true;
+}
+
+#endif
@@ -9,19 +9,19 @@
 class vec3
 {
 public:
-	double e[3];
+	real e[3];
 
 public:
 	vec3() : e{ 0,0,0 } {}
-	vec3(double e0, double e1, double e2) : e{ e0, e1, e2 } {}
+	vec3(real e0, real e1, real e2) : e{ e0, e1, e2 } {}
 
-	double x() const { return e[0]; }
-	double y() const { return e[1]; }
-	double z() const { return e[2]; }
+	real x() const { return e[0]; }
+	real y() const { return e[1]; }
+	real z() const { return e[2]; }
 
 	vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-	double operator[](int i) const { return e[i]; }
-	double& operator[](int i) { return e[i]; }
+	real operator[](int i) const { return e[i]; }
+	real& operator[](int i) { return e[i]; }
 
 	vec3& operator+=(const vec3& v)
 	{
@@ -31,7 +31,7 @@ public:
 		return *this;
 	}
 
-	vec3& operator*=(const double t)
+	vec3& operator*=(const real t)
 	{
 		e[0] *= t;
 		e[1] *= t;
@@ -39,17 +39,17 @@ public:
 		return *this;
 	}
 
-	vec3& operator/=(const double t)
+	vec3& operator/=(const real t)
 	{
 		return *this *= (1 / t);
 	}
 
-	double length() const
+	real length() const
 	{
 		return std::sqrt(length_squared());
 	}
 
-	double length_squared() const
+	real length_squared() const
 	{
 		return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
 	}
@@ -66,7 +66,7 @@ public:
 		return vec3(random_double(), random_double(), random_double());
 	}
 
-	inline static vec3 random(double min, double max)
+	inline static vec3 random(real min, real max)
 	{
 		return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
 	}
@@ -97,22 +97,22 @@ inline vec3 operator*(const vec3& u, const vec3& v)
 	return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(const vec3& v, const double t)
+inline vec3 operator*(const vec3& v, const real t)
 {
 	return vec3(v.e[0] * t, v.e[1] * t, v.e[2] * t);
 }
 
-inline vec3 operator*(const double t,const vec3& v)
+inline vec3 operator*(const real t,const vec3& v)
 {
 	return v * t;
 }
 
-inline vec3 operator/(const vec3& v, const double t)
+inline vec3 operator/(const vec3& v, const real t)
 {
 	return v * (1 / t);
 }
 
-inline double dot(const vec3& u, const vec3& v)
+inline real dot(const vec3& u, const vec3& v)
 {
 	return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
 }
@@ -129,37 +129,15 @@ inline vec3 unit_vector(vec3 v)
 	return v / v.length();
 }
 
-vec3 random_in_unit_sphere()
+// two unit vectors that make an orthonormal basis with unit vector w (Duff et al. 2017, no
+// branches on w's largest axis), for turning directions sampled around +z into world space
+inline void orthonormal_basis(const vec3& w, vec3& u, vec3& v)
 {
-	while (true) {
-		auto p = vec3::random(-1, 1);
-		if (p.length_squared() < 1)
-			return p;
-	}
-}
-
-vec3 random_unit_vector()
-{
-	return unit_vector(random_in_unit_sphere());
-}
-
-vec3 random_in_hemisphere(const vec3& normal)
-{
-	vec3 in_unit_sphere = random_in_unit_sphere();
-	if (dot(in_unit_sphere, normal) > 0.0) // in the same hemisphere as the normal
-		return in_unit_sphere;
-	else
-		return -in_unit_sphere;
-}
-
-vec3 random_in_unit_disk()
-{
-	// generate a random vector in unit disk with rejection algorithm
-	while (true) {
-		auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
-		if (p.length_squared() <= 1)
-			return p;
-	}
+	real sign = std::copysign(static_cast<real>(1), w.z());
+	real a = -1 / (sign + w.z());
+	real b = w.x() * w.y() * a;
+	u = vec3(1 + sign * w.x() * w.x() * a, sign * b, -sign * w.x());
+	v = vec3(b, sign + w.y() * w.y() * a, -w.y());
 }
 
 vec3 reflect(const vec3& v, const vec3& n)
@@ -167,7 +145,7 @@ vec3 reflect(const vec3& v, const vec3& n)
 	return v - 2 * dot(v, n) * n;
 }
 
-vec3 refract(const vec3& uv, const vec3& n, double eta_over_etaprime)
+vec3 refract(const vec3& uv, const vec3& n, real eta_over_etaprime)
 {
 	auto cos_theta = fmin(dot(-uv, n), 1.0);
 	vec3 r_out_perp = eta_over_etaprime * (uv + cos_theta * n);
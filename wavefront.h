@@ -0,0 +1,345 @@
+#pragma once
+
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "rtweekend.h"
+
+#include "accumulation.h"
+#include "arena.h"
+#include "camera.h"
+#include "colour.h"
+#include "hittable.h"
+#include "integrator.h"
+#include "lighting.h"
+#include "material.h"
+#include "sampler.h"
+#include "settings.h"
+#include "stats.h"
+#include "tiles.h"
+
+#include <algorithm>
+#include <memory>
+
+// Paths in flight, stored as structure-of-arrays so each stage streams through only the
+// fields it needs. The arrays live in the owning wavefront_state's arena.
+struct path_queue
+{
+	real* origin_x, * origin_y, * origin_z;
+	real* dir_x, * dir_y, * dir_z;
+	real* throughput_r, * throughput_g, * throughput_b;
+	real* scatter_pdf; // of the bounce that made the ray, zero for camera rays and specular bounces
+	uint32_t* pixel;   // index into the tile
+	uint32_t* sample;  // index of the pixel's sample, where the path's sampler picks up
+	real* aov_depth;   // distance so far while a camera ray's AOVs follow specular surfaces, negative once they're recorded
+	size_t size = 0;
+
+	static constexpr size_t arrays = 13;
+	static constexpr size_t bytes_per_path = 11 * sizeof(real) + 2 * sizeof(uint32_t);
+
+	void reserve(arena& memory, size_t n)
+	{
+		for (auto** v : { &origin_x, &origin_y, &origin_z, &dir_x, &dir_y, &dir_z, &throughput_r, &throughput_g, &throughput_b, &scatter_pdf, &aov_depth })
+			*v = memory.allocate_array<real>(n);
+		pixel = memory.allocate_array<uint32_t>(n);
+		sample = memory.allocate_array<uint32_t>(n);
+	}
+
+	void push(const ray& r, const colour& throughput, uint32_t pixel_index, uint32_t sample_index, real pdf = 0, real aov = -1)
+	{
+		auto i = size++;
+		origin_x[i] = r.orig.x(); origin_y[i] = r.orig.y(); origin_z[i] = r.orig.z();
+		dir_x[i] = r.dir.x(); dir_y[i] = r.dir.y(); dir_z[i] = r.dir.z();
+		throughput_r[i] = throughput.x(); throughput_g[i] = throughput.y(); throughput_b[i] = throughput.z();
+		scatter_pdf[i] = pdf;
+		pixel[i] = pixel_index;
+		sample[i] = sample_index;
+		aov_depth[i] = aov;
+	}
+
+	ray get_ray(size_t i) const
+	{
+		return ray(point3(origin_x[i], origin_y[i], origin_z[i]), vec3(dir_x[i], dir_y[i], dir_z[i]));
+	}
+
+	colour get_throughput(size_t i) const
+	{
+		return colour(throughput_r[i], throughput_g[i], throughput_b[i]);
+	}
+};
+
+const int n_material_kinds = static_cast<int>(material_kind::other) + 1;
+
+// Most paths a thread keeps in flight, a 32 pixel tile's at 32 samples (about 15 MB of queues
+// in a double build). A tile with more samples than fit is rendered a batch of each pixel's
+// samples at a time, so memory stays put however many samples are asked for.
+const size_t wavefront_path_budget = 32 * 32 * 32;
+
+// samples of each pixel in one batch, at least one however big the tile
+inline int wavefront_batch_samples(size_t n_pixels, int samples_per_pixel)
+{
+	size_t fit = std::max<size_t>(1, wavefront_path_budget / n_pixels);
+	return static_cast<int>(std::min<size_t>(fit, static_cast<size_t>(samples_per_pixel)));
+}
+
+// paths in flight for tiles of up to n_pixels, what wavefront_state::reserve needs for them
+inline size_t wavefront_paths(size_t n_pixels, int samples_per_pixel)
+{
+	return std::max(n_pixels, std::min(wavefront_path_budget, n_pixels * static_cast<size_t>(samples_per_pixel)));
+}
+
+// Per-thread working memory for the wavefront integrator, sized for one batch of a tile's paths
+// and reused for every batch, tile and pass the thread renders. Everything comes out of one
+// scratch arena, so once it's been sized for the biggest tile nothing here touches the heap.
+struct wavefront_state
+{
+	arena scratch;                     // remade by reserve with a chunk that holds everything below
+	path_queue current, next;
+	path_queue shadow;                 // light samples made while shading, traced once every bin's done
+	hit_record* hits = nullptr;        // hit for each path in current, valid where alive
+	uint32_t* by_material = nullptr;   // indices of paths that hit something, grouped by material kind
+	colour* accum = nullptr;           // summed radiance for each of the batch's samples, a pixel's together
+	uint32_t samples_per_pixel = 0;    // of the batch being rendered, and the index of its pixels' first sample
+	uint32_t first_sample = 0;
+	colour* pixel_sums = nullptr;      // each pixel's samples so far, and the sum of their luminances squared
+	real* luminance_squares = nullptr;
+	// with AOVs: summed for each pixel, and each path's when it's following specular surfaces and
+	// the AOVs are only recorded if it stops at this bounce
+	bool aovs = false;
+	first_hit* first_hits = nullptr;
+	first_hit* pending_hits = nullptr;
+	size_t path_capacity = 0;
+	size_t pixel_capacity = 0;
+
+	void reserve(size_t n_paths, size_t n_pixels)
+	{
+		if (n_paths <= path_capacity && n_pixels <= pixel_capacity)
+			return;
+		// the three queues and the per-path and per-pixel arrays, each with room to be aligned
+		const size_t arrays = 3 * path_queue::arrays + 7;
+		size_t bytes = n_paths * (3 * path_queue::bytes_per_path + sizeof(hit_record) + sizeof(uint32_t) + sizeof(first_hit) + sizeof(colour))
+			+ n_pixels * (sizeof(first_hit) + sizeof(colour) + sizeof(real)) + arrays * alignof(std::max_align_t);
+		scratch = arena(bytes);
+		current.reserve(scratch, n_paths);
+		next.reserve(scratch, n_paths);
+		shadow.reserve(scratch, n_paths);
+		hits = scratch.allocate_array<hit_record>(n_paths);
+		std::uninitialized_default_construct_n(hits, n_paths);
+		by_material = scratch.allocate_array<uint32_t>(n_paths);
+		pending_hits = scratch.allocate_array<first_hit>(n_paths);
+		std::uninitialized_default_construct_n(pending_hits, n_paths);
+		accum = scratch.allocate_array<colour>(n_paths);
+		std::uninitialized_default_construct_n(accum, n_paths);
+		first_hits = scratch.allocate_array<first_hit>(n_pixels);
+		std::uninitialized_default_construct_n(first_hits, n_pixels);
+		pixel_sums = scratch.allocate_array<colour>(n_pixels);
+		std::uninitialized_default_construct_n(pixel_sums, n_pixels);
+		luminance_squares = scratch.allocate_array<real>(n_pixels);
+		path_capacity = n_paths;
+		pixel_capacity = n_pixels;
+	}
+
+	// where path i of q adds its radiance
+	colour& sample_radiance(const path_queue& q, size_t i) const
+	{
+		return accum[static_cast<size_t>(q.pixel[i]) * samples_per_pixel + (q.sample[i] - first_sample)];
+	}
+};
+
+// Shades every path in one material group at bounce depth of tile t: adds what the surface gives
+// off, queues a light sample where the material can evaluate its BRDF and sample_lights allows,
+// and scatters. The materials are final, so calls through M go straight to its own functions and
+// can inline, only M = material goes through the vtable.
+template <typename M>
+void shade_batch(const uint32_t* indices, size_t count, wavefront_state& state, const render_settings& settings, const tile& t, int depth,
+	const scene_lighting& lighting, bool sample_lights)
+{
+	const path_queue& in = state.current;
+	for (size_t k = 0; k < count; ++k) {
+		auto i = indices[k];
+		const hit_record& rec = state.hits[i];
+		// pick the path's sample up at this bounce's dimensions
+		thread_sampler.start_pixel(settings, t.x0 + static_cast<int>(in.pixel[i] % t.width()), t.y0 + static_cast<int>(in.pixel[i] / t.width()));
+		thread_sampler.start_sample(in.sample[i]);
+		thread_sampler.start_bounce(depth);
+		const M* mat = static_cast<const M*>(rec.mat_ptr);
+		ray r_in = in.get_ray(i);
+		colour throughput = in.get_throughput(i);
+
+		colour emitted = mat->emitted(r_in, rec);
+		if (!is_black(emitted))
+			state.sample_radiance(in, i) += throughput * emitted * emission_weight(lighting, r_in, in.scatter_pdf[i]);
+
+		ray scattered;
+		colour attenuation;
+		if (mat->scatter(r_in, rec, attenuation, scattered)) {
+			auto pdf = mat->scattering_pdf(r_in, rec, scattered.direction());
+			ray shadow;
+			colour weight;
+			if (pdf > 0 && sample_lights && sample_light(lighting, r_in, rec, shadow, weight))
+				state.shadow.push(shadow, throughput * weight, in.pixel[i], in.sample[i]);
+			state.next.push(scattered, attenuation * throughput, in.pixel[i], in.sample[i], pdf, state.aovs ? state.pending_hits[i].depth : -1);
+		} else {
+			RT_COUNT(absorbed_paths, 1);
+			if (state.aovs && state.pending_hits[i].depth >= 0)
+				state.first_hits[in.pixel[i]].add(state.pending_hits[i]);
+		}
+	}
+}
+
+// Renders a tile by advancing its samples together, as many as wavefront_path_budget allows at
+// a time, one bounce per pass: generate camera rays, intersect, bin by material, shade each bin,
+// compact the survivors.
+// Every path reads the same sampler dimensions as it would in ray_colour, so with the Sobol or
+// blue noise samplers the image is identical. With the independent one the random numbers get
+// consumed in a different order, so it only converges to the same image. Always takes
+// samples_per_pixel samples, adaptive sampling is left to the recursive integrator.
+void render_tile_wavefront(const tile& t, const render_settings& settings, const camera& cam, const hittable& world,
+	const scene_lighting& lighting, accumulation_buffer& accum, wavefront_state& state)
+{
+	RT_STATS_ONLY(double tile_start = stats_clock_seconds();)
+	const size_t n_pixels = static_cast<size_t>(t.width()) * t.height();
+	const int batch_samples = wavefront_batch_samples(n_pixels, settings.samples_per_pixel);
+	state.reserve(n_pixels * batch_samples, n_pixels);
+	const bool aovs = accum.has_aovs();
+	state.aovs = aovs;
+	for (size_t p = 0; p < n_pixels; ++p) {
+		state.first_hits[p] = first_hit();
+		state.pixel_sums[p] = colour(0, 0, 0);
+		state.luminance_squares[p] = 0;
+	}
+
+	// A batch of each pixel's samples at a time, each bounced to the end before the next. The
+	// first batch's rngs are seeded just as the whole tile's were when it was one batch.
+	for (int batch_start = 0; batch_start < settings.samples_per_pixel; batch_start += batch_samples) {
+		const int count = std::min(batch_samples, settings.samples_per_pixel - batch_start);
+		state.samples_per_pixel = static_cast<uint32_t>(count);
+		state.first_sample = static_cast<uint32_t>(settings.pass * settings.samples_per_pixel + batch_start);
+		auto batch_seed = [&](uint64_t seed) { return batch_start == 0 ? seed : mix_seed(seed, static_cast<uint64_t>(batch_start)); };
+
+		// generate camera rays, each pixel's samples seeded just like the recursive integrator
+		state.current.size = 0;
+		for (int j = t.y0; j < t.y1; ++j) {
+			for (int i = t.x0; i < t.x1; ++i) {
+				auto local = static_cast<uint32_t>((j - t.y0) * t.width() + (i - t.x0));
+				seed_rng(batch_seed(pixel_seed(settings, j * settings.image_width + i)));
+				thread_sampler.start_pixel(settings, i, j);
+				for (int s = 0; s < count; ++s) {
+					auto sample_index = state.first_sample + static_cast<uint32_t>(s);
+					thread_sampler.start_sample(sample_index);
+					sample2 jitter = sample_2d();
+					auto u = (i + jitter.u) / (settings.image_width - 1);
+					auto v = (j + jitter.v) / (settings.image_height - 1);
+					state.accum[state.current.size] = colour(0, 0, 0);
+					state.current.push(cam.get_ray(u, v), colour(1, 1, 1), local, sample_index, 0, 0);
+				}
+			}
+		}
+		RT_COUNT(primary_rays, state.current.size);
+		// with the independent sampler bounces draw from one stream per tile, so results don't depend
+		// on which thread got the tile
+		seed_rng(batch_seed(pixel_seed(settings, ~static_cast<uint64_t>(t.y0 * settings.image_width + t.x0))));
+
+		for (int depth = 0; depth < settings.max_depth && state.current.size > 0; ++depth) {
+			path_queue& in = state.current;
+			if (depth > 0)
+				RT_COUNT(secondary_rays, in.size);
+
+			// intersect, paths that escape pick up the background and finish here
+			size_t kind_count[n_material_kinds] = {};
+			for (size_t i = 0; i < in.size; ++i) {
+				hit_record& rec = state.hits[i];
+				ray r = in.get_ray(i);
+				bool hit = world.hit(r, ray_epsilon, infinity, rec);
+				if (hit) {
+					kind_count[static_cast<int>(rec.mat_ptr->kind)]++;
+				} else {
+					rec.mat_ptr = nullptr;
+					RT_COUNT(escaped_paths, 1);
+					state.sample_radiance(in, i) += in.get_throughput(i) * lighting.environment(r);
+				}
+				// Same AOVs as ray_colour records. Specular surfaces' attenuation is their albedo, so
+				// a path still following them has the albedo so far as its throughput, and a camera
+				// ray's is one. Paths on their last bounce won't be traced any further, so what they've
+				// followed so far is all there is.
+				if (aovs) {
+					first_hit& pending = state.pending_hits[i];
+					pending.depth = -1;
+					if (in.aov_depth[i] >= 0) {
+						first_hit h;
+						h.albedo = in.get_throughput(i);
+						h.depth = in.aov_depth[i];
+						bool following = true;
+						if (hit)
+							following = record_first_hit(r, rec, h);
+						else
+							record_first_escape(r, lighting, h);
+						if (hit && following && depth < settings.max_depth - 1)
+							pending = h;
+						else
+							state.first_hits[in.pixel[i]].add(h);
+					}
+				}
+			}
+
+			// bin the hits by material kind with a counting sort
+			size_t kind_start[n_material_kinds + 1] = {};
+			for (int k = 0; k < n_material_kinds; ++k)
+				kind_start[k + 1] = kind_start[k] + kind_count[k];
+			size_t kind_fill[n_material_kinds];
+			for (int k = 0; k < n_material_kinds; ++k)
+				kind_fill[k] = kind_start[k];
+			for (size_t i = 0; i < in.size; ++i) {
+				if (state.hits[i].mat_ptr)
+					state.by_material[kind_fill[static_cast<int>(state.hits[i].mat_ptr->kind)]++] = static_cast<uint32_t>(i);
+			}
+
+			// shade each bin, surviving paths are compacted into the next queue as they're shaded, lights
+			// aren't sampled on the last bounce for the same reason as in ray_colour
+			state.next.size = 0;
+			state.shadow.size = 0;
+			const uint32_t* bins = state.by_material;
+			bool sample_lights = depth < settings.max_depth - 1;
+			shade_batch<lambertian>(bins + kind_start[0], kind_count[0], state, settings, t, depth, lighting, sample_lights);
+			shade_batch<metal>(bins + kind_start[1], kind_count[1], state, settings, t, depth, lighting, sample_lights);
+			shade_batch<dielectric>(bins + kind_start[2], kind_count[2], state, settings, t, depth, lighting, sample_lights);
+			shade_batch<diffuse_light>(bins + kind_start[3], kind_count[3], state, settings, t, depth, lighting, sample_lights);
+			shade_batch<material>(bins + kind_start[4], kind_count[4], state, settings, t, depth, lighting, sample_lights);
+
+			// trace the light samples
+			const path_queue& shadow = state.shadow;
+			for (size_t i = 0; i < shadow.size; ++i)
+				state.sample_radiance(shadow, i) += shadow.get_throughput(i) * shadow_radiance(shadow.get_ray(i), world);
+
+			std::swap(state.current, state.next);
+		}
+		// anything still going after max_depth bounces contributes nothing, same as ray_colour
+		RT_COUNT(depth_cutoffs, state.current.size);
+
+		// the batch's samples onto their pixels', in sample order as they'd have been in one batch
+		for (size_t p = 0; p < n_pixels; ++p) {
+			const colour* samples = state.accum + p * count;
+			for (int s = 0; s < count; ++s) {
+				state.pixel_sums[p] += samples[s];
+				real l = luminance(samples[s]);
+				state.luminance_squares[p] += l * l;
+			}
+		}
+	}
+
+	// pixels' paths are shaded together, so each gets an even share of the tile's time
+	RT_STATS_ONLY(float pixel_cost = static_cast<float>((stats_clock_seconds() - tile_start) / n_pixels);)
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			auto local = (j - t.y0) * t.width() + (i - t.x0);
+			accum.add(j * settings.image_width + i, state.pixel_sums[local], settings.samples_per_pixel);
+			if (aovs) {
+				const first_hit& sums = state.first_hits[local];
+				accum.add_aovs(j * settings.image_width + i, sums.albedo, sums.normal, sums.depth, state.luminance_squares[local]);
+			}
+			RT_STATS_ONLY(accum.cost[j * settings.image_width + i] += pixel_cost;)
+		}
+	}
+}
+
+#endif